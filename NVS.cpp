@@ -1,12 +1,29 @@
 #include "include/NVS.h"
 #include "string.h"
 
+#include <mutex>
+
 #define CHECK_LEN(key)                         \
   if (strlen(key) > NVS_KEY_NAME_MAX_SIZE - 1) \
     return ESP_ERR_INVALID_ARG;
 
+#ifndef NVS_MAX_MOUNTED_PARTITIONS
+#define NVS_MAX_MOUNTED_PARTITIONS 4
+#endif
+
 const char *defaultNvsPartitionName = "nvs";
 
+// Partitions are mounted once by the first Nvs that uses them and unmounted by the last one,
+// so short-lived instances don't rescan the partition and can't unmount it under each other.
+struct MountedPartition
+{
+  const esp_partition_t *partition;
+  uint16_t users;
+};
+
+static MountedPartition mounted_partitions[NVS_MAX_MOUNTED_PARTITIONS];
+static std::mutex mounted_partitions_lock;
+
 Nvs::Nvs() : Nvs(defaultNvsPartitionName)
 {
 }
@@ -28,9 +45,42 @@ Nvs::Nvs(const char *partition_label, const char *namespace_name, nvs_open_mode_
   _err = open(namespace_name, open_mode);
 }
 
+Nvs::Nvs(NvsBackend &backend, const char *namespace_name, nvs_open_mode_t open_mode)
+{
+  _backend = &backend;
+  _err = open(namespace_name, open_mode);
+}
+
+Nvs::Nvs(Nvs &parent, const char *namespace_name)
+{
+  _auto_commit = parent._auto_commit;
+  _batch_depth = parent._batch_depth;
+  _concurrent = parent._concurrent;
+  _compress_min = parent._compress_min;
+  alloc_codec_buffer();
+  _allocator = parent._allocator;
+
+  // the partition is mounted by the parent, this only counts one more user
+  if (parent._partition != NULL)
+    _err = init(parent._partition->label);
+  else
+    _backend = parent._backend;
+  if (_err == ESP_OK)
+    _err = open(namespace_name, parent._open_mode);
+}
+
 Nvs::~Nvs()
 {
+  for (uint8_t i = 0; i < _child_count; i++)
+    delete _children[i];
+  delete _async;
+  _async = NULL;
+  flush();
+  if (_commit_pending)
+    commit();
   close();
+  delete _cache;
+  free(_codec_buffer);
   deinit();
 }
 
@@ -38,21 +88,72 @@ esp_err_t Nvs::init(const char *partition_label)
 {
   CHECK_LEN(partition_label);
 
-  _partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_DATA_NVS, partition_label);
-  if (_partition == NULL)
+  std::lock_guard<std::mutex> lock(mounted_partitions_lock);
+
+  MountedPartition *free_slot = NULL;
+  for (MountedPartition &mounted : mounted_partitions)
+  {
+    if (mounted.users == 0)
+    {
+      if (free_slot == NULL)
+        free_slot = &mounted;
+      continue;
+    }
+    if (strcmp(mounted.partition->label, partition_label) == 0)
+    {
+      mounted.users++;
+      _partition = mounted.partition;
+      _flash = NvsFlashBackend(_partition->label);
+      return ESP_OK;
+    }
+  }
+
+  if (free_slot == NULL)
+    return ESP_ERR_NO_MEM;
+
+  const esp_partition_t *partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_DATA_NVS, partition_label);
+  if (partition == NULL)
     return ESP_FAIL;
 
-  _err = nvs_flash_init_partition_ptr(_partition);
+  esp_err_t err = nvs_flash_init_partition_ptr(partition);
+
+  if (err == ESP_ERR_NVS_NO_FREE_PAGES)
+  {
+    err = nvs_flash_erase_partition_ptr(partition);
+    if (err == ESP_OK)
+      err = nvs_flash_init_partition_ptr(partition);
+  }
 
-  if (_err == ESP_ERR_NVS_NO_FREE_PAGES)
-    _err = nvs_flash_erase_partition_ptr(_partition);
+  if (err != ESP_OK)
+    return err;
 
-  return nvs_flash_init_partition_ptr(_partition);
+  free_slot->partition = partition;
+  free_slot->users = 1;
+  _partition = partition;
+  _flash = NvsFlashBackend(_partition->label);
+  return ESP_OK;
 }
 
 esp_err_t Nvs::deinit()
 {
-  _err = nvs_flash_deinit_partition(_partition->label);
+  if (_partition == NULL)
+    return ESP_OK;
+
+  std::lock_guard<std::mutex> lock(mounted_partitions_lock);
+
+  _err = ESP_OK;
+  for (MountedPartition &mounted : mounted_partitions)
+  {
+    if (mounted.users == 0 || mounted.partition != _partition)
+      continue;
+    if (--mounted.users == 0)
+    {
+      _err = nvs_flash_deinit_partition(mounted.partition->label);
+      mounted.partition = NULL;
+    }
+    break;
+  }
+
   _partition = NULL;
   return _err;
 }
@@ -60,312 +161,1137 @@ esp_err_t Nvs::deinit()
 esp_err_t Nvs::open(const char *namespace_name, nvs_open_mode_t open_mode)
 {
   CHECK_LEN(namespace_name);
-  return nvs_open_from_partition(_partition->label, namespace_name, open_mode, &_nvs_handle);
+  strcpy(_namespace, namespace_name);
+  _open_mode = open_mode;
+  return _backend->open(namespace_name, open_mode, &_nvs_handle);
 }
 
 void Nvs::close()
 {
-  nvs_close(_nvs_handle);
+  _backend->close(_nvs_handle);
 }
 
 esp_err_t Nvs::setBoolean(const char *key, bool value)
 {
-  _err = nvs_set_i8(_nvs_handle, key, value ? 1 : 0);
-  if (_err != ESP_OK)
-    return _err;
-  return nvs_commit(_nvs_handle);
+  return set(key, value);
 }
 
 esp_err_t Nvs::setUInt8(const char *key, uint8_t value)
 {
-  _err = nvs_set_u8(_nvs_handle, key, value);
-  if (_err != ESP_OK)
-    return _err;
-  return nvs_commit(_nvs_handle);
+  return set(key, value);
 }
 
 esp_err_t Nvs::setInt16(const char *key, int16_t value)
 {
-  CHECK_LEN(key);
-  _err = nvs_set_i16(_nvs_handle, key, value);
-  if (_err != ESP_OK)
-    return _err;
-  return nvs_commit(_nvs_handle);
+  return set(key, value);
 }
 
 esp_err_t Nvs::setUInt16(const char *key, uint16_t value)
 {
-  CHECK_LEN(key);
-  _err = nvs_set_u16(_nvs_handle, key, value);
-  if (_err != ESP_OK)
-    return _err;
-  return nvs_commit(_nvs_handle);
+  return set(key, value);
 }
 
 esp_err_t Nvs::setInt32(const char *key, int32_t value)
 {
-  CHECK_LEN(key);
-  _err = nvs_set_i32(_nvs_handle, key, value);
-  if (_err != ESP_OK)
-    return _err;
-  return nvs_commit(_nvs_handle);
+  return set(key, value);
 }
 
 esp_err_t Nvs::setUInt32(const char *key, uint32_t value)
 {
-  CHECK_LEN(key);
-  _err = nvs_set_u32(_nvs_handle, key, value);
-  if (_err != ESP_OK)
-    return _err;
-  return nvs_commit(_nvs_handle);
+  return set(key, value);
 }
 
 esp_err_t Nvs::setInt64(const char *key, int64_t value)
 {
-  CHECK_LEN(key);
-  _err = nvs_set_i64(_nvs_handle, key, value);
-  if (_err != ESP_OK)
-    return _err;
-  return nvs_commit(_nvs_handle);
+  return set(key, value);
 }
 
 esp_err_t Nvs::setUInt64(const char *key, uint64_t value)
 {
-  CHECK_LEN(key);
-  _err = nvs_set_u64(_nvs_handle, key, value);
-  if (_err != ESP_OK)
-    return _err;
-  return nvs_commit(_nvs_handle);
+  return set(key, value);
 }
 
 esp_err_t Nvs::setFloat(const char *key, float value)
 {
-  CHECK_LEN(key);
-  return setObject(key, &value, sizeof(float));
+  return set(key, value);
 }
 
 esp_err_t Nvs::setDouble(const char *key, double value)
 {
-  CHECK_LEN(key);
-  return setObject(key, &value, sizeof(double));
+  return set(key, value);
 }
 
-esp_err_t Nvs::setCharArray(const char *key, const char *value)
+esp_err_t Nvs::get_scalar(const char *key, nvs_type_t type, uint64_t *value)
 {
-  CHECK_LEN(key);
-  if (value == nullptr)
-  {
-    erase(key);
-    return true;
-  }
-
-  if (strlen(key) > 3999)
-    return ESP_ERR_INVALID_ARG;
+  esp_err_t err = get_scalar_value(key, type, value);
+  NVS_STAT(_stats.get(type, err));
+  return err;
+}
 
-  _err = nvs_set_str(_nvs_handle, key, value);
-  if (_err != ESP_OK)
-    return _err;
-  return nvs_commit(_nvs_handle);
+esp_err_t Nvs::get_scalar_value(const char *key, nvs_type_t type, uint64_t *value)
+{
+  return _backend->getScalar(_nvs_handle, key, nvs_entry_type(type), value);
 }
 
-esp_err_t Nvs::setObject(const char *key, void *value, size_t length)
+esp_err_t Nvs::set_scalar(const char *key, nvs_type_t type, uint64_t value)
 {
-  _err = nvs_set_blob(_nvs_handle, key, value, length);
-  if (_err != ESP_OK)
-    return _err;
-  return nvs_commit(_nvs_handle);
+  esp_err_t err = set_scalar_value(key, type, value);
+  NVS_STAT(_stats.set(type, nvs_scalar_size(type), err));
+  return err;
 }
 
-esp_err_t Nvs::check_key_and_type(const char *key, nvs_type_t checkType)
+esp_err_t Nvs::set_scalar_value(const char *key, nvs_type_t type, uint64_t value)
 {
-  if (strlen(key) > NVS_KEY_NAME_MAX_SIZE - 1)
-    return ESP_FAIL;
+  return _backend->setScalar(_nvs_handle, key, nvs_entry_type(type), value);
+}
 
-  nvs_type_t *type = NULL;
-  esp_err_t _err = nvs_find_key(_nvs_handle, key, type);
-  if (_err != ESP_OK || type == nullptr || *type != checkType)
-    return ESP_FAIL;
+esp_err_t Nvs::flush_if_due()
+{
+  if (_cache->dirtyCount() >= _write_back_max_dirty ||
+      std::chrono::steady_clock::now() - _dirty_since >= _write_back_interval)
+    return flush();
   return ESP_OK;
 }
 
-bool Nvs::getBoolean(const char *key, bool defaultValue)
+bool Nvs::store_dirty(const NvsKey &key, nvs_type_t type, uint64_t value)
 {
-  if (check_key_and_type(key, NVS_TYPE_I8) == ESP_FAIL)
-    return defaultValue;
+  if (_cache->dirtyCount() == 0)
+    _dirty_since = std::chrono::steady_clock::now();
 
-  int8_t ret;
-  _err = nvs_get_i8(_nvs_handle, key, &ret);
-  if (_err == ESP_OK)
+  if (_cache->store(key, type, value, true))
+    return true;
+
+  // no room left for another dirty key: write everything back and try once more
+  if (flush() != ESP_OK)
+    return false;
+  _dirty_since = std::chrono::steady_clock::now();
+  return _cache->store(key, type, value, true);
+}
+
+esp_err_t Nvs::flush()
+{
+  wait_async();
+  NvsGuard guard(_lock, _concurrent, NvsGuard::EXCLUSIVE);
+  if (_cache == NULL || _cache->dirtyCount() == 0)
+    return ESP_OK;
+
+  esp_err_t err = _cache->writeDirty([this](const char *key, nvs_type_t type, uint64_t value)
+                                     { return set_scalar(key, type, value); });
+  if (err != ESP_OK)
+    return result(err);
+  return commit_if_needed();
+}
+
+void Nvs::setWriteBack(bool enabled, uint32_t flush_interval_ms, uint16_t max_dirty)
+{
+  NvsGuard guard(_lock, _concurrent, NvsGuard::EXCLUSIVE);
+  if (!enabled)
+    flush();
+  else
+    setCache(true);
+
+  _write_back = enabled;
+  _write_back_interval = std::chrono::milliseconds(flush_interval_ms);
+  _write_back_max_dirty = max_dirty;
+}
+
+void Nvs::setAsync(bool enabled)
+{
+  if (!enabled)
   {
-    return ret == 1;
+    // submit() checks the flag under the shared lock: once this holds the lock nobody queues
+    // anything, and the worker waits for the lock before it pops. What is left is written here, the
+    // worker ends on its own and the queue stays around for the threads still calling wait_async()
+    NvsGuard guard(_lock, _concurrent, NvsGuard::EXCLUSIVE);
+    if (!_async_on)
+      return;
+    _async_on = false;
+    _async->drain();
+    _async->stop();
+    return;
   }
-  return defaultValue;
+
+  if (_async_on)
+    return;
+  setCache(true);
+  setWriteBack(false);
+  setConcurrent(true);
+  if (_async == NULL)
+    _async = new NvsAsync(*this);
+  else
+    _async->start();
+  _async_on = true;
 }
 
-uint8_t Nvs::getUInt8(const char *key, uint8_t defaultValue)
+esp_err_t Nvs::submit(const NvsKey &key, nvs_type_t type, uint64_t value, NvsWriteCallback done, void *arg)
 {
-  if (check_key_and_type(key, NVS_TYPE_U8) == ESP_FAIL)
-    return defaultValue;
-
-  uint8_t ret;
-  _err = nvs_get_u8(_nvs_handle, key, &ret);
-  if (_err == ESP_OK)
   {
-    return ret;
+    // shared: submitters and readers don't wait for each other, only for the worker writing a batch
+    NvsGuard guard(_lock, _concurrent, NvsGuard::SHARED);
+    if (_async_on)
+    {
+      // the cache answers reads until the worker gets to the key; pushing under the cache mutex
+      // leaves the cache and the queue in the same order when two threads write the same key
+      std::unique_lock<std::mutex> lock = cache_guard();
+      if (!_async->submit(key, type, value, done, arg))
+        return ESP_ERR_NO_MEM;
+      if (_cache != NULL)
+        _cache->store(key, type, value);
+      return ESP_OK;
+    }
   }
-  return defaultValue;
+
+  // async mode was disabled since the caller looked
+  esp_err_t err = write_scalar(key, type, value);
+  if (done != NULL)
+    done(key.c_str(), err, arg);
+  return err;
 }
 
-int16_t Nvs::getInt16(const char *key, int16_t defaultValue)
+esp_err_t Nvs::write_scalar(const NvsKey &key, nvs_type_t type, uint64_t value)
 {
-  if (check_key_and_type(key, NVS_TYPE_I16) == ESP_FAIL)
-    return defaultValue;
+  NvsGuard guard(_lock, _concurrent, NvsGuard::EXCLUSIVE);
+  esp_err_t err = set_scalar(key.c_str(), type, value);
+  if (err != ESP_OK)
+  {
+    cache_remove(key);
+    return result(err);
+  }
+  cache_store(key, type, value);
+  return commit_if_needed();
+}
 
-  int16_t ret;
-  _err = nvs_get_i16(_nvs_handle, key, &ret);
-  if (_err == ESP_OK)
+// index of the next write of the same key, count if there is none
+static size_t next_write(const NvsWrite *writes, size_t count, size_t index)
+{
+  for (size_t i = index + 1; i < count; i++)
   {
-    return ret;
+    if (writes[i].hash == writes[index].hash && strcmp(writes[i].key, writes[index].key) == 0)
+      return i;
   }
-  return defaultValue;
+  return count;
 }
 
-uint16_t Nvs::getUInt16(const char *key, uint16_t defaultValue)
+// called by NvsAsync with the lock held exclusively
+void Nvs::write_batch(NvsWrite *writes, size_t count)
 {
-  if (check_key_and_type(key, NVS_TYPE_U16) == ESP_FAIL)
-    return defaultValue;
+  esp_err_t results[NVS_ASYNC_QUEUE_SIZE];
+  bool written = false;
 
-  uint16_t ret;
-  _err = nvs_get_u16(_nvs_handle, key, &ret);
-  if (_err == ESP_OK)
+  // only the last write of a key reaches flash, the earlier ones share its result
+  for (size_t i = 0; i < count; i++)
+  {
+    results[i] = ESP_OK;
+    if (next_write(writes, count, i) < count)
+      continue;
+    results[i] = set_scalar(writes[i].key, writes[i].type, writes[i].value);
+    written |= results[i] == ESP_OK;
+  }
+
+  // inside a batch or with auto-commit off the commit is left to the caller, like for any setter
+  esp_err_t err = written ? commit_if_needed() : ESP_OK;
+
+  for (size_t i = 0; i < count; i++)
   {
-    return ret;
+    size_t last = i;
+    for (size_t next = next_write(writes, count, i); next < count; next = next_write(writes, count, next))
+      last = next;
+    esp_err_t result = results[last] != ESP_OK ? results[last] : err;
+
+    // the cache holds a value flash doesn't have
+    if (result != ESP_OK && last == i)
+      cache_remove(NvsKey::dynamic(writes[i].key));
+    if (writes[i].done != NULL)
+      writes[i].done(writes[i].key, result, writes[i].arg);
   }
-  return defaultValue;
 }
 
-int32_t Nvs::getInt32(const char *key, int32_t defaultValue)
+void Nvs::wait_async()
 {
-  if (check_key_and_type(key, NVS_TYPE_I32) == ESP_FAIL)
-    return defaultValue;
+  // a string / blob write or an erase must not be overtaken by a queued write of the same key.
+  // Skipped when the calling thread already holds the lock: the outer call has waited
+  if (_async != NULL && !_lock.owned())
+    _async->flush();
+}
 
-  int32_t ret;
-  _err = nvs_get_i32(_nvs_handle, key, &ret);
-  if (_err == ESP_OK)
+uint16_t Nvs::dirtyCount()
+{
+  NvsGuard guard(_lock, _concurrent, NvsGuard::SHARED);
+  return _cache != NULL ? _cache->dirtyCount() : 0;
+}
+
+esp_err_t Nvs::setCharArray(const char *key, const char *value)
+{
+  CHECK_LEN(key);
+  if (value == nullptr)
+    return erase(key);
+
+  size_t length = strlen(value) + 1;
+  if (length > 4000)
+    return ESP_ERR_INVALID_ARG;
+
+  wait_async();
+  NvsGuard guard(_lock, _concurrent, NvsGuard::EXCLUSIVE);
+  NvsKey nvs_key = NvsKey::dynamic(key);
+  if (unchanged_data(nvs_key, NVS_TYPE_STR, value, length))
+    return result(ESP_OK);
+
+  esp_err_t err = set_data(key, NVS_TYPE_STR, value, length);
+  if (err != ESP_OK)
   {
-    return ret;
+    cache_remove(nvs_key);
+    return result(err);
   }
-  return defaultValue;
+  cache_store(nvs_key, NVS_TYPE_STR, NvsCache::digest(value, length));
+  return commit_if_needed();
 }
 
-uint32_t Nvs::getUInt32(const char *key, uint32_t defaultValue)
+esp_err_t Nvs::setObject(const char *key, const void *value, size_t length)
 {
-  if (check_key_and_type(key, NVS_TYPE_U32) == ESP_FAIL)
-    return defaultValue;
+  CHECK_LEN(key);
+  wait_async();
+  NvsGuard guard(_lock, _concurrent, NvsGuard::EXCLUSIVE);
+  NvsKey nvs_key = NvsKey::dynamic(key);
+  if (unchanged_data(nvs_key, NVS_TYPE_BLOB, value, length))
+    return result(ESP_OK);
 
-  uint32_t ret;
-  _err = nvs_get_u32(_nvs_handle, key, &ret);
-  if (_err == ESP_OK)
+  esp_err_t err = set_data(key, NVS_TYPE_BLOB, value, length);
+  if (err != ESP_OK)
   {
-    return ret;
+    cache_remove(nvs_key);
+    return result(err);
   }
-  return defaultValue;
+  cache_store(nvs_key, NVS_TYPE_BLOB, NvsCache::digest(value, length));
+  return commit_if_needed();
 }
 
-int64_t Nvs::getInt64(const char *key, int64_t defaultValue)
+esp_err_t Nvs::set_data(const char *key, nvs_type_t type, const void *data, size_t length)
 {
-  if (check_key_and_type(key, NVS_TYPE_I64) == ESP_FAIL)
-    return defaultValue;
+  size_t packed_length = 0;
+  uint8_t *packed = NULL;
+  if (_compress_min != 0 && length >= _compress_min && _codec_buffer != NULL)
+  {
+    packed = _codec_buffer + NVS_CODEC_TABLE_SIZE;
+    // the packed value has to end up smaller and fit in the scratch space behind the match table
+    size_t room = length - 1 < NVS_CODEC_SCRATCH_SIZE ? length - 1 : NVS_CODEC_SCRATCH_SIZE;
+    packed_length = nvs_pack(type, data, length, packed, room, (uint32_t *)_codec_buffer);
+  }
 
-  int64_t ret;
-  _err = nvs_get_i64(_nvs_handle, key, &ret);
-  if (_err == ESP_OK)
+  esp_err_t err;
+  if (packed_length != 0)
+    err = _backend->setBlob(_nvs_handle, key, packed, packed_length);
+  else if (type == NVS_TYPE_STR)
+    err = _backend->setStr(_nvs_handle, key, (const char *)data);
+  else
+    err = _backend->setBlob(_nvs_handle, key, data, length);
+  NVS_STAT(_stats.set(type, packed_length != 0 ? packed_length : length, err));
+
+  // a packed string is a blob and NVS keeps the entry of the other type next to the new one. The old
+  // entry is only dropped once the new one is in place; findKey() and eraseKey() both find it first.
+  nvs_type_t stored_type;
+  if (err == ESP_OK && type == NVS_TYPE_STR && _compress_min != 0 &&
+      _backend->findKey(_nvs_handle, key, &stored_type) == ESP_OK &&
+      stored_type != (packed_length != 0 ? NVS_TYPE_BLOB : NVS_TYPE_STR))
+    _backend->eraseKey(_nvs_handle, key);
+  return err;
+}
+
+bool Nvs::unchanged(const NvsKey &key, nvs_type_t type, uint64_t value)
+{
+  // without the cache a set is a plain write, no read is added in front of it
+  if (_cache == NULL)
+    return false;
+
+  // a miss is read once into the cache, like a get would; stats only count the caller's operations
+  uint64_t stored;
+  if (!_cache->peek(key, type, &stored))
   {
-    return ret;
+    if (get_scalar_value(key.c_str(), type, &stored) != ESP_OK)
+      return false;
+    cache_store(key, type, stored);
   }
-  return defaultValue;
+  if (stored != value)
+    return false;
+
+  _elided.fetch_add(1, std::memory_order_relaxed);
+  return true;
 }
 
-uint64_t Nvs::getUInt64(const char *key, uint64_t defaultValue)
+bool Nvs::unchanged_data(const NvsKey &key, nvs_type_t type, const void *data, size_t length)
 {
-  if (check_key_and_type(key, NVS_TYPE_U64) == ESP_FAIL)
-    return defaultValue;
+  uint64_t digest = NvsCache::digest(data, length);
+  uint64_t stored_digest;
 
-  uint64_t ret;
-  _err = nvs_get_u64(_nvs_handle, key, &ret);
-  if (_err == ESP_OK)
+  if (_cache != NULL && _cache->peek(key, type, &stored_digest))
+  {
+    if (stored_digest != digest)
+      return false;
+  }
+  else
   {
-    return ret;
+    // no digest yet: short values are compared on the stack, longer ones are simply written
+    if (length > NVS_ELIDE_COMPARE_SIZE)
+      return false;
+    uint8_t stored[NVS_ELIDE_COMPARE_SIZE];
+    size_t stored_length = sizeof(stored);
+    esp_err_t err = type == NVS_TYPE_STR ? _backend->getStr(_nvs_handle, key.c_str(), (char *)stored, &stored_length)
+                                         : _backend->getBlob(_nvs_handle, key.c_str(), stored, &stored_length);
+    if (err != ESP_OK || stored_length != length || memcmp(stored, data, length) != 0)
+      return false;
+    cache_store(key, type, digest);
   }
-  return defaultValue;
+
+  _elided.fetch_add(1, std::memory_order_relaxed);
+  return true;
+}
+
+std::unique_lock<std::mutex> Nvs::cache_guard()
+{
+  return _concurrent ? std::unique_lock<std::mutex>(_cache_lock) : std::unique_lock<std::mutex>();
+}
+
+bool Nvs::cache_find(const NvsKey &key, nvs_type_t type, uint64_t *value)
+{
+  if (_cache == NULL)
+    return false;
+  std::unique_lock<std::mutex> lock = cache_guard();
+  return _cache->find(key, type, value);
+}
+
+void Nvs::cache_store(const NvsKey &key, nvs_type_t type, uint64_t value)
+{
+  if (_cache == NULL)
+    return;
+  std::unique_lock<std::mutex> lock = cache_guard();
+  _cache->store(key, type, value);
+}
+
+void Nvs::cache_fill(const NvsKey &key, nvs_type_t type, uint64_t value)
+{
+  if (_cache == NULL)
+    return;
+  std::unique_lock<std::mutex> lock = cache_guard();
+  _cache->fill(key, type, value);
+}
+
+void Nvs::cache_remove(const NvsKey &key)
+{
+  if (_cache == NULL)
+    return;
+  std::unique_lock<std::mutex> lock = cache_guard();
+  _cache->remove(key);
+}
+
+bool Nvs::getBoolean(const char *key, bool defaultValue)
+{
+  return get(key, defaultValue);
+}
+
+int8_t Nvs::getInt8(const char *key, int8_t defaultValue)
+{
+  return get(key, defaultValue);
+}
+
+uint8_t Nvs::getUInt8(const char *key, uint8_t defaultValue)
+{
+  return get(key, defaultValue);
+}
+
+int16_t Nvs::getInt16(const char *key, int16_t defaultValue)
+{
+  return get(key, defaultValue);
+}
+
+uint16_t Nvs::getUInt16(const char *key, uint16_t defaultValue)
+{
+  return get(key, defaultValue);
+}
+
+int32_t Nvs::getInt32(const char *key, int32_t defaultValue)
+{
+  return get(key, defaultValue);
+}
+
+uint32_t Nvs::getUInt32(const char *key, uint32_t defaultValue)
+{
+  return get(key, defaultValue);
+}
+
+int64_t Nvs::getInt64(const char *key, int64_t defaultValue)
+{
+  return get(key, defaultValue);
+}
+
+uint64_t Nvs::getUInt64(const char *key, uint64_t defaultValue)
+{
+  return get(key, defaultValue);
 }
 
 float Nvs::getFloat(const char *key, float defaultValue)
 {
-  // all checks are done in getObject
-  float *ret = (float *)getObject(key, &defaultValue);
-  return *ret;
+  return get(key, defaultValue);
 }
 
 double Nvs::getDouble(const char *key, double defaultValue)
 {
-  // all checks are done in getObject
-  double *ret = (double *)getObject(key, &defaultValue);
-  return *ret;
+  return get(key, defaultValue);
 }
 
-char *Nvs::getCharArray(const char *key, const char *defaultValue)
+template <typename T>
+esp_err_t Nvs::migrate_floating(const char *key)
+{
+  CHECK_LEN(key);
+
+  wait_async();
+  NvsGuard guard(_lock, _concurrent, NvsGuard::EXCLUSIVE);
+  T value;
+  size_t length = sizeof(value);
+  esp_err_t err = _backend->getBlob(_nvs_handle, key, &value, &length);
+  if (err != ESP_OK)
+    return result(err);
+  if (length != sizeof(value))
+    return result(ESP_ERR_NVS_TYPE_MISMATCH);
+
+  // nvs_erase_key removes the key whatever its type, so the blob has to go before the new entry is written
+  err = _backend->eraseKey(_nvs_handle, key);
+  if (err != ESP_OK)
+    return result(err);
+  return set(key, value);
+}
+
+esp_err_t Nvs::migrateFloat(const char *key)
+{
+  return migrate_floating<float>(key);
+}
+
+esp_err_t Nvs::migrateDouble(const char *key)
+{
+  return migrate_floating<double>(key);
+}
+
+esp_err_t Nvs::get_data(const char *key, nvs_type_t type, void *buffer, size_t *length)
 {
-  if (check_key_and_type(key, NVS_TYPE_STR) == ESP_FAIL)
+  size_t room = buffer != NULL ? *length : 0;
+  esp_err_t err;
+  if (type == NVS_TYPE_STR)
   {
-    if (defaultValue == nullptr)
-      return nullptr;
-    return strdup(defaultValue);
+    err = _backend->getStr(_nvs_handle, key, (char *)buffer, length);
+    // a packed string is stored as a blob
+    if (err != ESP_ERR_NVS_NOT_FOUND)
+      return err;
+    *length = room;
   }
 
-  size_t required_size;
+  err = _backend->getBlob(_nvs_handle, key, buffer, length);
+  if (err == ESP_OK && buffer == NULL)
+    return query_packed(key, type, length);
+  size_t original;
+  if (err == ESP_OK && nvs_packed(type, buffer, *length, &original))
+    return nvs_unpack(buffer, *length, room, length);
+  // a plain blob is no string
+  if (err == ESP_OK && type == NVS_TYPE_STR)
+    return ESP_ERR_NVS_NOT_FOUND;
+  return err;
+}
 
-  _err = nvs_get_str(_nvs_handle, key, NULL, &required_size);
-  if (_err != ESP_OK)
+esp_err_t Nvs::query_packed(const char *key, nvs_type_t type, size_t *length)
+{
+  // set_data() only packs into NVS_CODEC_SCRATCH_SIZE bytes: a longer blob is a plain one
+  size_t stored = *length;
+  if (stored < NVS_CODEC_HEADER_SIZE || stored > NVS_CODEC_SCRATCH_SIZE)
+    return type == NVS_TYPE_STR ? ESP_ERR_NVS_NOT_FOUND : ESP_OK;
+
+  // NVS only reads a blob whole, the header tells the room a packed value expands into
+  uint8_t *value = (uint8_t *)_allocator->allocate(stored);
+  if (value == NULL)
+    return ESP_ERR_NO_MEM;
+  size_t read = stored;
+  esp_err_t err = _backend->getBlob(_nvs_handle, key, value, &read);
+  size_t original;
+  if (err == ESP_OK && nvs_packed(type, value, read, &original))
+    *length = original + NVS_CODEC_MARGIN(original);
+  else if (err == ESP_OK && type == NVS_TYPE_STR)
+    err = ESP_ERR_NVS_NOT_FOUND;
+  _allocator->deallocate(value, stored);
+  return err;
+}
+
+void *Nvs::get_data_copy(const char *key, nvs_type_t type, NvsAllocator &allocator, size_t *size, size_t *length)
+{
+  esp_err_t err = get_data(key, type, NULL, length);
+  void *value = NULL;
+  while (err == ESP_OK)
   {
-    if (defaultValue == nullptr)
-      return nullptr;
-    return strdup(defaultValue);
+    *size = *length;
+    value = allocator.allocate(*size);
+    if (value == NULL)
+    {
+      err = ESP_ERR_NO_MEM;
+      break;
+    }
+    err = get_data(key, type, value, length);
+    if (err != ESP_ERR_NVS_INVALID_LENGTH || *length <= *size)
+      break;
+    // the value grew since the size query (another instance), length is now the room it needs
+    allocator.deallocate(value, *size);
+    value = NULL;
+    err = ESP_OK;
+  }
+  if (err != ESP_OK && value != NULL)
+  {
+    allocator.deallocate(value, *size);
+    value = NULL;
   }
+  NVS_STAT(_stats.get(type, err));
+  result(err);
+  return value;
+}
 
-  char *value = (char *)malloc(required_size);
-  nvs_get_str(_nvs_handle, key, value, &required_size);
+char *Nvs::getCharArray(const char *key, const char *defaultValue)
+{
+  size_t size, length;
+  NvsGuard guard(_lock, _concurrent, NvsGuard::SHARED);
+  char *value = (char *)get_data_copy(key, NVS_TYPE_STR, NvsAllocator::heap(), &size, &length);
+  if (value == NULL && defaultValue != nullptr)
+    return strdup(defaultValue);
   return value;
 }
 
 void *Nvs::getObject(const char *key, void *defaultValue)
 {
-  if (check_key_and_type(key, NVS_TYPE_BLOB) == ESP_FAIL)
-    return defaultValue;
+  size_t size, length;
+  NvsGuard guard(_lock, _concurrent, NvsGuard::SHARED);
+  void *blob = get_data_copy(key, NVS_TYPE_BLOB, NvsAllocator::heap(), &size, &length);
+  return blob != NULL ? blob : defaultValue;
+}
 
-  size_t required_size;
-  _err = nvs_get_blob(_nvs_handle, key, NULL, &required_size);
-  if (_err != ESP_OK)
-    return defaultValue;
+NvsString Nvs::getString(const char *key, const char *default_value, NvsAllocator *allocator)
+{
+  if (allocator == NULL)
+    allocator = _allocator;
+
+  size_t size = 0, length;
+  char *value = NULL;
+  if (strlen(key) <= NVS_KEY_NAME_MAX_SIZE - 1)
+  {
+    NvsGuard guard(_lock, _concurrent, NvsGuard::SHARED);
+    value = (char *)get_data_copy(key, NVS_TYPE_STR, *allocator, &size, &length);
+  }
+  if (value == NULL && default_value != NULL)
+  {
+    size = strlen(default_value) + 1;
+    value = (char *)allocator->allocate(size);
+    if (value != NULL)
+      memcpy(value, default_value, size);
+  }
+  return NvsString(value, NvsDeleter{allocator, size});
+}
+
+NvsBlob Nvs::getBlob(const char *key, size_t *length, NvsAllocator *allocator)
+{
+  if (allocator == NULL)
+    allocator = _allocator;
+
+  size_t size = 0, blob_length = 0;
+  uint8_t *blob = NULL;
+  if (strlen(key) <= NVS_KEY_NAME_MAX_SIZE - 1)
+  {
+    NvsGuard guard(_lock, _concurrent, NvsGuard::SHARED);
+    blob = (uint8_t *)get_data_copy(key, NVS_TYPE_BLOB, *allocator, &size, &blob_length);
+  }
+  if (length != NULL)
+    *length = blob != NULL ? blob_length : 0;
+  return NvsBlob(blob, NvsDeleter{allocator, size});
+}
 
-  void *blob = (void *)malloc(required_size);
-  nvs_get_blob(_nvs_handle, key, blob, &required_size);
-  return blob;
+void Nvs::setAllocator(NvsAllocator &allocator)
+{
+  NvsGuard guard(_lock, _concurrent, NvsGuard::EXCLUSIVE);
+  _allocator = &allocator;
+}
+
+esp_err_t Nvs::getCharArray(const char *key, char *buffer, size_t *length)
+{
+  CHECK_LEN(key);
+  NvsGuard guard(_lock, _concurrent, NvsGuard::SHARED);
+  NVS_STAT(NvsStats::clock::time_point start = NvsStats::clock::now());
+  esp_err_t err = get_data(key, NVS_TYPE_STR, buffer, length);
+  NVS_STAT(_stats.getLatency(start); _stats.get(NVS_TYPE_STR, err));
+  return result(err);
+}
+
+esp_err_t Nvs::getCharArray(const char *key, std::span<char> buffer, size_t *length)
+{
+  size_t size = buffer.size();
+  esp_err_t err = getCharArray(key, buffer.data(), &size);
+  if (length != NULL)
+    *length = size;
+  return err;
+}
+
+esp_err_t Nvs::getObject(const char *key, void *buffer, size_t *length)
+{
+  CHECK_LEN(key);
+  NvsGuard guard(_lock, _concurrent, NvsGuard::SHARED);
+  NVS_STAT(NvsStats::clock::time_point start = NvsStats::clock::now());
+  esp_err_t err = get_data(key, NVS_TYPE_BLOB, buffer, length);
+  NVS_STAT(_stats.getLatency(start); _stats.get(NVS_TYPE_BLOB, err));
+  return result(err);
+}
+
+esp_err_t Nvs::getObject(const char *key, std::span<uint8_t> buffer, size_t *length)
+{
+  size_t size = buffer.size();
+  esp_err_t err = getObject(key, buffer.data(), &size);
+  if (length != NULL)
+    *length = size;
+  return err;
+}
+
+bool Nvs::exists(const char *key)
+{
+  NvsKey nvs_key = NvsKey::dynamic(key);
+  if (!nvs_key.valid())
+    return false;
+  NvsGuard guard(_lock, _concurrent, NvsGuard::SHARED);
+  // values held back by write-back mode are not in flash yet
+  if (_cache != NULL)
+  {
+    std::unique_lock<std::mutex> lock = cache_guard();
+    if (_cache->contains(nvs_key))
+      return true;
+  }
+  return _backend->findKey(_nvs_handle, key, NULL) == ESP_OK;
+}
+
+NvsEntries Nvs::entries(nvs_type_t type)
+{
+  return NvsEntries(_backend, _namespace, type, _nvs_handle, _namespace);
+}
+
+NvsEntries Nvs::partitionEntries(nvs_type_t type)
+{
+  return NvsEntries(_backend, NULL, type, _nvs_handle, _namespace);
 }
 
 esp_err_t Nvs::eraseAll()
 {
-  _err = nvs_erase_all(_nvs_handle);
-  if (_err != ESP_OK)
-    return _err;
-  return nvs_commit(_nvs_handle);
+  wait_async();
+  NvsGuard guard(_lock, _concurrent, NvsGuard::EXCLUSIVE);
+  esp_err_t err = _backend->eraseAll(_nvs_handle);
+  NVS_STAT(_stats.erase());
+  if (err != ESP_OK)
+    return result(err);
+  if (_cache != NULL)
+    _cache->clear();
+  return commit_if_needed();
 }
 
 esp_err_t Nvs::erase(const char *key)
 {
   CHECK_LEN(key);
-  _err = nvs_erase_key(_nvs_handle, key);
-  if (_err != ESP_OK)
-    return _err;
-  return nvs_commit(_nvs_handle);
+  wait_async();
+  NvsGuard guard(_lock, _concurrent, NvsGuard::EXCLUSIVE);
+  bool was_dirty = _cache != NULL && _cache->remove(NvsKey::dynamic(key));
+  esp_err_t err = _backend->eraseKey(_nvs_handle, key);
+  NVS_STAT(_stats.erase());
+  // a value that only lived in the write-back cache has nothing to erase in flash
+  if (err == ESP_ERR_NVS_NOT_FOUND && was_dirty)
+    return result(ESP_OK);
+  if (err != ESP_OK)
+    return result(err);
+  return commit_if_needed();
+}
+
+esp_err_t Nvs::commit()
+{
+  NvsGuard guard(_lock, _concurrent, NvsGuard::EXCLUSIVE);
+  _commit_pending = false;
+  NVS_STAT(NvsStats::clock::time_point start = NvsStats::clock::now());
+  esp_err_t err = _backend->commit(_nvs_handle);
+  NVS_STAT(_stats.commit(start));
+  return result(err);
+}
+
+esp_err_t Nvs::commit_if_needed()
+{
+  if (_auto_commit && _batch_depth == 0)
+    return commit();
+
+  _commit_pending = true;
+  return result(ESP_OK);
+}
+
+esp_err_t Nvs::result(esp_err_t err)
+{
+  // shared by every thread in concurrent mode, so it would only report somebody's last call
+  if (!_concurrent)
+    _err = err;
+  return err;
+}
+
+void Nvs::beginBatch()
+{
+  NvsGuard guard(_lock, _concurrent, NvsGuard::EXCLUSIVE);
+  _batch_depth++;
+  for (uint8_t i = 0; i < _child_count; i++)
+    _children[i]->beginBatch();
+}
+
+esp_err_t Nvs::commitBatch()
+{
+  NvsGuard guard(_lock, _concurrent, NvsGuard::EXCLUSIVE);
+  if (_batch_depth == 0)
+    return ESP_ERR_INVALID_STATE;
+
+  esp_err_t err = ESP_OK;
+  for (uint8_t i = 0; i < _child_count; i++)
+  {
+    esp_err_t child_err = _children[i]->commitBatch();
+    if (err == ESP_OK)
+      err = child_err;
+  }
+
+  if (--_batch_depth > 0 || !_commit_pending)
+    return err;
+  esp_err_t commit_err = commit();
+  return err != ESP_OK ? err : commit_err;
+}
+
+// ends a batch of this instance and its children without committing what it wrote
+void Nvs::close_batch()
+{
+  NvsGuard guard(_lock, _concurrent, NvsGuard::EXCLUSIVE);
+  for (uint8_t i = 0; i < _child_count; i++)
+    _children[i]->close_batch();
+  if (_batch_depth > 0)
+    _batch_depth--;
+}
+
+Nvs *Nvs::find_child(const char *namespace_name, uint32_t hash)
+{
+  for (uint8_t i = 0; i < _child_count; i++)
+  {
+    if (_child_hashes[i] == hash && strcmp(_children[i]->_namespace, namespace_name) == 0)
+      return _children[i];
+  }
+  return NULL;
+}
+
+Nvs *Nvs::child(const char *namespace_name)
+{
+  size_t length = strlen(namespace_name);
+  if (length == 0 || length > NVS_KEY_NAME_MAX_SIZE - 1)
+    return NULL;
+  if (strcmp(namespace_name, _namespace) == 0)
+    return this;
+
+  uint32_t hash = NvsKey::hash(namespace_name);
+  NvsGuard guard(_lock, _concurrent, NvsGuard::SHARED);
+  Nvs *found = find_child(namespace_name, hash);
+  if (found != NULL)
+    return found;
+  // another task may have opened it while the lock was released
+  if (guard.upgrade() && (found = find_child(namespace_name, hash)) != NULL)
+    return found;
+
+  if (_child_count == NVS_MAX_CHILDREN)
+  {
+    result(ESP_ERR_NO_MEM);
+    return NULL;
+  }
+  Nvs *child = new Nvs(*this, namespace_name);
+  if (child->_err != ESP_OK)
+  {
+    result(child->_err);
+    delete child;
+    return NULL;
+  }
+  _children[_child_count] = child;
+  _child_hashes[_child_count] = hash;
+  _child_count++;
+  return child;
+}
+
+void Nvs::setAutoCommit(bool auto_commit)
+{
+  NvsGuard guard(_lock, _concurrent, NvsGuard::EXCLUSIVE);
+  _auto_commit = auto_commit;
+}
+
+NvsBatch::NvsBatch(Nvs &nvs) : _nvs(nvs)
+{
+  _nvs.beginBatch();
+}
+
+NvsBatch::~NvsBatch()
+{
+  if (!_done)
+    _nvs.commitBatch();
+}
+
+esp_err_t NvsBatch::commit()
+{
+  if (_done)
+    return ESP_ERR_INVALID_STATE;
+  _done = true;
+  return _nvs.commitBatch();
+}
+
+void Nvs::setCache(bool enabled)
+{
+  NvsGuard guard(_lock, _concurrent, NvsGuard::EXCLUSIVE);
+  if (enabled && _cache == NULL)
+    _cache = new NvsCache();
+  else if (!enabled && _cache != NULL)
+  {
+    setWriteBack(false);
+    delete _cache;
+    _cache = NULL;
+  }
+}
+
+void Nvs::setCompression(size_t min_length)
+{
+  NvsGuard guard(_lock, _concurrent, NvsGuard::EXCLUSIVE);
+  _compress_min = min_length;
+  alloc_codec_buffer();
+}
+
+void Nvs::alloc_codec_buffer()
+{
+  if (_compress_min == 0)
+  {
+    free(_codec_buffer);
+    _codec_buffer = NULL;
+  }
+  else if (_codec_buffer == NULL)
+    _codec_buffer = (uint8_t *)malloc(NVS_CODEC_TABLE_SIZE + NVS_CODEC_SCRATCH_SIZE);
+}
+
+void Nvs::setConcurrent(bool enabled)
+{
+  _concurrent = enabled;
+}
+
+uint32_t Nvs::cacheHits()
+{
+  return _cache != NULL ? _cache->hits() : 0;
+}
+
+uint32_t Nvs::cacheMisses()
+{
+  return _cache != NULL ? _cache->misses() : 0;
+}
+
+// scalar members are copied through an integer of their own width, so this works whatever the byte order
+static void write_member(uint8_t *member, size_t size, uint64_t value)
+{
+  if (size == 1)
+    *member = (uint8_t)value;
+  else if (size == 2)
+  {
+    uint16_t v = (uint16_t)value;
+    memcpy(member, &v, size);
+  }
+  else if (size == 4)
+  {
+    uint32_t v = (uint32_t)value;
+    memcpy(member, &v, size);
+  }
+  else
+    memcpy(member, &value, sizeof(value));
+}
+
+static uint64_t read_member(const uint8_t *member, size_t size)
+{
+  if (size == 1)
+    return *member;
+  if (size == 2)
+  {
+    uint16_t v;
+    memcpy(&v, member, size);
+    return v;
+  }
+  if (size == 4)
+  {
+    uint32_t v;
+    memcpy(&v, member, size);
+    return v;
+  }
+  uint64_t v;
+  memcpy(&v, member, sizeof(v));
+  return v;
+}
+
+static void apply_default(const NvsField &field, uint8_t *member)
+{
+  if (field.type == NVS_TYPE_STR)
+  {
+    if (field.default_data == NULL)
+      member[0] = '\0';
+    else
+    {
+      strncpy((char *)member, (const char *)field.default_data, field.size - 1);
+      member[field.size - 1] = '\0';
+    }
+  }
+  else if (field.type == NVS_TYPE_BLOB)
+  {
+    if (field.default_data != NULL)
+      memcpy(member, field.default_data, field.size);
+  }
+  else
+    write_member(member, field.size, field.default_bits);
+}
+
+static const NvsField *find_field(std::span<const NvsField> schema, const char *key)
+{
+  uint32_t hash = NvsKey::hash(key);
+  for (const NvsField &field : schema)
+  {
+    if (field.key.hash() == hash && strcmp(field.key.c_str(), key) == 0)
+      return &field;
+  }
+  return NULL;
+}
+
+esp_err_t Nvs::load_data(const NvsField &field, nvs_type_t type, uint8_t *member)
+{
+  const char *key = field.key.c_str();
+  size_t length = field.size;
+  esp_err_t err = get_data(key, type, member, &length);
+  if (err == ESP_ERR_NVS_INVALID_LENGTH && length > field.size)
+  {
+    // a compressed value expands with a margin past its end, more than the member has
+    uint8_t *buffer = (uint8_t *)malloc(length);
+    if (buffer == NULL)
+      return ESP_ERR_NO_MEM;
+    err = get_data(key, type, buffer, &length);
+    if (err == ESP_OK && length <= field.size)
+      memcpy(member, buffer, length);
+    else if (err == ESP_OK)
+      err = ESP_ERR_NVS_INVALID_LENGTH;
+    free(buffer);
+  }
+  if (err == ESP_OK && type == NVS_TYPE_BLOB && length != field.size)
+    return ESP_ERR_NVS_INVALID_LENGTH;
+  return err;
+}
+
+void Nvs::load_field(const NvsField &field, nvs_type_t entry_type, uint8_t *member)
+{
+  const char *key = field.key.c_str();
+
+  // compressed strings are stored as blobs
+  if (field.type == NVS_TYPE_STR && (entry_type == NVS_TYPE_STR || entry_type == NVS_TYPE_BLOB))
+  {
+    if (load_data(field, NVS_TYPE_STR, member) != ESP_OK)
+      apply_default(field, member);
+  }
+  else if (entry_type == NVS_TYPE_BLOB && (field.type == NVS_TYPE_BLOB || field.type == NVS_TYPE_FLOAT || field.type == NVS_TYPE_DOUBLE))
+  {
+    // floats written as a blob by older versions are read like any other blob
+    if (load_data(field, NVS_TYPE_BLOB, member) != ESP_OK)
+      apply_default(field, member);
+  }
+  else if (entry_type == nvs_entry_type(field.type))
+  {
+    uint64_t value;
+    if (get_scalar(key, field.type, &value) != ESP_OK)
+      return;
+    write_member(member, field.size, value);
+    cache_store(field.key, field.type, value);
+  }
+}
+
+esp_err_t Nvs::load(std::span<const NvsField> schema, void *object)
+{
+  uint8_t *base = (uint8_t *)object;
+  wait_async();
+  NvsGuard guard(_lock, _concurrent, NvsGuard::EXCLUSIVE);
+  // the entries are read from flash: values still waiting in the write-back cache go there first
+  esp_err_t err = flush();
+  if (err != ESP_OK)
+    return err;
+
+  for (const NvsField &field : schema)
+    apply_default(field, base + field.offset);
+
+  for (const NvsEntry &entry : entries())
+  {
+    const NvsField *field = find_field(schema, entry.key());
+    if (field != NULL)
+      load_field(*field, entry.type(), base + field->offset);
+  }
+
+  return result(ESP_OK);
+}
+
+esp_err_t Nvs::store_field(const NvsField &field, const uint8_t *member)
+{
+  const char *key = field.key.c_str();
+
+  if (field.type == NVS_TYPE_STR)
+  {
+    if (strnlen((const char *)member, field.size) == field.size)
+      return ESP_ERR_INVALID_SIZE;
+    return setCharArray(key, (const char *)member);
+  }
+
+  if (field.type == NVS_TYPE_BLOB)
+    return setObject(key, member, field.size);
+
+  uint64_t value = read_member(member, field.size);
+  esp_err_t err = set_scalar(key, field.type, value);
+  if (err != ESP_OK)
+    return result(err);
+  cache_store(field.key, field.type, value);
+  return commit_if_needed();
+}
+
+esp_err_t Nvs::store(std::span<const NvsField> schema, const void *object, const void *previous)
+{
+  const uint8_t *base = (const uint8_t *)object;
+  const uint8_t *previous_base = (const uint8_t *)previous;
+  esp_err_t first_error = ESP_OK;
+
+  wait_async();
+  NvsGuard guard(_lock, _concurrent, NvsGuard::EXCLUSIVE);
+  NvsBatch batch(*this);
+
+  for (const NvsField &field : schema)
+  {
+    const uint8_t *member = base + field.offset;
+    if (previous_base != NULL)
+    {
+      const uint8_t *previous_member = previous_base + field.offset;
+      if (field.type == NVS_TYPE_STR ? strncmp((const char *)member, (const char *)previous_member, field.size) == 0
+                                     : memcmp(member, previous_member, field.size) == 0)
+        continue;
+    }
+
+    esp_err_t err = store_field(field, member);
+    if (err != ESP_OK && first_error == ESP_OK)
+      first_error = err;
+  }
+
+  esp_err_t err = batch.commit();
+  return result(first_error != ESP_OK ? first_error : err);
+}
+
+NvsStatsSnapshot Nvs::stats()
+{
+#if CONFIG_NVS_WRAPPER_STATS
+  return _stats.snapshot();
+#else
+  return NvsStatsSnapshot{};
+#endif
+}
+
+void Nvs::resetStats()
+{
+#if CONFIG_NVS_WRAPPER_STATS
+  _stats.reset();
+#endif
 }
@@ -0,0 +1,36 @@
+#include "include/NvsAllocator.h"
+
+#include <stdlib.h>
+
+class HeapAllocator : public NvsAllocator
+{
+public:
+  void *allocate(size_t size) override { return malloc(size); }
+  void deallocate(void *data, size_t size) override { free(data); }
+};
+
+NvsAllocator &NvsAllocator::heap()
+{
+  static HeapAllocator allocator;
+  return allocator;
+}
+
+void *NvsArena::allocate(size_t size)
+{
+  uintptr_t base = (uintptr_t)_buffer.data();
+  size_t start = ((base + _used + alignof(max_align_t) - 1) & ~(alignof(max_align_t) - 1)) - base;
+  if (start > _buffer.size() || size > _buffer.size() - start)
+    return NULL;
+  _used = start + size;
+  return _buffer.data() + start;
+}
+
+void *NvsResourceAllocator::allocate(size_t size)
+{
+  return _resource.allocate(size, alignof(max_align_t));
+}
+
+void NvsResourceAllocator::deallocate(void *data, size_t size)
+{
+  _resource.deallocate(data, size, alignof(max_align_t));
+}
@@ -0,0 +1,112 @@
+#include "include/NvsAsync.h"
+#include "include/NVS.h"
+#include "string.h"
+
+NvsAsync::NvsAsync(Nvs &nvs) : _nvs(nvs)
+{
+  start();
+}
+
+NvsAsync::~NvsAsync()
+{
+  stop();
+  if (_thread.joinable())
+    _thread.join();
+}
+
+void NvsAsync::start()
+{
+  if (_thread.joinable())
+    _thread.join();
+  _stop = false;
+  _thread = std::thread(&NvsAsync::run, this);
+}
+
+void NvsAsync::stop()
+{
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _stop = true;
+  }
+  _wake.notify_one();
+}
+
+bool NvsAsync::submit(const NvsKey &key, nvs_type_t type, uint64_t value, NvsWriteCallback done, void *arg)
+{
+  NvsWrite write;
+  memcpy(write.key, key.c_str(), key.length() + 1);
+  write.hash = key.hash();
+  write.type = type;
+  write.value = value;
+  write.done = done;
+  write.arg = arg;
+
+  if (!_queue.push(write))
+    return false;
+  wake();
+  return true;
+}
+
+void NvsAsync::wake()
+{
+  // pairs with the fence in run(): either the worker sees the new write before it sleeps,
+  // or this thread sees it sleeping and notifies
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if (!_sleeping.load(std::memory_order_relaxed))
+    return;
+  std::lock_guard<std::mutex> lock(_mutex);
+  _wake.notify_one();
+}
+
+void NvsAsync::flush()
+{
+  // the queue is FIFO, so once as many writes as were pushed by now are done, ours are too
+  size_t target = _queue.pushed();
+  std::unique_lock<std::mutex> lock(_mutex);
+  _done.wait(lock, [this, target]
+             { return (intptr_t)(_completed - target) >= 0; });
+}
+
+void NvsAsync::drain()
+{
+  while (write_queued() > 0)
+    ;
+}
+
+size_t NvsAsync::write_queued()
+{
+  size_t count = 0;
+  {
+    NvsGuard guard(_nvs._lock, _nvs._concurrent, NvsGuard::EXCLUSIVE);
+    while (count < NVS_ASYNC_QUEUE_SIZE && _queue.pop(&_batch[count]))
+      count++;
+    if (count == 0)
+      return 0;
+    _nvs.write_batch(_batch, count);
+  }
+
+  std::lock_guard<std::mutex> lock(_mutex);
+  _completed += count;
+  _done.notify_all();
+  return count;
+}
+
+void NvsAsync::run()
+{
+  std::unique_lock<std::mutex> lock(_mutex);
+  while (true)
+  {
+    _sleeping.store(true, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    _wake.wait(lock, [this]
+               { return _stop || !_queue.empty(); });
+    _sleeping.store(false, std::memory_order_relaxed);
+    if (_stop && _queue.empty())
+      return;
+
+    // drain() may have emptied the queue meanwhile, then there is nothing to write
+    lock.unlock();
+    write_queued();
+    lock.lock();
+  }
+}
@@ -0,0 +1,140 @@
+#include "include/NvsBackend.h"
+#include "include/NvsTraits.h"
+
+template <typename S>
+static esp_err_t get_bits(nvs_handle_t handle, const char *key, uint64_t *value)
+{
+  S stored;
+  esp_err_t err = nvs_get_value(handle, key, &stored);
+  if (err == ESP_OK)
+    *value = (uint64_t)stored;
+  return err;
+}
+
+esp_err_t NvsFlashBackend::open(const char *namespace_name, nvs_open_mode_t open_mode, nvs_handle_t *handle)
+{
+  return nvs_open_from_partition(_partition_label, namespace_name, open_mode, handle);
+}
+
+void NvsFlashBackend::close(nvs_handle_t handle)
+{
+  nvs_close(handle);
+}
+
+esp_err_t NvsFlashBackend::getScalar(nvs_handle_t handle, const char *key, nvs_type_t type, uint64_t *value)
+{
+  switch (type)
+  {
+  case NVS_TYPE_I8:
+    return get_bits<int8_t>(handle, key, value);
+  case NVS_TYPE_U8:
+    return get_bits<uint8_t>(handle, key, value);
+  case NVS_TYPE_I16:
+    return get_bits<int16_t>(handle, key, value);
+  case NVS_TYPE_U16:
+    return get_bits<uint16_t>(handle, key, value);
+  case NVS_TYPE_I32:
+    return get_bits<int32_t>(handle, key, value);
+  case NVS_TYPE_U32:
+    return get_bits<uint32_t>(handle, key, value);
+  case NVS_TYPE_I64:
+    return get_bits<int64_t>(handle, key, value);
+  case NVS_TYPE_U64:
+    return get_bits<uint64_t>(handle, key, value);
+  default:
+    return ESP_ERR_NVS_TYPE_MISMATCH;
+  }
+}
+
+esp_err_t NvsFlashBackend::setScalar(nvs_handle_t handle, const char *key, nvs_type_t type, uint64_t value)
+{
+  switch (type)
+  {
+  case NVS_TYPE_I8:
+    return nvs_set_value(handle, key, (int8_t)value);
+  case NVS_TYPE_U8:
+    return nvs_set_value(handle, key, (uint8_t)value);
+  case NVS_TYPE_I16:
+    return nvs_set_value(handle, key, (int16_t)value);
+  case NVS_TYPE_U16:
+    return nvs_set_value(handle, key, (uint16_t)value);
+  case NVS_TYPE_I32:
+    return nvs_set_value(handle, key, (int32_t)value);
+  case NVS_TYPE_U32:
+    return nvs_set_value(handle, key, (uint32_t)value);
+  case NVS_TYPE_I64:
+    return nvs_set_value(handle, key, (int64_t)value);
+  case NVS_TYPE_U64:
+    return nvs_set_value(handle, key, value);
+  default:
+    return ESP_ERR_NVS_TYPE_MISMATCH;
+  }
+}
+
+esp_err_t NvsFlashBackend::getStr(nvs_handle_t handle, const char *key, char *value, size_t *length)
+{
+  return nvs_get_str(handle, key, value, length);
+}
+
+esp_err_t NvsFlashBackend::getBlob(nvs_handle_t handle, const char *key, void *value, size_t *length)
+{
+  return nvs_get_blob(handle, key, value, length);
+}
+
+esp_err_t NvsFlashBackend::setStr(nvs_handle_t handle, const char *key, const char *value)
+{
+  return nvs_set_str(handle, key, value);
+}
+
+esp_err_t NvsFlashBackend::setBlob(nvs_handle_t handle, const char *key, const void *value, size_t length)
+{
+  return nvs_set_blob(handle, key, value, length);
+}
+
+esp_err_t NvsFlashBackend::findKey(nvs_handle_t handle, const char *key, nvs_type_t *type)
+{
+  return nvs_find_key(handle, key, type);
+}
+
+esp_err_t NvsFlashBackend::eraseKey(nvs_handle_t handle, const char *key)
+{
+  return nvs_erase_key(handle, key);
+}
+
+esp_err_t NvsFlashBackend::eraseAll(nvs_handle_t handle)
+{
+  return nvs_erase_all(handle);
+}
+
+esp_err_t NvsFlashBackend::commit(nvs_handle_t handle)
+{
+  return nvs_commit(handle);
+}
+
+void *NvsFlashBackend::entryFind(const char *namespace_name, nvs_type_t type)
+{
+  nvs_iterator_t it = NULL;
+  if (nvs_entry_find(_partition_label, namespace_name, type, &it) != ESP_OK)
+    return NULL;
+  return it;
+}
+
+void *NvsFlashBackend::entryNext(void *it)
+{
+  // nvs_entry_next releases the iterator and sets it to NULL after the last entry
+  nvs_iterator_t next = (nvs_iterator_t)it;
+  if (nvs_entry_next(&next) == ESP_OK)
+    return next;
+  nvs_release_iterator(next);
+  return NULL;
+}
+
+void NvsFlashBackend::entryInfo(void *it, nvs_entry_info_t *info)
+{
+  nvs_entry_info((nvs_iterator_t)it, info);
+}
+
+void NvsFlashBackend::entryRelease(void *it)
+{
+  nvs_release_iterator((nvs_iterator_t)it);
+}
@@ -0,0 +1,123 @@
+#include "include/NvsCache.h"
+#include "string.h"
+
+#define SLOT(hash) ((hash) & (NVS_CACHE_SIZE - 1))
+
+NvsCache::NvsCache()
+{
+  clear();
+}
+
+NvsCache::Entry *NvsCache::lookup(const NvsKey &key)
+{
+  for (uint32_t i = 0; i < NVS_CACHE_SIZE; i++)
+  {
+    Entry *entry = &_entries[SLOT(key.hash() + i)];
+    if (!entry->used)
+      return NULL;
+    if (entry->hash == key.hash() && memcmp(entry->key, key.c_str(), key.length() + 1) == 0)
+      return entry;
+  }
+  return NULL;
+}
+
+bool NvsCache::find(const NvsKey &key, nvs_type_t type, uint64_t *value)
+{
+  if (!peek(key, type, value))
+  {
+    _misses.fetch_add(1, std::memory_order_relaxed);
+    return false;
+  }
+
+  _hits.fetch_add(1, std::memory_order_relaxed);
+  return true;
+}
+
+bool NvsCache::peek(const NvsKey &key, nvs_type_t type, uint64_t *value)
+{
+  Entry *entry = lookup(key);
+  if (entry == NULL || entry->type != type)
+    return false;
+
+  *value = entry->value;
+  return true;
+}
+
+bool NvsCache::store(const NvsKey &key, nvs_type_t type, uint64_t value, bool dirty)
+{
+  Entry *entry = lookup(key);
+
+  if (entry == NULL)
+  {
+    Entry *home = &_entries[SLOT(key.hash())];
+    // full: evict whoever sits in the home slot, or don't cache the key at all
+    if (_count >= NVS_CACHE_SIZE * 3 / 4)
+    {
+      if (!home->used || home->dirty)
+        return false;
+      erase(home);
+    }
+
+    entry = home;
+    while (entry->used)
+      entry = &_entries[SLOT(entry - _entries + 1)];
+    _count++;
+
+    entry->used = true;
+    entry->dirty = false;
+    entry->hash = key.hash();
+    memcpy(entry->key, key.c_str(), key.length() + 1);
+  }
+
+  if (dirty != entry->dirty)
+  {
+    entry->dirty = dirty;
+    dirty ? _dirty++ : _dirty--;
+  }
+  entry->type = type;
+  entry->value = value;
+  return true;
+}
+
+bool NvsCache::remove(const NvsKey &key)
+{
+  Entry *entry = lookup(key);
+  if (entry == NULL)
+    return false;
+
+  bool dirty = entry->dirty;
+  erase(entry);
+  return dirty;
+}
+
+void NvsCache::erase(Entry *entry)
+{
+  if (entry->dirty)
+    _dirty--;
+
+  // backward-shift deletion: pull up every following entry whose home slot
+  // does not lie between the hole and its current position
+  uint32_t hole = entry - _entries;
+  uint32_t next = SLOT(hole + 1);
+  while (_entries[next].used)
+  {
+    uint32_t home = SLOT(_entries[next].hash);
+    if (SLOT(next - home) >= SLOT(next - hole))
+    {
+      _entries[hole] = _entries[next];
+      hole = next;
+    }
+    next = SLOT(next + 1);
+  }
+
+  _entries[hole].used = false;
+  _count--;
+}
+
+void NvsCache::clear()
+{
+  for (Entry &entry : _entries)
+    entry.used = false;
+  _count = 0;
+  _dirty = 0;
+}
@@ -0,0 +1,176 @@
+#include "include/NvsCodec.h"
+#include "string.h"
+
+#define MAX_LITERALS 32
+#define MAX_OFFSET 8192
+#define MAX_MATCH (7 + 255 + 2)
+
+static const uint8_t magic[3] = {0xff, 'N', 'Z'};
+
+static uint32_t hash(const uint8_t *data)
+{
+  uint32_t value = data[0] | data[1] << 8 | data[2] << 16;
+  return (value * 2654435761u) >> (32 - NVS_CODEC_HASH_BITS);
+}
+
+static bool put_literals(const uint8_t *data, size_t count, uint8_t *out, size_t *op, size_t room)
+{
+  while (count > 0)
+  {
+    size_t run = count < MAX_LITERALS ? count : MAX_LITERALS;
+    if (*op + 1 + run > room)
+      return false;
+    out[(*op)++] = run - 1;
+    memcpy(out + *op, data, run);
+    *op += run;
+    data += run;
+    count -= run;
+  }
+  return true;
+}
+
+// greedy LZF: one candidate per hash slot, every position of a match is indexed
+static size_t compress(const uint8_t *in, size_t length, uint8_t *out, size_t room, uint32_t *table)
+{
+  memset(table, 0xff, NVS_CODEC_TABLE_SIZE);
+  size_t ip = 0;
+  size_t op = 0;
+  size_t anchor = 0; // first byte not emitted yet
+
+  while (ip + 2 < length)
+  {
+    uint32_t slot = hash(in + ip);
+    size_t ref = table[slot];
+    table[slot] = ip;
+    if (ref == UINT32_MAX || ip - ref > MAX_OFFSET || memcmp(in + ref, in + ip, 3) != 0)
+    {
+      ip++;
+      continue;
+    }
+
+    size_t max = length - ip < MAX_MATCH ? length - ip : MAX_MATCH;
+    size_t match = 3;
+    while (match < max && in[ref + match] == in[ip + match])
+      match++;
+
+    if (!put_literals(in + anchor, ip - anchor, out, &op, room) || op + 3 > room)
+      return 0;
+    size_t offset = ip - ref - 1;
+    if (match - 2 < 7)
+      out[op++] = (match - 2) << 5 | offset >> 8;
+    else
+    {
+      out[op++] = 7 << 5 | offset >> 8;
+      out[op++] = match - 2 - 7;
+    }
+    out[op++] = offset & 0xff;
+
+    size_t end = ip + match;
+    for (ip++; ip < end && ip + 2 < length; ip++)
+      table[hash(in + ip)] = ip;
+    ip = end;
+    anchor = end;
+  }
+
+  if (!put_literals(in + anchor, length - anchor, out, &op, room))
+    return 0;
+  return op;
+}
+
+// in and out may overlap as long as the unread input stays ahead of the output, see NVS_CODEC_MARGIN
+static size_t decompress(const uint8_t *in, size_t length, uint8_t *out, size_t room)
+{
+  size_t ip = 0;
+  size_t op = 0;
+
+  while (ip < length)
+  {
+    size_t control = in[ip++];
+    if (control < MAX_LITERALS)
+    {
+      size_t run = control + 1;
+      if (ip + run > length || op + run > room)
+        return 0;
+      memmove(out + op, in + ip, run);
+      ip += run;
+      op += run;
+      continue;
+    }
+
+    size_t match = control >> 5;
+    if (match == 7)
+    {
+      if (ip >= length)
+        return 0;
+      match += in[ip++];
+    }
+    match += 2;
+    if (ip >= length)
+      return 0;
+    size_t offset = ((control & 0x1f) << 8 | in[ip++]) + 1;
+    if (offset > op || op + match > room)
+      return 0;
+    // byte by byte: the reference may overlap the bytes being written
+    for (size_t i = 0; i < match; i++, op++)
+      out[op] = out[op - offset];
+  }
+  return op;
+}
+
+size_t nvs_pack(nvs_type_t type, const void *data, size_t length, void *output, size_t room, uint32_t *table)
+{
+  if (room <= NVS_CODEC_HEADER_SIZE || length > UINT32_MAX)
+    return 0;
+
+  uint8_t *out = (uint8_t *)output;
+  size_t packed = compress((const uint8_t *)data, length, out + NVS_CODEC_HEADER_SIZE, room - NVS_CODEC_HEADER_SIZE, table);
+  if (packed == 0)
+    return 0;
+
+  memcpy(out, magic, sizeof(magic));
+  out[3] = type;
+  for (size_t i = 0; i < 4; i++)
+    out[4 + i] = (uint8_t)(length >> (8 * i));
+  return NVS_CODEC_HEADER_SIZE + packed;
+}
+
+bool nvs_packed(nvs_type_t type, const void *data, size_t stored, size_t *length)
+{
+  const uint8_t *header = (const uint8_t *)data;
+  if (stored < NVS_CODEC_HEADER_SIZE || memcmp(header, magic, sizeof(magic)) != 0 || header[3] != type)
+    return false;
+
+  size_t original = header[4] | header[5] << 8 | header[6] << 16 | (uint32_t)header[7] << 24;
+  // only values that got smaller are stored packed
+  if (original <= stored)
+    return false;
+  *length = original;
+  return true;
+}
+
+esp_err_t nvs_unpack(void *buffer, size_t stored, size_t room, size_t *length)
+{
+  uint8_t *bytes = (uint8_t *)buffer;
+  nvs_type_t type = (nvs_type_t)bytes[3];
+  size_t original;
+  if (!nvs_packed(type, buffer, stored, &original))
+    return ESP_ERR_INVALID_SIZE;
+
+  size_t needed = original + NVS_CODEC_MARGIN(original);
+  if (room < needed)
+  {
+    *length = needed;
+    return ESP_ERR_NVS_INVALID_LENGTH;
+  }
+
+  // the packed value moves to the end of the buffer and expands towards its start
+  uint8_t *packed = bytes + room - stored;
+  memmove(packed, bytes, stored);
+  if (decompress(packed + NVS_CODEC_HEADER_SIZE, stored - NVS_CODEC_HEADER_SIZE, bytes, original) != original)
+    return ESP_ERR_INVALID_SIZE;
+  if (type == NVS_TYPE_STR && bytes[original - 1] != '\0')
+    return ESP_ERR_INVALID_SIZE;
+
+  *length = original;
+  return ESP_OK;
+}
@@ -0,0 +1,89 @@
+#include "include/NvsEntries.h"
+#include "string.h"
+
+size_t NvsEntry::size() const
+{
+  switch (_info.type)
+  {
+  case NVS_TYPE_U8:
+  case NVS_TYPE_I8:
+    return 1;
+  case NVS_TYPE_U16:
+  case NVS_TYPE_I16:
+    return 2;
+  case NVS_TYPE_U32:
+  case NVS_TYPE_I32:
+    return 4;
+  case NVS_TYPE_U64:
+  case NVS_TYPE_I64:
+    return 8;
+  default:
+    break;
+  }
+
+  if (_handle_namespace == NULL || strcmp(_handle_namespace, _info.namespace_name) != 0)
+    return 0;
+
+  size_t length = 0;
+  if (_info.type == NVS_TYPE_STR)
+    _backend->getStr(_handle, _info.key, NULL, &length);
+  else if (_info.type == NVS_TYPE_BLOB)
+    _backend->getBlob(_handle, _info.key, NULL, &length);
+  return length;
+}
+
+NvsEntryIterator::NvsEntryIterator(NvsBackend *backend, void *it, nvs_handle_t handle, const char *handle_namespace) : _it(it)
+{
+  _entry._backend = backend;
+  _entry._handle = handle;
+  _entry._handle_namespace = handle_namespace;
+  if (_it != NULL)
+    backend->entryInfo(_it, &_entry._info);
+}
+
+NvsEntryIterator::NvsEntryIterator(NvsEntryIterator &&other) : _it(other._it), _entry(other._entry)
+{
+  other._it = NULL;
+}
+
+NvsEntryIterator &NvsEntryIterator::operator=(NvsEntryIterator &&other)
+{
+  if (this != &other)
+  {
+    if (_it != NULL)
+      _entry._backend->entryRelease(_it);
+    _it = other._it;
+    _entry = other._entry;
+    other._it = NULL;
+  }
+  return *this;
+}
+
+NvsEntryIterator::~NvsEntryIterator()
+{
+  if (_it != NULL)
+    _entry._backend->entryRelease(_it);
+}
+
+NvsEntryIterator &NvsEntryIterator::operator++()
+{
+  _it = _entry._backend->entryNext(_it);
+  if (_it != NULL)
+    _entry._backend->entryInfo(_it, &_entry._info);
+  return *this;
+}
+
+NvsEntries::NvsEntries(NvsBackend *backend, const char *namespace_name, nvs_type_t type,
+                       nvs_handle_t handle, const char *handle_namespace)
+    : _backend(backend), _namespace(namespace_name), _type(type),
+      _handle(handle), _handle_namespace(handle_namespace)
+{
+}
+
+NvsEntryIterator NvsEntries::begin() const
+{
+  void *it = _backend->entryFind(_namespace, _type);
+  if (it == NULL)
+    return end();
+  return NvsEntryIterator(_backend, it, _handle, _handle_namespace);
+}
@@ -0,0 +1,455 @@
+#include "include/NvsImage.h"
+#include "include/NvsTraits.h"
+#include "string.h"
+
+#include <algorithm>
+
+#if defined(CONFIG_IDF_TARGET_LINUX) || !defined(ESP_PLATFORM)
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+struct ImageIterator
+{
+  size_t position;
+  uint8_t space; // 0: every namespace
+  nvs_type_t type;
+};
+
+static int compare(const NvsItem *item, uint8_t space, const char *key, uint8_t type, uint8_t chunk)
+{
+  if (item->space != space)
+    return item->space < space ? -1 : 1;
+  int order = strncmp(item->key, key, NVS_KEY_NAME_MAX_SIZE);
+  if (order != 0)
+    return order;
+  if (item->type != type)
+    return item->type < type ? -1 : 1;
+  if (item->chunk != chunk)
+    return item->chunk < chunk ? -1 : 1;
+  return 0;
+}
+
+static int compare(const NvsItem *a, const NvsItem *b)
+{
+  char key[NVS_KEY_NAME_MAX_SIZE + 1] = {};
+  memcpy(key, b->key, NVS_KEY_NAME_MAX_SIZE);
+  return compare(a, b->space, key, b->type, b->chunk);
+}
+
+// the type an entry has for nvs_find_key / nvs_entry_find
+static nvs_type_t entry_type(const NvsItem *item)
+{
+  if (item->type == NVS_ITEM_BLOB_INDEX || item->type == NVS_ITEM_BLOB_V1)
+    return NVS_TYPE_BLOB;
+  return (nvs_type_t)item->type;
+}
+
+static bool valid_handle(nvs_handle_t handle)
+{
+  return handle > NVS_NAMESPACE_INDEX && handle <= NVS_NAMESPACE_MAX;
+}
+
+#ifdef ESP_PLATFORM
+NvsImage::NvsImage(const char *partition_label)
+{
+  const esp_partition_t *partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_DATA_NVS, partition_label);
+  if (partition == NULL)
+  {
+    _err = ESP_ERR_NVS_PART_NOT_FOUND;
+    return;
+  }
+
+  const void *mapped = NULL;
+  _err = esp_partition_mmap(partition, 0, partition->size, ESP_PARTITION_MMAP_DATA, &mapped, &_mmap_handle);
+  if (_err != ESP_OK)
+    return;
+  _partition_mapped = true;
+  _image = (const uint8_t *)mapped;
+  _size = partition->size;
+  _err = build();
+}
+#endif
+
+NvsImage::NvsImage(std::span<const uint8_t> image) : _image(image.data()), _size(image.size())
+{
+  _err = build();
+}
+
+NvsImage::~NvsImage()
+{
+#ifdef ESP_PLATFORM
+  if (_partition_mapped)
+    esp_partition_munmap(_mmap_handle);
+#endif
+#if defined(CONFIG_IDF_TARGET_LINUX) || !defined(ESP_PLATFORM)
+  if (_file_mapped)
+    munmap((void *)_image, _size);
+#endif
+}
+
+esp_err_t NvsImage::build()
+{
+  if (_size == 0 || _size % NVS_PAGE_SIZE != 0)
+    return ESP_ERR_INVALID_SIZE;
+
+  // pages in the order they were written, so a later copy of an entry replaces an earlier one
+  std::vector<const NvsPageHeader *> pages;
+  for (size_t offset = 0; offset < _size; offset += NVS_PAGE_SIZE)
+  {
+    const NvsPageHeader *header = (const NvsPageHeader *)(_image + offset);
+    if (header->state != NVS_PAGE_STATE_ACTIVE && header->state != NVS_PAGE_STATE_FULL &&
+        header->state != NVS_PAGE_STATE_FREEING)
+      continue;
+    if (header->crc == nvs_page_crc(header))
+      pages.push_back(header);
+    else
+      _damaged++;
+  }
+  std::sort(pages.begin(), pages.end(), [](const NvsPageHeader *a, const NvsPageHeader *b)
+            { return a->sequence < b->sequence; });
+
+  std::vector<uint32_t> entries;
+  for (const NvsPageHeader *header : pages)
+  {
+    const uint8_t *page = (const uint8_t *)header;
+    for (size_t i = 0; i < NVS_PAGE_ENTRIES; i++)
+    {
+      const NvsItem *entry = (const NvsItem *)(page + NVS_PAGE_FIRST_ENTRY + i * NVS_ENTRY_SIZE);
+      if (nvs_entry_state(page, i) != NVS_ENTRY_STATE_WRITTEN)
+        continue;
+      if (entry->crc != nvs_item_crc(entry) || entry->span == 0 || entry->span > NVS_PAGE_ENTRIES - i)
+      {
+        _damaged++;
+        continue;
+      }
+
+      bool valid = true;
+      if (nvs_item_variable(entry->type))
+      {
+        for (size_t j = 1; j < entry->span; j++)
+          valid = valid && nvs_entry_state(page, i + j) == NVS_ENTRY_STATE_WRITTEN;
+        valid = valid && entry->var.size <= (entry->span - 1) * NVS_ENTRY_SIZE &&
+                entry->var.crc == nvs_data_crc(entry + 1, entry->var.size);
+      }
+      else
+        valid = entry->span == 1;
+      if (valid)
+        entries.push_back((const uint8_t *)entry - _image);
+      else
+        _damaged++;
+      i += entry->span - 1;
+    }
+  }
+
+  std::stable_sort(entries.begin(), entries.end(), [this](uint32_t a, uint32_t b)
+                   { return compare(item(a), item(b)) < 0; });
+  for (size_t i = 0; i < entries.size(); i++)
+    if (i + 1 == entries.size() || compare(item(entries[i]), item(entries[i + 1])) != 0)
+      _index.push_back(entries[i]);
+  return ESP_OK;
+}
+
+const NvsItem *NvsImage::find(uint8_t space, const char *key, uint8_t type, uint8_t chunk)
+{
+  auto found = std::lower_bound(_index.begin(), _index.end(), 0, [&](uint32_t offset, int)
+                                { return compare(item(offset), space, key, type, chunk) < 0; });
+  if (found == _index.end() || compare(item(*found), space, key, type, chunk) != 0)
+    return NULL;
+  return item(*found);
+}
+
+uint8_t NvsImage::namespace_index(const char *namespace_name)
+{
+  const NvsItem *entry = find(NVS_NAMESPACE_INDEX, namespace_name, NVS_TYPE_U8, NVS_CHUNK_ANY);
+  return entry != NULL ? entry->data[0] : NVS_NAMESPACE_INDEX;
+}
+
+bool NvsImage::namespace_name(uint8_t space, char *name)
+{
+  // namespace entries sort first
+  for (uint32_t offset : _index)
+  {
+    const NvsItem *entry = item(offset);
+    if (entry->space != NVS_NAMESPACE_INDEX)
+      break;
+    if (entry->type == NVS_TYPE_U8 && entry->data[0] == space)
+    {
+      memcpy(name, entry->key, NVS_KEY_NAME_MAX_SIZE - 1);
+      name[NVS_KEY_NAME_MAX_SIZE - 1] = '\0';
+      return true;
+    }
+  }
+  return false;
+}
+
+esp_err_t NvsImage::string_item(uint8_t space, const char *key, const NvsItem **found)
+{
+  *found = find(space, key, NVS_ITEM_STR, NVS_CHUNK_ANY);
+  return *found != NULL && (*found)->var.size > 0 ? ESP_OK : ESP_ERR_NVS_NOT_FOUND;
+}
+
+esp_err_t NvsImage::blob_index(uint8_t space, const char *key, const NvsItem **found)
+{
+  *found = find(space, key, NVS_ITEM_BLOB_INDEX, NVS_CHUNK_ANY);
+  if (*found == NULL)
+    *found = find(space, key, NVS_ITEM_BLOB_V1, NVS_CHUNK_ANY);
+  return *found != NULL ? ESP_OK : ESP_ERR_NVS_NOT_FOUND;
+}
+
+esp_err_t NvsImage::getStringView(const char *namespace_name, const char *key, std::string_view *value)
+{
+  uint8_t space = namespace_index(namespace_name);
+  const NvsItem *entry;
+  esp_err_t err = space != NVS_NAMESPACE_INDEX ? string_item(space, key, &entry) : ESP_ERR_NVS_NOT_FOUND;
+  if (err == ESP_OK)
+    *value = std::string_view((const char *)(entry + 1), entry->var.size - 1);
+  return err;
+}
+
+esp_err_t NvsImage::getBlobView(const char *namespace_name, const char *key, std::span<const uint8_t> *value)
+{
+  uint8_t space = namespace_index(namespace_name);
+  const NvsItem *entry;
+  esp_err_t err = space != NVS_NAMESPACE_INDEX ? blob_index(space, key, &entry) : ESP_ERR_NVS_NOT_FOUND;
+  if (err != ESP_OK)
+    return err;
+
+  if (entry->type == NVS_ITEM_BLOB_INDEX)
+  {
+    if (entry->blob.chunks > 1)
+      return ESP_ERR_NOT_SUPPORTED;
+    if (entry->blob.chunks == 0 || entry->blob.size == 0)
+    {
+      *value = {};
+      return ESP_OK;
+    }
+    entry = find(space, key, NVS_ITEM_BLOB_DATA, entry->blob.start);
+    if (entry == NULL)
+      return ESP_ERR_NVS_NOT_FOUND;
+  }
+  *value = std::span<const uint8_t>((const uint8_t *)(entry + 1), entry->var.size);
+  return ESP_OK;
+}
+
+esp_err_t NvsImage::open(const char *namespace_name, nvs_open_mode_t open_mode, nvs_handle_t *handle)
+{
+  if (_err != ESP_OK)
+    return _err;
+  // the handle is the namespace index; a read-write handle opens, writes through it fail
+  uint8_t space = namespace_index(namespace_name);
+  if (space == NVS_NAMESPACE_INDEX)
+    return ESP_ERR_NVS_NOT_FOUND;
+  *handle = space;
+  return ESP_OK;
+}
+
+void NvsImage::close(nvs_handle_t handle)
+{
+}
+
+esp_err_t NvsImage::getScalar(nvs_handle_t handle, const char *key, nvs_type_t type, uint64_t *value)
+{
+  if (!valid_handle(handle))
+    return ESP_ERR_NVS_INVALID_HANDLE;
+  const NvsItem *entry = find(handle, key, type, NVS_CHUNK_ANY);
+  if (entry == NULL)
+    return ESP_ERR_NVS_NOT_FOUND;
+
+  size_t size = nvs_scalar_size(type);
+  uint64_t bits = 0;
+  for (size_t i = 0; i < size; i++)
+    bits |= (uint64_t)entry->data[i] << (8 * i);
+  // signed values are sign-extended
+  if ((type & 0xf0) == 0x10 && size < 8 && (bits >> (8 * size - 1)) != 0)
+    bits |= ~0ull << (8 * size);
+  *value = bits;
+  return ESP_OK;
+}
+
+esp_err_t NvsImage::getStr(nvs_handle_t handle, const char *key, char *value, size_t *length)
+{
+  if (!valid_handle(handle))
+    return ESP_ERR_NVS_INVALID_HANDLE;
+  const NvsItem *entry;
+  esp_err_t err = string_item(handle, key, &entry);
+  if (err != ESP_OK)
+    return err;
+
+  size_t size = entry->var.size;
+  if (value != NULL)
+  {
+    if (*length < size)
+    {
+      *length = size;
+      return ESP_ERR_NVS_INVALID_LENGTH;
+    }
+    memcpy(value, entry + 1, size);
+  }
+  *length = size;
+  return ESP_OK;
+}
+
+esp_err_t NvsImage::getBlob(nvs_handle_t handle, const char *key, void *value, size_t *length)
+{
+  if (!valid_handle(handle))
+    return ESP_ERR_NVS_INVALID_HANDLE;
+  const NvsItem *index;
+  esp_err_t err = blob_index(handle, key, &index);
+  if (err != ESP_OK)
+    return err;
+
+  size_t size = index->type == NVS_ITEM_BLOB_INDEX ? index->blob.size : index->var.size;
+  if (value == NULL)
+  {
+    *length = size;
+    return ESP_OK;
+  }
+  if (*length < size)
+  {
+    *length = size;
+    return ESP_ERR_NVS_INVALID_LENGTH;
+  }
+
+  if (index->type == NVS_ITEM_BLOB_V1)
+    memcpy(value, index + 1, size);
+  else
+  {
+    // chunks are numbered from the start of the version, one per page
+    size_t copied = 0;
+    for (uint8_t chunk = 0; chunk < index->blob.chunks; chunk++)
+    {
+      const NvsItem *data = find(handle, key, NVS_ITEM_BLOB_DATA, index->blob.start + chunk);
+      if (data == NULL || data->var.size > size - copied)
+        return ESP_ERR_NVS_NOT_FOUND;
+      memcpy((uint8_t *)value + copied, data + 1, data->var.size);
+      copied += data->var.size;
+    }
+    if (copied != size)
+      return ESP_ERR_NVS_NOT_FOUND;
+  }
+  *length = size;
+  return ESP_OK;
+}
+
+esp_err_t NvsImage::findKey(nvs_handle_t handle, const char *key, nvs_type_t *type)
+{
+  if (!valid_handle(handle))
+    return ESP_ERR_NVS_INVALID_HANDLE;
+  auto found = std::lower_bound(_index.begin(), _index.end(), 0, [&](uint32_t offset, int)
+                                { return compare(item(offset), handle, key, 0, 0) < 0; });
+  for (; found != _index.end() && compare(item(*found), handle, key, 0xff, 0xff) <= 0; ++found)
+  {
+    if (item(*found)->type == NVS_ITEM_BLOB_DATA)
+      continue;
+    if (type != NULL)
+      *type = entry_type(item(*found));
+    return ESP_OK;
+  }
+  return ESP_ERR_NVS_NOT_FOUND;
+}
+
+esp_err_t NvsImage::setScalar(nvs_handle_t handle, const char *key, nvs_type_t type, uint64_t value)
+{
+  return ESP_ERR_NVS_READ_ONLY;
+}
+
+esp_err_t NvsImage::setStr(nvs_handle_t handle, const char *key, const char *value)
+{
+  return ESP_ERR_NVS_READ_ONLY;
+}
+
+esp_err_t NvsImage::setBlob(nvs_handle_t handle, const char *key, const void *value, size_t length)
+{
+  return ESP_ERR_NVS_READ_ONLY;
+}
+
+esp_err_t NvsImage::eraseKey(nvs_handle_t handle, const char *key)
+{
+  return ESP_ERR_NVS_READ_ONLY;
+}
+
+esp_err_t NvsImage::eraseAll(nvs_handle_t handle)
+{
+  return ESP_ERR_NVS_READ_ONLY;
+}
+
+esp_err_t NvsImage::commit(nvs_handle_t handle)
+{
+  return valid_handle(handle) ? ESP_OK : ESP_ERR_NVS_INVALID_HANDLE;
+}
+
+static bool matches(const NvsItem *item, const ImageIterator *scan)
+{
+  if (item->space == NVS_NAMESPACE_INDEX || item->type == NVS_ITEM_BLOB_DATA)
+    return false;
+  return (scan->space == NVS_NAMESPACE_INDEX || item->space == scan->space) &&
+         (scan->type == NVS_TYPE_ANY || entry_type(item) == scan->type);
+}
+
+void *NvsImage::entryFind(const char *namespace_name, nvs_type_t type)
+{
+  ImageIterator scan = {0, NVS_NAMESPACE_INDEX, type};
+  if (namespace_name != NULL && (scan.space = namespace_index(namespace_name)) == NVS_NAMESPACE_INDEX)
+    return NULL;
+  while (scan.position < _index.size() && !matches(item(_index[scan.position]), &scan))
+    scan.position++;
+  if (scan.position == _index.size())
+    return NULL;
+  return new ImageIterator(scan);
+}
+
+void *NvsImage::entryNext(void *it)
+{
+  ImageIterator *scan = (ImageIterator *)it;
+  while (++scan->position < _index.size())
+    if (matches(item(_index[scan->position]), scan))
+      return scan;
+  delete scan;
+  return NULL;
+}
+
+void NvsImage::entryInfo(void *it, nvs_entry_info_t *info)
+{
+  const NvsItem *entry = item(_index[((ImageIterator *)it)->position]);
+  memset(info, 0, sizeof(*info));
+  if (!namespace_name(entry->space, info->namespace_name))
+    info->namespace_name[0] = '\0';
+  memcpy(info->key, entry->key, NVS_KEY_NAME_MAX_SIZE - 1);
+  info->type = entry_type(entry);
+}
+
+void NvsImage::entryRelease(void *it)
+{
+  delete (ImageIterator *)it;
+}
+
+#if defined(CONFIG_IDF_TARGET_LINUX) || !defined(ESP_PLATFORM)
+
+NvsImage::NvsImage(int fd)
+{
+  struct stat info;
+  if (fstat(fd, &info) != 0)
+  {
+    _err = ESP_FAIL;
+    return;
+  }
+  _size = info.st_size;
+  if (_size == 0 || _size % NVS_PAGE_SIZE != 0)
+  {
+    _err = ESP_ERR_INVALID_SIZE;
+    return;
+  }
+
+  void *mapped = mmap(NULL, _size, PROT_READ, MAP_PRIVATE, fd, 0);
+  if (mapped == MAP_FAILED)
+  {
+    _err = ESP_FAIL;
+    return;
+  }
+  _file_mapped = true;
+  _image = (const uint8_t *)mapped;
+  _err = build();
+}
+
+#endif
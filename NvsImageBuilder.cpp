@@ -0,0 +1,206 @@
+#include "include/NvsImageBuilder.h"
+#include "string.h"
+
+#include <algorithm>
+
+// strings are kept in one page, like nvs_set_str
+#define NVS_BUILDER_MAX_STRING 4000
+// blob chunks are numbered from 0, the other version of a blob starts at 128
+#define NVS_BUILDER_MAX_CHUNKS 127
+
+static esp_err_t check_name(const char *name)
+{
+  size_t length = strlen(name);
+  if (length == 0)
+    return ESP_ERR_NVS_INVALID_NAME;
+  if (length > NVS_KEY_NAME_MAX_SIZE - 1)
+    return ESP_ERR_NVS_KEY_TOO_LONG;
+  return ESP_OK;
+}
+
+static size_t data_entries(size_t length)
+{
+  return (length + NVS_ENTRY_SIZE - 1) / NVS_ENTRY_SIZE;
+}
+
+NvsImageBuilder::NvsImageBuilder(std::span<uint8_t> image) : _image(image)
+{
+  _pages = image.size() / NVS_PAGE_SIZE;
+  if (image.size() % NVS_PAGE_SIZE != 0 || _pages < 2)
+  {
+    _err = ESP_ERR_INVALID_SIZE;
+    return;
+  }
+  memset(image.data(), 0xff, image.size());
+}
+
+void NvsImageBuilder::close_page(uint32_t state)
+{
+  NvsPageHeader *header = (NvsPageHeader *)(_image.data() + _page * NVS_PAGE_SIZE);
+  header->state = state;
+  header->sequence = _page;
+  header->version = NVS_PAGE_VERSION;
+  header->crc = nvs_page_crc(header);
+}
+
+// entries of one item never straddle pages; the last page of the image is left empty
+NvsItem *NvsImageBuilder::reserve(size_t span)
+{
+  if (_entry + span > NVS_PAGE_ENTRIES)
+  {
+    if (_page + 2 >= _pages)
+    {
+      _err = ESP_ERR_NVS_NOT_ENOUGH_SPACE;
+      return NULL;
+    }
+    close_page(NVS_PAGE_STATE_FULL);
+    _page++;
+    _entry = 0;
+  }
+
+  uint8_t *page = _image.data() + _page * NVS_PAGE_SIZE;
+  for (size_t i = _entry; i < _entry + span; i++)
+    page[NVS_PAGE_HEADER_SIZE + i / 4] &= ~((~NVS_ENTRY_STATE_WRITTEN & 0x3) << (i % 4 * 2));
+  NvsItem *item = (NvsItem *)(page + NVS_PAGE_FIRST_ENTRY + _entry * NVS_ENTRY_SIZE);
+  _entry += span;
+  return item;
+}
+
+esp_err_t NvsImageBuilder::write_scalar(uint8_t space, uint8_t type, const char *key, uint64_t bits)
+{
+  NvsItem *item = reserve(1);
+  if (item == NULL)
+    return _err;
+
+  item->space = space;
+  item->type = type;
+  item->span = 1;
+  item->chunk = NVS_CHUNK_ANY;
+  memset(item->key, 0, sizeof(item->key));
+  strcpy(item->key, key);
+  for (size_t i = 0; i < sizeof(item->data); i++)
+    item->data[i] = i < nvs_scalar_size((nvs_type_t)type) ? (uint8_t)(bits >> (8 * i)) : 0xff;
+  item->crc = nvs_item_crc(item);
+  return ESP_OK;
+}
+
+esp_err_t NvsImageBuilder::write_data(uint8_t type, const char *key, uint8_t chunk, const void *data, size_t length)
+{
+  size_t span = 1 + data_entries(length);
+  NvsItem *item = reserve(span);
+  if (item == NULL)
+    return _err;
+
+  item->space = _space;
+  item->type = type;
+  item->span = span;
+  item->chunk = chunk;
+  memset(item->key, 0, sizeof(item->key));
+  strcpy(item->key, key);
+  item->var.size = length;
+  item->var.reserved = 0xffff;
+  memcpy(item + 1, data, length);
+  item->var.crc = nvs_data_crc(item + 1, length);
+  item->crc = nvs_item_crc(item);
+  return ESP_OK;
+}
+
+// a chunk fills what is left of a page, so a blob takes as few entries as possible
+size_t NvsImageBuilder::blob_chunks(size_t length)
+{
+  size_t room = NVS_PAGE_ENTRIES - _entry >= 2 ? (NVS_PAGE_ENTRIES - _entry - 1) * NVS_ENTRY_SIZE : 0;
+  if (room > 0 && length <= room)
+    return 1;
+  length -= std::min(room, length);
+  return (room > 0 ? 1 : 0) + std::max<size_t>(1, (length + NVS_ITEM_MAX_DATA - 1) / NVS_ITEM_MAX_DATA);
+}
+
+esp_err_t NvsImageBuilder::write_blob(const char *key, const void *data, size_t length)
+{
+  size_t chunks = blob_chunks(length);
+  if (chunks > NVS_BUILDER_MAX_CHUNKS)
+    return ESP_ERR_NVS_VALUE_TOO_LONG;
+
+  size_t offset = 0;
+  for (uint8_t chunk = 0; chunk < chunks; chunk++)
+  {
+    // with less than 2 free entries, reserve() moves to a new page
+    size_t free = NVS_PAGE_ENTRIES - _entry;
+    size_t size = std::min(free >= 2 ? (free - 1) * NVS_ENTRY_SIZE : NVS_ITEM_MAX_DATA, length - offset);
+    esp_err_t err = write_data(NVS_ITEM_BLOB_DATA, key, chunk, (const uint8_t *)data + offset, size);
+    if (err != ESP_OK)
+      return err;
+    offset += size;
+  }
+
+  NvsItem *item = reserve(1);
+  if (item == NULL)
+    return _err;
+  item->space = _space;
+  item->type = NVS_ITEM_BLOB_INDEX;
+  item->span = 1;
+  item->chunk = NVS_CHUNK_ANY;
+  memset(item->key, 0, sizeof(item->key));
+  strcpy(item->key, key);
+  item->blob.size = length;
+  item->blob.chunks = chunks;
+  item->blob.start = 0;
+  item->blob.reserved = 0xffff;
+  item->crc = nvs_item_crc(item);
+  return ESP_OK;
+}
+
+esp_err_t NvsImageBuilder::setNamespace(const char *namespace_name)
+{
+  if (_err != ESP_OK || _finished)
+    return ESP_ERR_INVALID_STATE;
+  esp_err_t err = check_name(namespace_name);
+  if (err != ESP_OK)
+    return err;
+
+  for (size_t i = 0; i < _namespaces.size(); i++)
+    if (_namespaces[i] == namespace_name)
+    {
+      _space = i + 1;
+      return ESP_OK;
+    }
+
+  if (_namespaces.size() == NVS_NAMESPACE_MAX)
+    return ESP_ERR_NVS_NOT_ENOUGH_SPACE;
+  uint8_t space = _namespaces.size() + 1;
+  if ((err = write_scalar(NVS_NAMESPACE_INDEX, NVS_TYPE_U8, namespace_name, space)) != ESP_OK)
+    return err;
+  _namespaces.push_back(namespace_name);
+  _space = space;
+  return ESP_OK;
+}
+
+esp_err_t NvsImageBuilder::add(const NvsValue &value)
+{
+  if (_err != ESP_OK || _finished || _space == NVS_NAMESPACE_INDEX)
+    return ESP_ERR_INVALID_STATE;
+  const char *key = value.key.c_str();
+  esp_err_t err = check_name(key);
+  if (err != ESP_OK)
+    return err;
+
+  if (value.type == NVS_TYPE_STR)
+  {
+    if (value.length > NVS_BUILDER_MAX_STRING)
+      return ESP_ERR_NVS_VALUE_TOO_LONG;
+    if (value.length == 0 || ((const char *)value.data)[value.length - 1] != '\0')
+      return ESP_ERR_INVALID_ARG;
+    return write_data(NVS_ITEM_STR, key, NVS_CHUNK_ANY, value.data, value.length);
+  }
+  if (value.type == NVS_TYPE_BLOB)
+    return write_blob(key, value.data, value.length);
+  return write_scalar(_space, nvs_entry_type(value.type), key, value.bits);
+}
+
+esp_err_t NvsImageBuilder::finish()
+{
+  if (_err == ESP_OK && !_finished && _entry > 0)
+    close_page(NVS_PAGE_STATE_ACTIVE);
+  _finished = true;
+  return _err;
+}
@@ -0,0 +1,254 @@
+#include "include/NVS.h"
+#include "string.h"
+
+#include <stdio.h>
+
+static void chunk_key(char *key, uint32_t hash, uint8_t generation, uint16_t index)
+{
+  snprintf(key, NVS_KEY_NAME_MAX_SIZE, "~%08lx.%c%03x", (unsigned long)hash, 'a' + generation, index);
+}
+
+static esp_err_t read_manifest(NvsBackend *backend, nvs_handle_t handle, const char *key, NvsObjectManifest *manifest)
+{
+  size_t length = sizeof(*manifest);
+  esp_err_t err = backend->getBlob(handle, key, manifest, &length);
+  if (err == ESP_ERR_NVS_INVALID_LENGTH)
+    return ESP_ERR_NVS_TYPE_MISMATCH;
+  if (err != ESP_OK)
+    return err;
+  // the reader divides by chunk_size and derives chunk indexes from size
+  if (length != sizeof(*manifest) || manifest->magic != NVS_OBJECT_MAGIC || manifest->chunk_size == 0 ||
+      manifest->size > (uint32_t)manifest->chunk_size * NVS_OBJECT_MAX_CHUNKS || manifest->generation > 1)
+    return ESP_ERR_NVS_TYPE_MISMATCH;
+  return ESP_OK;
+}
+
+// chunks are numbered from 0 without gaps, the first missing one ends the object
+static void erase_chunks(NvsBackend *backend, nvs_handle_t handle, uint32_t hash, uint8_t generation, uint16_t first)
+{
+  char key[NVS_KEY_NAME_MAX_SIZE];
+  for (uint16_t index = first; index < NVS_OBJECT_MAX_CHUNKS; index++)
+  {
+    chunk_key(key, hash, generation, index);
+    if (backend->eraseKey(handle, key) != ESP_OK)
+      break;
+  }
+}
+
+NvsObjectWriter::NvsObjectWriter(Nvs &nvs, const char *key, std::span<uint8_t> chunk_buffer) : _nvs(nvs), _buffer(chunk_buffer)
+{
+  size_t key_length = strlen(key);
+  if (key_length == 0 || key_length > NVS_KEY_NAME_MAX_SIZE - 1 || chunk_buffer.empty() || chunk_buffer.size() > UINT16_MAX)
+  {
+    _err = ESP_ERR_INVALID_ARG;
+    _done = true;
+    return;
+  }
+  strcpy(_key, key);
+  _hash = NvsKey::hash(key);
+
+  // a queued write of the key would land after the manifest read here
+  _nvs.wait_async();
+  NvsGuard guard(_nvs._lock, _nvs._concurrent, NvsGuard::SHARED);
+  esp_err_t err = read_manifest(_nvs._backend, _nvs._nvs_handle, key, &_previous);
+  if (err == ESP_OK)
+    _generation = !_previous.generation;
+  else if (err != ESP_ERR_NVS_NOT_FOUND && err != ESP_ERR_NVS_TYPE_MISMATCH)
+  {
+    _err = err;
+    _done = true;
+  }
+}
+
+NvsObjectWriter::~NvsObjectWriter()
+{
+  if (_done)
+    return;
+  // never finished: the previous object is still the valid one
+  NvsGuard guard(_nvs._lock, _nvs._concurrent, NvsGuard::EXCLUSIVE);
+  erase_chunks(_nvs._backend, _nvs._nvs_handle, _hash, _generation, 0);
+  _nvs.commit_if_needed();
+}
+
+esp_err_t NvsObjectWriter::write(const void *data, size_t length)
+{
+  if (_done || _err != ESP_OK)
+    return ESP_ERR_INVALID_STATE;
+
+  const uint8_t *bytes = (const uint8_t *)data;
+  while (length > 0)
+  {
+    size_t count = _buffer.size() - _used;
+    if (count > length)
+      count = length;
+    memcpy(_buffer.data() + _used, bytes, count);
+    _used += count;
+    _size += count;
+    bytes += count;
+    length -= count;
+
+    if (_used == _buffer.size() && (_err = write_chunk()) != ESP_OK)
+      return _err;
+  }
+  return ESP_OK;
+}
+
+esp_err_t NvsObjectWriter::write_chunk()
+{
+  if (_chunks >= NVS_OBJECT_MAX_CHUNKS)
+    return ESP_ERR_INVALID_SIZE;
+
+  char key[NVS_KEY_NAME_MAX_SIZE];
+  chunk_key(key, _hash, _generation, _chunks);
+
+  NvsGuard guard(_nvs._lock, _nvs._concurrent, NvsGuard::EXCLUSIVE);
+  esp_err_t err = _nvs._backend->setBlob(_nvs._nvs_handle, key, _buffer.data(), _used);
+  NVS_STAT(_nvs._stats.set(NVS_TYPE_BLOB, _used, err));
+  if (err != ESP_OK)
+    return err;
+
+  _chunks++;
+  _used = 0;
+  return ESP_OK;
+}
+
+esp_err_t NvsObjectWriter::finish()
+{
+  if (_done || _err != ESP_OK)
+    return _err != ESP_OK ? _err : ESP_ERR_INVALID_STATE;
+  if (_used > 0 && (_err = write_chunk()) != ESP_OK)
+    return _err;
+
+  // nor may one queued since the constructor overwrite the manifest
+  _nvs.wait_async();
+  NvsGuard guard(_nvs._lock, _nvs._concurrent, NvsGuard::EXCLUSIVE);
+  NvsBackend *backend = _nvs._backend;
+  nvs_handle_t handle = _nvs._nvs_handle;
+
+  // a value of another type under the key would stay next to the manifest
+  nvs_type_t type;
+  if (backend->findKey(handle, _key, &type) == ESP_OK && type != NVS_TYPE_BLOB && (_err = backend->eraseKey(handle, _key)) != ESP_OK)
+    return _err;
+  _nvs.cache_remove(NvsKey::dynamic(_key));
+
+  NvsObjectManifest manifest = {NVS_OBJECT_MAGIC, (uint32_t)_size, (uint16_t)_buffer.size(), _generation, 0};
+  _err = backend->setBlob(handle, _key, &manifest, sizeof(manifest));
+  NVS_STAT(_nvs._stats.set(NVS_TYPE_BLOB, sizeof(manifest), _err));
+  if (_err != ESP_OK)
+    return _err;
+  // the manifest names the new chunks from here on: the destructor must not erase them, even when the
+  // commit fails and the chunks of the previous object are kept
+  _done = true;
+  if ((_err = _nvs.commit_if_needed()) != ESP_OK)
+    return _err;
+
+  // the previous object, and whatever an interrupted write of this generation left behind
+  erase_chunks(backend, handle, _hash, !_generation, 0);
+  erase_chunks(backend, handle, _hash, _generation, _chunks);
+  return _nvs.commit_if_needed();
+}
+
+NvsObjectReader::NvsObjectReader(Nvs &nvs, const char *key, std::span<uint8_t> chunk_buffer)
+    : _nvs(nvs), _hash(NvsKey::hash(key)), _buffer(chunk_buffer)
+{
+  if (strlen(key) > NVS_KEY_NAME_MAX_SIZE - 1)
+  {
+    _err = ESP_ERR_INVALID_ARG;
+    return;
+  }
+
+  NvsGuard guard(_nvs._lock, _nvs._concurrent, NvsGuard::SHARED);
+  _err = read_manifest(_nvs._backend, _nvs._nvs_handle, key, &_manifest);
+  if (_err == ESP_OK && _manifest.chunk_size > _buffer.size())
+    _err = ESP_ERR_INVALID_SIZE;
+  if (_err != ESP_OK)
+    _manifest = {};
+}
+
+esp_err_t NvsObjectReader::load(uint16_t chunk)
+{
+  if (_loaded == chunk)
+    return ESP_OK;
+
+  char key[NVS_KEY_NAME_MAX_SIZE];
+  chunk_key(key, _hash, _manifest.generation, chunk);
+  size_t expected = _manifest.size - (size_t)chunk * _manifest.chunk_size;
+  if (expected > _manifest.chunk_size)
+    expected = _manifest.chunk_size;
+
+  NvsGuard guard(_nvs._lock, _nvs._concurrent, NvsGuard::SHARED);
+  size_t length = _buffer.size();
+  esp_err_t err = _nvs._backend->getBlob(_nvs._nvs_handle, key, _buffer.data(), &length);
+  NVS_STAT(_nvs._stats.get(NVS_TYPE_BLOB, err));
+  if (err == ESP_OK && length != expected)
+    err = ESP_ERR_NVS_INVALID_LENGTH;
+  if (err != ESP_OK)
+  {
+    _loaded = -1;
+    return _err = err;
+  }
+  _loaded = chunk;
+  return ESP_OK;
+}
+
+esp_err_t NvsObjectReader::readAt(size_t offset, void *data, size_t length)
+{
+  if (_manifest.magic != NVS_OBJECT_MAGIC)
+    return _err;
+  if (offset > _manifest.size || length > _manifest.size - offset)
+    return ESP_ERR_INVALID_SIZE;
+
+  uint8_t *bytes = (uint8_t *)data;
+  while (length > 0)
+  {
+    uint16_t chunk = offset / _manifest.chunk_size;
+    size_t within = offset % _manifest.chunk_size;
+    size_t count = _manifest.chunk_size - within;
+    if (count > length)
+      count = length;
+
+    esp_err_t err = load(chunk);
+    if (err != ESP_OK)
+      return err;
+    memcpy(bytes, _buffer.data() + within, count);
+    bytes += count;
+    offset += count;
+    length -= count;
+  }
+  return ESP_OK;
+}
+
+esp_err_t NvsObjectReader::read(void *data, size_t *length)
+{
+  size_t count = _manifest.size - _position;
+  if (count > *length)
+    count = *length;
+
+  esp_err_t err = readAt(_position, data, count);
+  if (err != ESP_OK)
+  {
+    *length = 0;
+    return err;
+  }
+  _position += count;
+  *length = count;
+  return ESP_OK;
+}
+
+esp_err_t Nvs::eraseObject(const char *key)
+{
+  if (strlen(key) > NVS_KEY_NAME_MAX_SIZE - 1)
+    return ESP_ERR_INVALID_ARG;
+
+  wait_async();
+  NvsGuard guard(_lock, _concurrent, NvsGuard::EXCLUSIVE);
+  NvsObjectManifest manifest;
+  esp_err_t err = read_manifest(_backend, _nvs_handle, key, &manifest);
+  if (err != ESP_OK)
+    return result(err);
+
+  uint32_t hash = NvsKey::hash(key);
+  erase_chunks(_backend, _nvs_handle, hash, manifest.generation, 0);
+  erase_chunks(_backend, _nvs_handle, hash, !manifest.generation, 0);
+  return erase(key);
+}
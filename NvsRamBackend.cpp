@@ -0,0 +1,543 @@
+#include "include/NvsRamBackend.h"
+#include "include/NvsKey.h"
+#include "include/NvsTraits.h"
+#include "string.h"
+
+// nvs_flash keeps NVS_TYPE_STR values up to this size
+#define MAX_STRING_LENGTH 4000
+
+struct RamIterator
+{
+  std::vector<nvs_entry_info_t> entries;
+  size_t index;
+};
+
+// integers are kept the way nvs_flash returns them: truncated to their size, signed ones sign-extended
+static uint64_t normalize(nvs_type_t type, uint64_t value)
+{
+  size_t size = nvs_scalar_size(type);
+  if (size >= 8)
+    return value;
+  value &= (1ull << (8 * size)) - 1;
+  bool is_signed = (type & 0xf0) == 0x10;
+  if (is_signed && (value >> (8 * size - 1)) != 0)
+    value |= ~0ull << (8 * size);
+  return value;
+}
+
+static bool is_scalar(nvs_type_t type)
+{
+  switch (type)
+  {
+  case NVS_TYPE_I8:
+  case NVS_TYPE_U8:
+  case NVS_TYPE_I16:
+  case NVS_TYPE_U16:
+  case NVS_TYPE_I32:
+  case NVS_TYPE_U32:
+  case NVS_TYPE_I64:
+  case NVS_TYPE_U64:
+    return true;
+  default:
+    return false;
+  }
+}
+
+bool NvsRamBackend::Name::operator==(const Name &other) const
+{
+  return space == other.space && strcmp(key, other.key) == 0;
+}
+
+size_t NvsRamBackend::NameHash::operator()(const Name &name) const
+{
+  return NvsKey::hash(name.key) ^ (name.space * 0x9e3779b9u);
+}
+
+uint16_t NvsRamBackend::namespace_index(const char *namespace_name, bool create)
+{
+  for (size_t i = 0; i < _namespaces.size(); i++)
+  {
+    if (_namespaces[i] == namespace_name)
+      return i;
+  }
+  if (!create)
+    return UINT16_MAX;
+  _namespaces.emplace_back(namespace_name);
+  return _namespaces.size() - 1;
+}
+
+esp_err_t NvsRamBackend::open(const char *namespace_name, nvs_open_mode_t open_mode, nvs_handle_t *handle)
+{
+  size_t length = strlen(namespace_name);
+  if (length == 0 || length > NVS_KEY_NAME_MAX_SIZE - 1)
+    return ESP_ERR_NVS_INVALID_NAME;
+
+  std::lock_guard<std::mutex> lock(_mutex);
+  // like nvs_flash, only a read-write open creates the namespace
+  uint16_t space = namespace_index(namespace_name, open_mode == NVS_READWRITE);
+  if (space == UINT16_MAX)
+    return ESP_ERR_NVS_NOT_FOUND;
+
+  Handle opened = {space, open_mode == NVS_READWRITE, true};
+  for (size_t i = 0; i < _handles.size(); i++)
+  {
+    if (!_handles[i].open)
+    {
+      _handles[i] = opened;
+      *handle = i + 1;
+      return ESP_OK;
+    }
+  }
+  _handles.push_back(opened);
+  *handle = _handles.size();
+  return ESP_OK;
+}
+
+void NvsRamBackend::close(nvs_handle_t handle)
+{
+  std::lock_guard<std::mutex> lock(_mutex);
+  if (handle >= 1 && handle <= _handles.size())
+    _handles[handle - 1].open = false;
+}
+
+esp_err_t NvsRamBackend::handle_space(nvs_handle_t handle, bool write, uint16_t *space)
+{
+  if (handle < 1 || handle > _handles.size() || !_handles[handle - 1].open)
+    return ESP_ERR_NVS_INVALID_HANDLE;
+  if (write && !_handles[handle - 1].writable)
+    return ESP_ERR_NVS_READ_ONLY;
+  *space = _handles[handle - 1].space;
+  return ESP_OK;
+}
+
+esp_err_t NvsRamBackend::lookup(nvs_handle_t handle, const char *key, bool write, Name *name)
+{
+  esp_err_t err = handle_space(handle, write, &name->space);
+  if (err != ESP_OK)
+    return err;
+  size_t length = strlen(key);
+  if (length == 0)
+    return ESP_ERR_NVS_INVALID_NAME;
+  if (length > NVS_KEY_NAME_MAX_SIZE - 1)
+    return ESP_ERR_NVS_KEY_TOO_LONG;
+  memcpy(name->key, key, length + 1);
+  return ESP_OK;
+}
+
+esp_err_t NvsRamBackend::getScalar(nvs_handle_t handle, const char *key, nvs_type_t type, uint64_t *value)
+{
+  if (!is_scalar(type))
+    return ESP_ERR_NVS_TYPE_MISMATCH;
+
+  std::lock_guard<std::mutex> lock(_mutex);
+  Name name;
+  esp_err_t err = lookup(handle, key, false, &name);
+  if (err != ESP_OK)
+    return err;
+  auto found = _values.find(name);
+  if (found == _values.end() || found->second.type != type)
+    return ESP_ERR_NVS_NOT_FOUND;
+  *value = found->second.bits;
+  return ESP_OK;
+}
+
+esp_err_t NvsRamBackend::setScalar(nvs_handle_t handle, const char *key, nvs_type_t type, uint64_t value)
+{
+  if (!is_scalar(type))
+    return ESP_ERR_NVS_TYPE_MISMATCH;
+  return set_value(handle, key, Value{type, normalize(type, value), {}});
+}
+
+esp_err_t NvsRamBackend::get_data(nvs_handle_t handle, const char *key, nvs_type_t type, void *value, size_t *length)
+{
+  std::lock_guard<std::mutex> lock(_mutex);
+  Name name;
+  esp_err_t err = lookup(handle, key, false, &name);
+  if (err != ESP_OK)
+    return err;
+  auto found = _values.find(name);
+  if (found == _values.end() || found->second.type != type)
+    return ESP_ERR_NVS_NOT_FOUND;
+
+  const std::vector<uint8_t> &data = found->second.data;
+  if (value != NULL)
+  {
+    if (*length < data.size())
+    {
+      *length = data.size();
+      return ESP_ERR_NVS_INVALID_LENGTH;
+    }
+    memcpy(value, data.data(), data.size());
+  }
+  *length = data.size();
+  return ESP_OK;
+}
+
+esp_err_t NvsRamBackend::getStr(nvs_handle_t handle, const char *key, char *value, size_t *length)
+{
+  return get_data(handle, key, NVS_TYPE_STR, value, length);
+}
+
+esp_err_t NvsRamBackend::getBlob(nvs_handle_t handle, const char *key, void *value, size_t *length)
+{
+  return get_data(handle, key, NVS_TYPE_BLOB, value, length);
+}
+
+esp_err_t NvsRamBackend::setStr(nvs_handle_t handle, const char *key, const char *value)
+{
+  size_t length = strlen(value) + 1;
+  if (length > MAX_STRING_LENGTH)
+    return ESP_ERR_NVS_VALUE_TOO_LONG;
+  const uint8_t *data = (const uint8_t *)value;
+  return set_value(handle, key, Value{NVS_TYPE_STR, 0, std::vector<uint8_t>(data, data + length)});
+}
+
+esp_err_t NvsRamBackend::setBlob(nvs_handle_t handle, const char *key, const void *value, size_t length)
+{
+  const uint8_t *data = (const uint8_t *)value;
+  return set_value(handle, key, Value{NVS_TYPE_BLOB, 0, std::vector<uint8_t>(data, data + length)});
+}
+
+esp_err_t NvsRamBackend::set_value(nvs_handle_t handle, const char *key, Value &&value)
+{
+  std::lock_guard<std::mutex> lock(_mutex);
+  Name name;
+  esp_err_t err = lookup(handle, key, true, &name);
+  if (err != ESP_OK)
+    return err;
+  _values.insert_or_assign(name, std::move(value));
+  _changes++;
+  return ESP_OK;
+}
+
+esp_err_t NvsRamBackend::findKey(nvs_handle_t handle, const char *key, nvs_type_t *type)
+{
+  std::lock_guard<std::mutex> lock(_mutex);
+  Name name;
+  esp_err_t err = lookup(handle, key, false, &name);
+  if (err != ESP_OK)
+    return err;
+  auto found = _values.find(name);
+  if (found == _values.end())
+    return ESP_ERR_NVS_NOT_FOUND;
+  if (type != NULL)
+    *type = found->second.type;
+  return ESP_OK;
+}
+
+esp_err_t NvsRamBackend::eraseKey(nvs_handle_t handle, const char *key)
+{
+  std::lock_guard<std::mutex> lock(_mutex);
+  Name name;
+  esp_err_t err = lookup(handle, key, true, &name);
+  if (err != ESP_OK)
+    return err;
+  if (_values.erase(name) == 0)
+    return ESP_ERR_NVS_NOT_FOUND;
+  _changes++;
+  return ESP_OK;
+}
+
+esp_err_t NvsRamBackend::eraseAll(nvs_handle_t handle)
+{
+  std::lock_guard<std::mutex> lock(_mutex);
+  uint16_t space;
+  esp_err_t err = handle_space(handle, true, &space);
+  if (err != ESP_OK)
+    return err;
+  std::erase_if(_values, [space](const auto &entry) { return entry.first.space == space; });
+  _changes++;
+  return ESP_OK;
+}
+
+esp_err_t NvsRamBackend::commit(nvs_handle_t handle)
+{
+  std::lock_guard<std::mutex> lock(_mutex);
+  uint16_t space;
+  return handle_space(handle, false, &space);
+}
+
+void *NvsRamBackend::entryFind(const char *namespace_name, nvs_type_t type)
+{
+  std::lock_guard<std::mutex> lock(_mutex);
+  uint16_t space = UINT16_MAX;
+  if (namespace_name != NULL && (space = namespace_index(namespace_name, false)) == UINT16_MAX)
+    return NULL;
+
+  // a scan works on a copy of the names, so writes during it can't invalidate it
+  RamIterator *it = new RamIterator{{}, 0};
+  for (const auto &[name, value] : _values)
+  {
+    if ((namespace_name != NULL && name.space != space) || (type != NVS_TYPE_ANY && value.type != type))
+      continue;
+    nvs_entry_info_t info = {};
+    strcpy(info.namespace_name, _namespaces[name.space].c_str());
+    strcpy(info.key, name.key);
+    info.type = value.type;
+    it->entries.push_back(info);
+  }
+  if (it->entries.empty())
+  {
+    delete it;
+    return NULL;
+  }
+  return it;
+}
+
+void *NvsRamBackend::entryNext(void *it)
+{
+  RamIterator *scan = (RamIterator *)it;
+  if (++scan->index < scan->entries.size())
+    return scan;
+  delete scan;
+  return NULL;
+}
+
+void NvsRamBackend::entryInfo(void *it, nvs_entry_info_t *info)
+{
+  RamIterator *scan = (RamIterator *)it;
+  *info = scan->entries[scan->index];
+}
+
+void NvsRamBackend::entryRelease(void *it)
+{
+  delete (RamIterator *)it;
+}
+
+size_t NvsRamBackend::size()
+{
+  std::lock_guard<std::mutex> lock(_mutex);
+  return _values.size();
+}
+
+#if defined(CONFIG_IDF_TARGET_LINUX) || !defined(ESP_PLATFORM)
+
+#include "include/NvsCrc.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define FILE_MAGIC "NVSF"
+#define FILE_VERSION 1
+#define FILE_HEADER_SIZE 8
+
+static void put_le(uint8_t *data, uint64_t value, size_t size)
+{
+  for (size_t i = 0; i < size; i++)
+    data[i] = (uint8_t)(value >> (8 * i));
+}
+
+static uint64_t get_le(const uint8_t *data, size_t size)
+{
+  uint64_t value = 0;
+  for (size_t i = 0; i < size; i++)
+    value |= (uint64_t)data[i] << (8 * i);
+  return value;
+}
+
+NvsFileBackend::NvsFileBackend(const char *path) : _path(path)
+{
+  _fd = ::open(path, O_RDWR | O_CREAT, 0644);
+  _err = _fd < 0 ? ESP_FAIL : load();
+}
+
+NvsFileBackend::~NvsFileBackend()
+{
+  map(0);
+  if (_fd >= 0)
+    ::close(_fd);
+}
+
+esp_err_t NvsFileBackend::map(size_t size)
+{
+  if (_map != NULL && _mapped == size)
+    return ESP_OK;
+  if (_map != NULL)
+    munmap(_map, _mapped);
+  _map = NULL;
+  _mapped = 0;
+  if (size == 0)
+    return ESP_OK;
+
+  void *mapped = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, _fd, 0);
+  if (mapped == MAP_FAILED)
+    return ESP_FAIL;
+  _map = (uint8_t *)mapped;
+  _mapped = size;
+  return ESP_OK;
+}
+
+esp_err_t NvsFileBackend::load()
+{
+  struct stat info;
+  if (fstat(_fd, &info) != 0)
+    return ESP_FAIL;
+  size_t size = info.st_size;
+  if (size == 0)
+    return ESP_OK;
+  if (map(size) != ESP_OK)
+    return ESP_FAIL;
+
+  if (size < FILE_HEADER_SIZE + 1 + 4 || memcmp(_map, FILE_MAGIC, 4) != 0)
+    return ESP_ERR_INVALID_ARG;
+  if (get_le(_map + 4, 2) != FILE_VERSION)
+    return ESP_ERR_INVALID_VERSION;
+  if (nvs_crc32(0, _map, size - 4) != get_le(_map + size - 4, 4))
+    return ESP_ERR_INVALID_CRC;
+
+  std::lock_guard<std::mutex> lock(_mutex);
+  const uint8_t *p = _map + FILE_HEADER_SIZE;
+  const uint8_t *end = _map + size - 4;
+  while (p < end && *p != 0)
+  {
+    // namespace, type, key length; the lengths are checked before anything is copied
+    size_t space_length = *p++;
+    if (space_length > NVS_KEY_NAME_MAX_SIZE - 1 || (size_t)(end - p) < space_length + 2)
+      break;
+    char space[NVS_KEY_NAME_MAX_SIZE];
+    memcpy(space, p, space_length);
+    space[space_length] = '\0';
+    p += space_length;
+    nvs_type_t type = (nvs_type_t)*p++;
+    size_t key_length = *p++;
+    if (key_length == 0 || key_length > NVS_KEY_NAME_MAX_SIZE - 1 || (size_t)(end - p) < key_length)
+      break;
+
+    Name name = {namespace_index(space, true), {}};
+    memcpy(name.key, p, key_length);
+    name.key[key_length] = '\0';
+    p += key_length;
+
+    Value value = {type, 0, {}};
+    if (is_scalar(type))
+    {
+      if ((size_t)(end - p) < nvs_scalar_size(type))
+        break;
+      value.bits = normalize(type, get_le(p, nvs_scalar_size(type)));
+      p += nvs_scalar_size(type);
+    }
+    else if (type == NVS_TYPE_STR || type == NVS_TYPE_BLOB)
+    {
+      if (end - p < 4)
+        break;
+      size_t length = get_le(p, 4);
+      p += 4;
+      if ((size_t)(end - p) < length)
+        break;
+      value.data.assign(p, p + length);
+      p += length;
+    }
+    else
+      break;
+    _values.insert_or_assign(name, std::move(value));
+  }
+
+  if (p >= end || *p != 0)
+  {
+    _values.clear();
+    _namespaces.clear();
+    return ESP_ERR_INVALID_SIZE;
+  }
+  _saved_changes = _changes;
+  return ESP_OK;
+}
+
+// makes a rename in the directory of path durable
+static void sync_directory(const std::string &path)
+{
+  size_t slash = path.rfind('/');
+  std::string directory = slash == std::string::npos ? "." : path.substr(0, slash + 1);
+  int fd = ::open(directory.c_str(), O_RDONLY);
+  if (fd < 0)
+    return;
+  fsync(fd);
+  ::close(fd);
+}
+
+esp_err_t NvsFileBackend::commit(nvs_handle_t handle)
+{
+  esp_err_t err = NvsRamBackend::commit(handle);
+  if (err != ESP_OK)
+    return err;
+  if (_err != ESP_OK)
+    return _err;
+
+  std::lock_guard<std::mutex> lock(_mutex);
+  if (_changes == _saved_changes)
+    return ESP_OK;
+
+  // sized first, then written straight into the mapping
+  size_t size = FILE_HEADER_SIZE + 1 + 4;
+  for (const auto &[name, value] : _values)
+  {
+    size += 1 + _namespaces[name.space].size() + 2 + strlen(name.key);
+    size += is_scalar(value.type) ? nvs_scalar_size(value.type) : 4 + value.data.size();
+  }
+  // the new image goes to a temporary file, the current one stays untouched until the rename
+  std::string temporary = _path + ".tmp";
+  int fd = ::open(temporary.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0)
+    return ESP_FAIL;
+  void *mapped = ftruncate(fd, size) == 0 ? mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0) : MAP_FAILED;
+  if (mapped == MAP_FAILED)
+  {
+    ::close(fd);
+    unlink(temporary.c_str());
+    return ESP_FAIL;
+  }
+
+  uint8_t *image = (uint8_t *)mapped;
+  uint8_t *p = image;
+  memcpy(p, FILE_MAGIC, 4);
+  put_le(p + 4, FILE_VERSION, 2);
+  put_le(p + 6, 0, 2);
+  p += FILE_HEADER_SIZE;
+  for (const auto &[name, value] : _values)
+  {
+    const std::string &space = _namespaces[name.space];
+    size_t key_length = strlen(name.key);
+    *p++ = space.size();
+    memcpy(p, space.data(), space.size());
+    p += space.size();
+    *p++ = value.type;
+    *p++ = key_length;
+    memcpy(p, name.key, key_length);
+    p += key_length;
+    if (is_scalar(value.type))
+    {
+      put_le(p, value.bits, nvs_scalar_size(value.type));
+      p += nvs_scalar_size(value.type);
+    }
+    else
+    {
+      put_le(p, value.data.size(), 4);
+      memcpy(p + 4, value.data.data(), value.data.size());
+      p += 4 + value.data.size();
+    }
+  }
+  *p++ = 0;
+  put_le(p, nvs_crc32(0, image, p - image), 4);
+
+  if (msync(image, size, MS_SYNC) != 0 || fsync(fd) != 0 || rename(temporary.c_str(), _path.c_str()) != 0)
+  {
+    munmap(image, size);
+    ::close(fd);
+    unlink(temporary.c_str());
+    return ESP_FAIL;
+  }
+  sync_directory(_path);
+
+  // the temporary file is now the file under _path
+  map(0);
+  ::close(_fd);
+  _fd = fd;
+  _map = image;
+  _mapped = size;
+  _saved_changes = _changes;
+  return ESP_OK;
+}
+
+#endif
@@ -0,0 +1,233 @@
+#include "include/NvsRingLog.h"
+#include "include/NvsCrc.h"
+#include "nvs.h"
+#include "string.h"
+
+#define NVS_RING_ERASED UINT32_MAX
+
+static uint32_t record_crc(uint32_t sequence, const void *record, size_t size)
+{
+  return nvs_crc32(nvs_crc32(0, &sequence, sizeof(sequence)), record, size);
+}
+
+NvsRingLog::NvsRingLog(const char *partition_label, size_t record_size) : _record_size(record_size)
+{
+  if (record_size == 0 || record_size > NVS_RING_MAX_RECORD)
+  {
+    _err = ESP_ERR_INVALID_SIZE;
+    return;
+  }
+
+  _partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, partition_label);
+  if (_partition == NULL)
+  {
+    _err = ESP_ERR_NOT_FOUND;
+    return;
+  }
+
+  _slot_size = sizeof(NvsRingHeader) + ((record_size + 3) & ~(size_t)3);
+  _sectors = _partition->size / _partition->erase_size;
+  _slots_per_sector = _partition->erase_size / _slot_size;
+  if (_sectors < 2)
+  {
+    _err = ESP_ERR_INVALID_SIZE;
+    return;
+  }
+
+  _err = scan();
+}
+
+size_t NvsRingLog::slot_offset(size_t slot)
+{
+  return (slot / _slots_per_sector) * _partition->erase_size + (slot % _slots_per_sector) * _slot_size;
+}
+
+// ESP_ERR_NVS_NOT_FOUND: never written, ESP_ERR_INVALID_CRC: written but torn
+esp_err_t NvsRingLog::read_slot(size_t slot, NvsRingHeader *header, void *record)
+{
+  uint8_t buffer[sizeof(NvsRingHeader) + NVS_RING_MAX_RECORD + 3];
+  esp_err_t err = esp_partition_read(_partition, slot_offset(slot), buffer, _slot_size);
+  if (err != ESP_OK)
+    return err;
+
+  memcpy(header, buffer, sizeof(*header));
+  const uint8_t *data = buffer + sizeof(*header);
+  if (header->sequence == NVS_RING_ERASED)
+  {
+    for (size_t i = sizeof(*header); i < _slot_size; i++)
+      if (buffer[i] != 0xff)
+        return ESP_ERR_INVALID_CRC;
+    return header->crc == NVS_RING_ERASED ? ESP_ERR_NVS_NOT_FOUND : ESP_ERR_INVALID_CRC;
+  }
+  if (header->sequence == 0 || header->crc != record_crc(header->sequence, data, _record_size))
+    return ESP_ERR_INVALID_CRC;
+
+  memcpy(record, data, _record_size);
+  return ESP_OK;
+}
+
+esp_err_t NvsRingLog::scan()
+{
+  uint8_t record[NVS_RING_MAX_RECORD];
+  NvsRingHeader header;
+
+  // every sector starts higher than the ones written before it
+  size_t newest = 0;
+  _sequence = 0;
+  for (size_t sector = 0; sector < _sectors; sector++)
+  {
+    esp_err_t err = read_slot(sector * _slots_per_sector, &header, record);
+    if (err == ESP_OK && header.sequence > _sequence)
+    {
+      _sequence = header.sequence;
+      newest = sector;
+    }
+    else if (err != ESP_OK && err != ESP_ERR_NVS_NOT_FOUND && err != ESP_ERR_INVALID_CRC)
+      return err;
+  }
+
+  if (_sequence == 0)
+  {
+    _latest = 0;
+    _next = 0;
+    return ESP_OK;
+  }
+
+  // a sector is filled in order: written slots, then blank ones
+  size_t first = newest * _slots_per_sector;
+  size_t low = 1, high = _slots_per_sector;
+  while (low < high)
+  {
+    size_t middle = (low + high) / 2;
+    esp_err_t err = read_slot(first + middle, &header, record);
+    if (err == ESP_ERR_NVS_NOT_FOUND)
+      high = middle;
+    else if (err == ESP_OK || err == ESP_ERR_INVALID_CRC)
+      low = middle + 1;
+    else
+      return err;
+  }
+  _next = (first + low) % (_sectors * _slots_per_sector);
+
+  // the latest record is the last one that isn't torn, at worst the first of the sector
+  _latest = first;
+  for (size_t slot = first + low; slot-- > first + 1;)
+  {
+    esp_err_t err = read_slot(slot, &header, record);
+    if (err == ESP_OK)
+    {
+      _latest = slot;
+      _sequence = header.sequence;
+      break;
+    }
+    if (err != ESP_ERR_INVALID_CRC)
+      return err;
+  }
+  return ESP_OK;
+}
+
+esp_err_t NvsRingLog::append(const void *record)
+{
+  std::lock_guard<std::mutex> lock(_mutex);
+  if (_err != ESP_OK)
+    return ESP_ERR_INVALID_STATE;
+
+  esp_err_t err;
+  if (_next % _slots_per_sector == 0 &&
+      (err = esp_partition_erase_range(_partition, slot_offset(_next), _partition->erase_size)) != ESP_OK)
+    return err;
+
+  uint8_t buffer[sizeof(NvsRingHeader) + NVS_RING_MAX_RECORD + 3];
+  NvsRingHeader header = {_sequence + 1, record_crc(_sequence + 1, record, _record_size)};
+  memcpy(buffer, &header, sizeof(header));
+  memcpy(buffer + sizeof(header), record, _record_size);
+  memset(buffer + sizeof(header) + _record_size, 0xff, _slot_size - sizeof(header) - _record_size);
+
+  size_t slot = _next;
+  err = esp_partition_write(_partition, slot_offset(slot), buffer, _slot_size);
+  // on failure the slot may be partly written. It is skipped, except the first of a sector: scan()
+  // dates a sector by that slot, so the next append erases the sector again and retries it.
+  if (err != ESP_OK && slot % _slots_per_sector == 0)
+    return err;
+  _next = (_next + 1) % (_sectors * _slots_per_sector);
+  if (err != ESP_OK)
+    return err;
+
+  _sequence = header.sequence;
+  _latest = slot;
+  return ESP_OK;
+}
+
+esp_err_t NvsRingLog::read(uint32_t back, void *record)
+{
+  std::lock_guard<std::mutex> lock(_mutex);
+  if (_err != ESP_OK)
+    return ESP_ERR_INVALID_STATE;
+  if (back >= _sequence)
+    return ESP_ERR_NVS_NOT_FOUND;
+
+  // sequences are contiguous, torn slots in between are skipped
+  uint32_t wanted = _sequence - back;
+  uint8_t found[NVS_RING_MAX_RECORD];
+  size_t slots = _sectors * _slots_per_sector;
+  size_t slot = _latest;
+  for (size_t i = 0; i < slots; i++, slot = (slot + slots - 1) % slots)
+  {
+    NvsRingHeader header;
+    esp_err_t err = read_slot(slot, &header, found);
+    if (err == ESP_OK && header.sequence <= wanted)
+    {
+      if (header.sequence < wanted)
+        break;
+      memcpy(record, found, _record_size);
+      return ESP_OK;
+    }
+    if (err != ESP_OK && err != ESP_ERR_NVS_NOT_FOUND && err != ESP_ERR_INVALID_CRC)
+      return err;
+  }
+  return ESP_ERR_NVS_NOT_FOUND;
+}
+
+esp_err_t NvsRingLog::clear()
+{
+  std::lock_guard<std::mutex> lock(_mutex);
+  if (_err != ESP_OK)
+    return ESP_ERR_INVALID_STATE;
+
+  esp_err_t err = esp_partition_erase_range(_partition, 0, _sectors * _partition->erase_size);
+  _sequence = 0;
+  _latest = 0;
+  _next = 0;
+  return err;
+}
+
+NvsCounter::NvsCounter(const char *partition_label) : _log(partition_label, sizeof(uint64_t))
+{
+  if (_log.read(0, &_value) != ESP_OK)
+    _value = 0;
+}
+
+uint64_t NvsCounter::value()
+{
+  std::lock_guard<std::mutex> lock(_mutex);
+  return _value;
+}
+
+esp_err_t NvsCounter::add(uint64_t delta)
+{
+  std::lock_guard<std::mutex> lock(_mutex);
+  uint64_t value = _value + delta;
+  esp_err_t err = _log.append(&value);
+  if (err == ESP_OK)
+    _value = value;
+  return err;
+}
+
+esp_err_t NvsCounter::set(uint64_t value)
+{
+  std::lock_guard<std::mutex> lock(_mutex);
+  esp_err_t err = _log.append(&value);
+  if (err == ESP_OK)
+    _value = value;
+  return err;
+}
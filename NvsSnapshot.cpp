@@ -0,0 +1,382 @@
+#include "include/NVS.h"
+#include "include/NvsCrc.h"
+#include "string.h"
+
+#include <errno.h>
+#include <unistd.h>
+
+static void put_le(uint8_t *data, uint64_t value, size_t size)
+{
+  for (size_t i = 0; i < size; i++)
+    data[i] = (uint8_t)(value >> (8 * i));
+}
+
+static uint64_t get_le(const uint8_t *data, size_t size)
+{
+  uint64_t value = 0;
+  for (size_t i = 0; i < size; i++)
+    value |= (uint64_t)data[i] << (8 * i);
+  return value;
+}
+
+// signed values are kept sign-extended, the way NvsTraits::encode() and the cache hold them
+static uint64_t get_scalar_le(const uint8_t *data, nvs_type_t type)
+{
+  size_t size = nvs_scalar_size(type);
+  uint64_t value = get_le(data, size);
+  bool is_signed = (type & 0xf0) == 0x10;
+  if (is_signed && size < 8 && (value >> (8 * size - 1)) != 0)
+    value |= ~0ull << (8 * size);
+  return value;
+}
+
+static bool is_scalar(nvs_type_t type)
+{
+  switch (type)
+  {
+  case NVS_TYPE_I8:
+  case NVS_TYPE_U8:
+  case NVS_TYPE_I16:
+  case NVS_TYPE_U16:
+  case NVS_TYPE_I32:
+  case NVS_TYPE_U32:
+  case NVS_TYPE_I64:
+  case NVS_TYPE_U64:
+    return true;
+  default:
+    return false;
+  }
+}
+
+// Stages small pieces of the image in the caller's buffer and hands it over when full
+struct SnapshotWriter
+{
+  NvsSnapshotWrite write;
+  void *arg;
+  uint8_t *buffer;
+  size_t size;
+  size_t used;
+  uint32_t crc;
+
+  esp_err_t flush()
+  {
+    if (used == 0)
+      return ESP_OK;
+    crc = nvs_crc32(crc, buffer, used);
+    esp_err_t err = write(buffer, used, arg);
+    used = 0;
+    return err;
+  }
+
+  // room for length (<= NVS_SNAPSHOT_MIN_BUFFER) bytes at buffer + used
+  esp_err_t reserve(size_t length)
+  {
+    if (used + length > size)
+      return flush();
+    return ESP_OK;
+  }
+};
+
+// Read-ahead over the caller's buffer; a string / blob value has to be contiguous in it
+struct SnapshotReader
+{
+  NvsSnapshotRead read;
+  void *arg;
+  uint8_t *buffer;
+  size_t size;
+  size_t start;
+  size_t end;
+  uint32_t crc;
+
+  // makes length bytes available at buffer + start
+  esp_err_t fill(size_t length)
+  {
+    if (length > size)
+      return ESP_ERR_NVS_INVALID_LENGTH;
+    if (end - start >= length)
+      return ESP_OK;
+
+    memmove(buffer, buffer + start, end - start);
+    end -= start;
+    start = 0;
+    while (end < length)
+    {
+      size_t read_length = size - end;
+      esp_err_t err = read(buffer + end, &read_length, arg);
+      if (err != ESP_OK)
+        return err;
+      if (read_length == 0)
+        return ESP_ERR_INVALID_SIZE; // truncated image
+      end += read_length;
+    }
+    return ESP_OK;
+  }
+
+  const uint8_t *take(size_t length)
+  {
+    const uint8_t *data = buffer + start;
+    crc = nvs_crc32(crc, data, length);
+    start += length;
+    return data;
+  }
+};
+
+esp_err_t Nvs::exportSnapshot(NvsSnapshotWrite write, void *arg, std::span<uint8_t> buffer)
+{
+  if (buffer.size() < NVS_SNAPSHOT_MIN_BUFFER)
+    return ESP_ERR_INVALID_ARG;
+
+  // values held back by write-back / async mode have to be in flash to be exported
+  flush();
+
+  NvsGuard guard(_lock, _concurrent, NvsGuard::SHARED);
+  SnapshotWriter out = {write, arg, buffer.data(), buffer.size(), 0, 0};
+
+  memcpy(out.buffer, NVS_SNAPSHOT_MAGIC, 4);
+  put_le(out.buffer + 4, NVS_SNAPSHOT_VERSION, 2);
+  put_le(out.buffer + 6, 0, 2);
+  out.used = NVS_SNAPSHOT_HEADER_SIZE;
+
+  esp_err_t err = ESP_OK;
+  for (const NvsEntry &entry : entries())
+  {
+    nvs_type_t type = entry.type();
+    const char *key = entry.key();
+    size_t key_length = strlen(key);
+
+    uint64_t value = 0;
+    size_t length;
+    if (is_scalar(type))
+    {
+      err = get_scalar(key, type, &value);
+      length = nvs_scalar_size(type);
+    }
+    else if (type == NVS_TYPE_STR)
+      err = _backend->getStr(_nvs_handle, key, NULL, &length);
+    else if (type == NVS_TYPE_BLOB)
+      err = _backend->getBlob(_nvs_handle, key, NULL, &length);
+    else
+      continue;
+    if (err != ESP_OK)
+      break;
+
+    if ((err = out.reserve(2 + key_length + 4 + 8)) != ESP_OK)
+      break;
+    uint8_t *record = out.buffer + out.used;
+    record[0] = type;
+    record[1] = key_length;
+    memcpy(record + 2, key, key_length);
+    out.used += 2 + key_length;
+
+    if (is_scalar(type))
+    {
+      put_le(out.buffer + out.used, value, length);
+      out.used += length;
+      continue;
+    }
+
+    put_le(out.buffer + out.used, length, 4);
+    out.used += 4;
+
+    // the value is read straight into the buffer and handed over on its own
+    if (length > out.size)
+    {
+      err = ESP_ERR_NVS_INVALID_LENGTH;
+      break;
+    }
+    if ((err = out.flush()) != ESP_OK)
+      break;
+    if (type == NVS_TYPE_STR)
+      err = _backend->getStr(_nvs_handle, key, (char *)out.buffer, &length);
+    else
+      err = _backend->getBlob(_nvs_handle, key, out.buffer, &length);
+    NVS_STAT(_stats.get(type, err));
+    if (err != ESP_OK)
+      break;
+    out.used = length;
+    if ((err = out.flush()) != ESP_OK)
+      break;
+  }
+
+  if (err == ESP_OK)
+    err = out.reserve(1 + 4);
+  if (err == ESP_OK)
+  {
+    out.buffer[out.used++] = NVS_TYPE_ANY;
+    uint32_t crc = nvs_crc32(out.crc, out.buffer, out.used);
+    put_le(out.buffer + out.used, crc, 4);
+    err = out.write(out.buffer, out.used + 4, out.arg);
+  }
+  return result(err);
+}
+
+// Walks the records of an image and checks its CRC; record(value) is called for each record as it
+// is read, so with a damaged image it has already seen the records before the damage
+template <typename F>
+static esp_err_t parse_snapshot(SnapshotReader &in, F record)
+{
+  esp_err_t err = in.fill(NVS_SNAPSHOT_HEADER_SIZE);
+  if (err != ESP_OK)
+    return err;
+  const uint8_t *header = in.take(NVS_SNAPSHOT_HEADER_SIZE);
+  if (memcmp(header, NVS_SNAPSHOT_MAGIC, 4) != 0)
+    return ESP_ERR_INVALID_ARG;
+  if (get_le(header + 4, 2) != NVS_SNAPSHOT_VERSION)
+    return ESP_ERR_INVALID_VERSION;
+
+  while (true)
+  {
+    if ((err = in.fill(1)) != ESP_OK)
+      return err;
+    nvs_type_t type = (nvs_type_t)*in.take(1);
+    if (type == NVS_TYPE_ANY)
+      break;
+    if (!is_scalar(type) && type != NVS_TYPE_STR && type != NVS_TYPE_BLOB)
+      return ESP_ERR_NVS_TYPE_MISMATCH;
+
+    if ((err = in.fill(1)) != ESP_OK)
+      return err;
+    size_t key_length = *in.take(1);
+    if (key_length == 0 || key_length > NVS_KEY_NAME_MAX_SIZE - 1)
+      return ESP_ERR_INVALID_SIZE;
+    if ((err = in.fill(key_length)) != ESP_OK)
+      return err;
+    char key[NVS_KEY_NAME_MAX_SIZE];
+    memcpy(key, in.take(key_length), key_length);
+    key[key_length] = '\0';
+
+    size_t length = nvs_scalar_size(type);
+    if (!is_scalar(type))
+    {
+      if ((err = in.fill(4)) != ESP_OK)
+        return err;
+      length = get_le(in.take(4), 4);
+    }
+    if ((err = in.fill(length)) != ESP_OK)
+      return err;
+    const uint8_t *data = in.take(length);
+    if (type == NVS_TYPE_STR && (length == 0 || data[length - 1] != '\0'))
+      return ESP_ERR_INVALID_SIZE;
+
+    NvsValue value = {NvsKey::dynamic(key), type, 0, data, length};
+    if (is_scalar(type))
+      value = NvsValue{value.key, type, get_scalar_le(data, type), NULL, 0};
+    if ((err = record(value)) != ESP_OK)
+      return err;
+  }
+
+  uint32_t crc = in.crc;
+  if ((err = in.fill(4)) != ESP_OK)
+    return err;
+  if (get_le(in.buffer + in.start, 4) != crc)
+    return ESP_ERR_INVALID_CRC;
+  return ESP_OK;
+}
+
+esp_err_t Nvs::import_snapshot(NvsSnapshotRead read, void *arg, std::span<uint8_t> buffer, uint32_t crc,
+                                NvsSyncResult *summary)
+{
+  // records that match the stored entry are not written again; everything is committed once
+  NvsSyncResult counts = {};
+  beginBatch();
+  SnapshotReader in = {read, arg, buffer.data(), buffer.size(), 0, 0, 0};
+  esp_err_t err = parse_snapshot(in, [&](const NvsValue &value)
+                                 { return sync_value(value, &counts); });
+  // the source changed since it was checked
+  if (err == ESP_OK && in.crc != crc)
+    err = ESP_ERR_INVALID_CRC;
+  if (summary != NULL)
+    *summary = counts;
+
+  // a write that failed leaves the others uncommitted, the next commit() takes them along
+  if (err != ESP_OK)
+  {
+    close_batch();
+    return result(err);
+  }
+  return result(commitBatch());
+}
+
+esp_err_t Nvs::importSnapshot(NvsSnapshotRead read, NvsSnapshotRewind rewind, void *arg, std::span<uint8_t> buffer,
+                              NvsSyncResult *summary)
+{
+  if (buffer.size() < NVS_SNAPSHOT_MIN_BUFFER)
+    return ESP_ERR_INVALID_ARG;
+  if (summary != NULL)
+    *summary = {};
+  if (rewind == NULL)
+    return result(ESP_ERR_NOT_SUPPORTED);
+
+  // nothing is written before the whole image has been read and its CRC checked, the records are
+  // then applied in a second pass over the source
+  SnapshotReader in = {read, arg, buffer.data(), buffer.size(), 0, 0, 0};
+  esp_err_t err = parse_snapshot(in, [](const NvsValue &)
+                                 { return ESP_OK; });
+  if (err == ESP_OK)
+    err = rewind(arg);
+  if (err != ESP_OK)
+    return result(err);
+
+  wait_async();
+  NvsGuard guard(_lock, _concurrent, NvsGuard::EXCLUSIVE);
+  return import_snapshot(read, arg, buffer, in.crc, summary);
+}
+
+struct SnapshotFile
+{
+  int fd;
+  off_t start;
+};
+
+static esp_err_t write_fd(const void *data, size_t length, void *arg)
+{
+  int fd = *(int *)arg;
+  const uint8_t *bytes = (const uint8_t *)data;
+  while (length > 0)
+  {
+    ssize_t written = write(fd, bytes, length);
+    if (written < 0)
+    {
+      if (errno == EINTR)
+        continue;
+      return ESP_FAIL;
+    }
+    bytes += written;
+    length -= written;
+  }
+  return ESP_OK;
+}
+
+static esp_err_t read_fd(void *data, size_t *length, void *arg)
+{
+  int fd = ((SnapshotFile *)arg)->fd;
+  while (true)
+  {
+    ssize_t count = read(fd, data, *length);
+    if (count >= 0)
+    {
+      *length = count;
+      return ESP_OK;
+    }
+    if (errno != EINTR)
+      return ESP_FAIL;
+  }
+}
+
+esp_err_t Nvs::exportSnapshot(int fd, std::span<uint8_t> buffer)
+{
+  return exportSnapshot(write_fd, &fd, buffer);
+}
+
+static esp_err_t rewind_fd(void *arg)
+{
+  SnapshotFile *file = (SnapshotFile *)arg;
+  return lseek(file->fd, file->start, SEEK_SET) == file->start ? ESP_OK : ESP_FAIL;
+}
+
+esp_err_t Nvs::importSnapshot(int fd, std::span<uint8_t> buffer, NvsSyncResult *summary)
+{
+  // read twice: a pipe or a socket can't go back to the start of the image
+  SnapshotFile file = {fd, lseek(fd, 0, SEEK_CUR)};
+  return importSnapshot(read_fd, file.start >= 0 ? rewind_fd : NULL, &file, buffer, summary);
+}
@@ -0,0 +1,43 @@
+#include "include/NvsStats.h"
+
+template <typename T, size_t N>
+static void load_all(T (&out)[N], const std::atomic<T> (&in)[N])
+{
+  for (size_t i = 0; i < N; i++)
+    out[i] = in[i].load(std::memory_order_relaxed);
+}
+
+template <typename T, size_t N>
+static void clear_all(std::atomic<T> (&counters)[N])
+{
+  for (std::atomic<T> &counter : counters)
+    counter.store(0, std::memory_order_relaxed);
+}
+
+NvsStatsSnapshot NvsStats::snapshot() const
+{
+  NvsStatsSnapshot snapshot;
+  load_all(snapshot.sets, _sets);
+  load_all(snapshot.gets, _gets);
+  load_all(snapshot.failures, _failures);
+  snapshot.cache_hits = _cache_hits.load(std::memory_order_relaxed);
+  snapshot.commits = _commits.load(std::memory_order_relaxed);
+  snapshot.erases = _erases.load(std::memory_order_relaxed);
+  snapshot.bytes_written = _bytes_written.load(std::memory_order_relaxed);
+  load_all(snapshot.commit_latency, _commit_latency);
+  load_all(snapshot.get_latency, _get_latency);
+  return snapshot;
+}
+
+void NvsStats::reset()
+{
+  clear_all(_sets);
+  clear_all(_gets);
+  clear_all(_failures);
+  _cache_hits.store(0, std::memory_order_relaxed);
+  _commits.store(0, std::memory_order_relaxed);
+  _erases.store(0, std::memory_order_relaxed);
+  _bytes_written.store(0, std::memory_order_relaxed);
+  clear_all(_commit_latency);
+  clear_all(_get_latency);
+}
@@ -0,0 +1,169 @@
+#include "include/NVS.h"
+#include "string.h"
+
+// keys erased per walk over the namespace by sync(), on the stack
+#ifndef NVS_SYNC_ERASE_CHUNK
+#define NVS_SYNC_ERASE_CHUNK 16
+#endif
+
+static const NvsValue *find_value(std::span<const NvsValue> values, const char *key)
+{
+  uint32_t hash = NvsKey::hash(key);
+  for (const NvsValue &value : values)
+  {
+    if (value.key.hash() == hash && strcmp(value.key.c_str(), key) == 0)
+      return &value;
+  }
+  return NULL;
+}
+
+bool Nvs::same_value(const NvsValue &value)
+{
+  const char *key = value.key.c_str();
+
+  if (value.type != NVS_TYPE_STR && value.type != NVS_TYPE_BLOB)
+  {
+    uint64_t bits;
+    return get_scalar(key, value.type, &bits) == ESP_OK && bits == value.bits;
+  }
+
+  // a digest left in the cache by an earlier write settles it without touching flash
+  uint64_t digest;
+  if (_cache != NULL && _cache->peek(value.key, value.type, &digest))
+    return digest == NvsCache::digest(value.data, value.length);
+
+  // the length comes from the entry index, the bytes are only read when it matches and they fit on
+  // the stack; a longer value without a digest is simply written, like unchanged_data() does
+  size_t length;
+  esp_err_t err = value.type == NVS_TYPE_STR ? _backend->getStr(_nvs_handle, key, NULL, &length)
+                                             : _backend->getBlob(_nvs_handle, key, NULL, &length);
+  if (err != ESP_OK || length != value.length || length > NVS_ELIDE_COMPARE_SIZE)
+    return false;
+
+  uint8_t stored[NVS_ELIDE_COMPARE_SIZE];
+  err = value.type == NVS_TYPE_STR ? _backend->getStr(_nvs_handle, key, (char *)stored, &length)
+                                   : _backend->getBlob(_nvs_handle, key, stored, &length);
+  return err == ESP_OK && length == value.length && memcmp(stored, value.data, length) == 0;
+}
+
+esp_err_t Nvs::sync_value(const NvsValue &value, NvsSyncResult *counts)
+{
+  const char *key = value.key.c_str();
+
+  uint64_t bits;
+  if (value.type != NVS_TYPE_STR && value.type != NVS_TYPE_BLOB &&
+      cache_find(value.key, value.type, &bits) && bits == value.bits)
+  {
+    counts->unchanged++;
+    return ESP_OK;
+  }
+
+  nvs_type_t stored_type;
+  esp_err_t err = _backend->findKey(_nvs_handle, key, &stored_type);
+  if (err != ESP_OK && err != ESP_ERR_NVS_NOT_FOUND)
+    return err;
+
+  if (err == ESP_OK)
+  {
+    if (stored_type == nvs_entry_type(value.type) && same_value(value))
+    {
+      counts->unchanged++;
+      return ESP_OK;
+    }
+    // an entry of another type would stay next to the new one
+    if (stored_type != nvs_entry_type(value.type) && (err = _backend->eraseKey(_nvs_handle, key)) != ESP_OK)
+      return err;
+  }
+
+  if (value.type == NVS_TYPE_STR || value.type == NVS_TYPE_BLOB)
+  {
+    err = value.type == NVS_TYPE_STR ? _backend->setStr(_nvs_handle, key, (const char *)value.data)
+                                     : _backend->setBlob(_nvs_handle, key, value.data, value.length);
+    NVS_STAT(_stats.set(value.type, value.length, err));
+    if (err == ESP_OK)
+      cache_store(value.key, value.type, NvsCache::digest(value.data, value.length));
+    else
+      cache_remove(value.key);
+  }
+  else
+  {
+    err = set_scalar(key, value.type, value.bits);
+    if (err == ESP_OK)
+      cache_store(value.key, value.type, value.bits);
+  }
+  if (err != ESP_OK)
+    return err;
+
+  counts->written++;
+  return commit_if_needed();
+}
+
+esp_err_t Nvs::sync(std::span<const NvsValue> values, bool erase_missing, NvsSyncResult *summary)
+{
+  for (const NvsValue &value : values)
+  {
+    if (!value.key.valid())
+      return result(ESP_ERR_INVALID_ARG);
+  }
+
+  wait_async();
+  NvsGuard guard(_lock, _concurrent, NvsGuard::EXCLUSIVE);
+  NvsSyncResult counts = {};
+  esp_err_t first_error = ESP_OK;
+
+  NvsBatch batch(*this);
+
+  for (const NvsValue &value : values)
+  {
+    esp_err_t err = sync_value(value, &counts);
+    if (err != ESP_OK && first_error == ESP_OK)
+      first_error = err;
+  }
+
+  // a value waiting in the write-back cache is only known to flash once written; left there, a key
+  // missing from values would come back with the next flush
+  if (erase_missing && first_error == ESP_OK)
+    first_error = flush();
+
+  // NVS can't erase under an open iterator: collect up to NVS_SYNC_ERASE_CHUNK keys in one walk,
+  // erase them and only walk again if there may be more
+  while (erase_missing && first_error == ESP_OK)
+  {
+    char keys[NVS_SYNC_ERASE_CHUNK][NVS_KEY_NAME_MAX_SIZE];
+    size_t count = 0;
+    bool more = false;
+    for (const NvsEntry &entry : entries())
+    {
+      if (find_value(values, entry.key()) != NULL)
+        continue;
+      if (count == NVS_SYNC_ERASE_CHUNK)
+      {
+        more = true;
+        break;
+      }
+      strcpy(keys[count++], entry.key());
+    }
+
+    for (size_t i = 0; i < count && first_error == ESP_OK; i++)
+    {
+      cache_remove(NvsKey::dynamic(keys[i]));
+      esp_err_t err = _backend->eraseKey(_nvs_handle, keys[i]);
+      NVS_STAT(_stats.erase());
+      if (err != ESP_OK)
+        first_error = err;
+      else
+      {
+        counts.erased++;
+        commit_if_needed();
+      }
+    }
+    if (!more)
+      break;
+  }
+
+  if (summary != NULL)
+    *summary = counts;
+
+  esp_err_t err = batch.commit();
+  return result(first_error != ESP_OK ? first_error : err);
+}
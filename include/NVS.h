@@ -1,6 +1,46 @@
 #pragma once
 
 #include "nvs_flash.h"
+#include "NvsAllocator.h"
+#include "NvsAsync.h"
+#include "NvsBackend.h"
+#include "NvsCache.h"
+#include "NvsCodec.h"
+#include "NvsEntries.h"
+#include "NvsImage.h"
+#include "NvsImageBuilder.h"
+#include "NvsKey.h"
+#include "NvsLock.h"
+#include "NvsObject.h"
+#include "NvsRamBackend.h"
+#include "NvsRingLog.h"
+#include "NvsSchema.h"
+#include "NvsSnapshot.h"
+#include "NvsStats.h"
+#include "NvsTraits.h"
+#include "NvsValue.h"
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <span>
+#include <string.h>
+
+// namespaces one instance can open through child()
+#ifndef NVS_MAX_CHILDREN
+#define NVS_MAX_CHILDREN 16
+#endif
+
+// strings / blobs up to this size are compared on the stack when the cache has no digest of them
+#ifndef NVS_ELIDE_COMPARE_SIZE
+#define NVS_ELIDE_COMPARE_SIZE 64
+#endif
+
+// room for the packed form of a value while compression is on, values that don't pack into it are
+// written as they are
+#ifndef NVS_CODEC_SCRATCH_SIZE
+#define NVS_CODEC_SCRATCH_SIZE 4096
+#endif
 
 class Nvs
 {
@@ -8,6 +48,15 @@ public:
   Nvs();
   Nvs(const char *partition_label);
   Nvs(const char *partition_label, const char *namespace_name, nvs_open_mode_t open_mode = NVS_READWRITE);
+
+  /**
+   * @brief Open a namespace on another storage engine, e.g. NvsRamBackend or NvsFileBackend
+   *
+   * @param[in] backend The engine, must outlive this instance. May be shared.
+   * @param[in] namespace_name Namespace name. Maximal length is (NVS_KEY_NAME_MAX_SIZE-1) characters.
+   * @param[in] open_mode NVS_READWRITE or NVS_READONLY
+   */
+  Nvs(NvsBackend &backend, const char *namespace_name, nvs_open_mode_t open_mode = NVS_READWRITE);
   ~Nvs();
 
   /**
@@ -220,6 +269,8 @@ public:
   /**
    * @brief set double value for given key
    *
+   * Stored as the bits of a NVS_TYPE_U64 entry, which getUInt64() reads as an integer.
+   *
    * @param[in] key Key name. Maximum length is (NVS_KEY_NAME_MAX_SIZE-1) characters. Shouldn't be empty.
    * @param[in] value The value to set.
    * @return
@@ -241,6 +292,8 @@ public:
   /**
    * @brief set float value for given key
    *
+   * Stored as the bits of a NVS_TYPE_U32 entry, which getUInt32() reads as an integer.
+   *
    * @param[in] key Key name. Maximum length is (NVS_KEY_NAME_MAX_SIZE-1) characters. Shouldn't be empty.
    * @param[in] value The value to set.
    * @return
@@ -263,7 +316,7 @@ public:
    * @brief set string value for given key
    *
    * @param[in] key Key name. Maximum length is (NVS_KEY_NAME_MAX_SIZE-1) characters. Shouldn't be empty.
-   * @param[in] value The value to set.
+   * @param[in] value The value to set; nullptr erases the key and returns the result of erase().
    * @return
    *             - ESP_OK if value was set successfully
    *             - ESP_FAIL if there is an internal error; most likely due to corrupted
@@ -299,7 +352,7 @@ public:
    *               update will be finished after re-initialization of nvs, provided that
    *               flash operation doesn't fail again.
    */
-  esp_err_t setObject(const char *key, void *object, size_t length);
+  esp_err_t setObject(const char *key, const void *object, size_t length);
 
   /**
    * @brief Read bool value from NVS
@@ -385,6 +438,10 @@ public:
   /**
    * @brief Read double value from NVS
    *
+   * Values written as a blob by older versions of this class are still read, see migrateDouble().
+   * The value is stored as the bits of a NVS_TYPE_U64 entry: an integer of that width stored
+   * under the key is read as its bit pattern, not converted.
+   *
    * @param[in] key
    * @param[in] default_value
    * @return returns the read value, or default_value if the value could not be read.
@@ -394,12 +451,40 @@ public:
   /**
    * @brief Read float value from NVS
    *
+   * Values written as a blob by older versions of this class are still read, see migrateFloat().
+   * The value is stored as the bits of a NVS_TYPE_U32 entry: an integer of that width stored
+   * under the key is read as its bit pattern, not converted.
+   *
    * @param[in] key Key name. Maximum length is (NVS_KEY_NAME_MAX_SIZE-1) characters. Shouldn't be empty.
    * @param[in] default_value
    * @return returns the read value, or default_value if the value could not be read.
    */
   float getFloat(const char *key, float default_value);
 
+  /**
+   * @brief Rewrite a float stored as a blob by older versions of this class as a native 32 bit entry
+   *
+   * @param[in] key Key name. Maximum length is (NVS_KEY_NAME_MAX_SIZE-1) characters. Shouldn't be empty.
+   * @return
+   *             - ESP_OK if the value was migrated
+   *             - ESP_ERR_NVS_NOT_FOUND if there is no legacy value for the key
+   *             - ESP_ERR_NVS_TYPE_MISMATCH if the blob doesn't have the size of a float
+   *             - error codes of setFloat()
+   */
+  esp_err_t migrateFloat(const char *key);
+
+  /**
+   * @brief Rewrite a double stored as a blob by older versions of this class as a native 64 bit entry
+   *
+   * @param[in] key Key name. Maximum length is (NVS_KEY_NAME_MAX_SIZE-1) characters. Shouldn't be empty.
+   * @return
+   *             - ESP_OK if the value was migrated
+   *             - ESP_ERR_NVS_NOT_FOUND if there is no legacy value for the key
+   *             - ESP_ERR_NVS_TYPE_MISMATCH if the blob doesn't have the size of a double
+   *             - error codes of setDouble()
+   */
+  esp_err_t migrateDouble(const char *key);
+
   /**
    * @brief Read char array from NVS
    *
@@ -418,6 +503,226 @@ public:
    */
   void *getObject(const char *key, void *defaultValue);
 
+  /**
+   * @brief Read a string into memory of an allocator, freed when the result goes out of scope
+   *
+   * @code
+   * NvsString name = config->getString("name", "device");
+   * printf("%s\n", name.get());
+   * @endcode
+   *
+   * @param[in] key Key name. Maximum length is (NVS_KEY_NAME_MAX_SIZE-1) characters. Shouldn't be empty.
+   * @param[in] default_value Copied when the value could not be read, can be NULL
+   * @param[in] allocator NULL for the allocator of this instance, see setAllocator()
+   * @return the string, or the copy of default_value, or NULL (also when the allocator is out of memory)
+   */
+  NvsString getString(const char *key, const char *default_value = NULL, NvsAllocator *allocator = NULL);
+
+  /**
+   * @brief Read a blob into memory of an allocator, freed when the result goes out of scope
+   *
+   * @param[in] key Key name. Maximum length is (NVS_KEY_NAME_MAX_SIZE-1) characters. Shouldn't be empty.
+   * @param[out] length Size of the blob, can be NULL
+   * @param[in] allocator NULL for the allocator of this instance, see setAllocator()
+   * @return the blob, NULL if it could not be read
+   */
+  NvsBlob getBlob(const char *key, size_t *length = NULL, NvsAllocator *allocator = NULL);
+
+  /**
+   * @brief Allocator of getString() / getBlob() (NvsAllocator::heap() by default)
+   *
+   * getCharArray() / getObject() keep using malloc(), their results are released with free().
+   * The allocator has to outlive the instance and every value taken from it.
+   */
+  void setAllocator(NvsAllocator &allocator);
+
+  /**
+   * @brief Read char array from NVS into a caller supplied buffer, without allocating
+   *
+   * @param[in] key Key name. Maximum length is (NVS_KEY_NAME_MAX_SIZE-1) characters. Shouldn't be empty.
+   * @param[out] buffer Destination, may be NULL to only query the size.
+   * @param[inout] length In: size of buffer. Out: size of the stored string including the zero terminator,
+   *                      also when the buffer is too small. See setCompression() for compressed values.
+   * @return
+   *             - ESP_OK if the value was read (or the size was queried)
+   *             - ESP_ERR_NVS_NOT_FOUND if the key doesn't exist or isn't a string
+   *             - ESP_ERR_NVS_INVALID_LENGTH if the buffer is too small, length holds the required size
+   *             - ESP_ERR_INVALID_ARG if the key is too long
+   */
+  esp_err_t getCharArray(const char *key, char *buffer, size_t *length);
+
+  /**
+   * @brief Read char array from NVS into a caller supplied buffer, without allocating
+   *
+   * @param[in] key Key name. Maximum length is (NVS_KEY_NAME_MAX_SIZE-1) characters. Shouldn't be empty.
+   * @param[out] buffer Destination
+   * @param[out] length Size of the stored string including the zero terminator (required size on truncation), may be NULL
+   * @return same as getCharArray(const char *, char *, size_t *)
+   */
+  esp_err_t getCharArray(const char *key, std::span<char> buffer, size_t *length = NULL);
+
+  /**
+   * @brief Read char array from NVS into a fixed size array, without allocating
+   *
+   * @code
+   * char name[32];
+   * if (config->getCharArray("name", name) != ESP_OK)
+   *   strcpy(name, "device");
+   * @endcode
+   *
+   * @return same as getCharArray(const char *, char *, size_t *)
+   */
+  template <size_t N>
+  esp_err_t getCharArray(const char *key, char (&buffer)[N])
+  {
+    size_t length = N;
+    return getCharArray(key, buffer, &length);
+  }
+
+  /**
+   * @brief Read object from NVS into a caller supplied buffer, without allocating
+   *
+   * @param[in] key Key name. Maximum length is (NVS_KEY_NAME_MAX_SIZE-1) characters. Shouldn't be empty.
+   * @param[out] buffer Destination, may be NULL to only query the size.
+   * @param[inout] length In: size of buffer. Out: size of the stored object, also when the buffer is too small.
+   *                      See setCompression() for compressed values.
+   * @return
+   *             - ESP_OK if the value was read (or the size was queried)
+   *             - ESP_ERR_NVS_NOT_FOUND if the key doesn't exist or isn't an object
+   *             - ESP_ERR_NVS_INVALID_LENGTH if the buffer is too small, length holds the required size
+   *             - ESP_ERR_INVALID_ARG if the key is too long
+   */
+  esp_err_t getObject(const char *key, void *buffer, size_t *length);
+
+  /**
+   * @brief Read object from NVS into a caller supplied buffer, without allocating
+   *
+   * @param[in] key Key name. Maximum length is (NVS_KEY_NAME_MAX_SIZE-1) characters. Shouldn't be empty.
+   * @param[out] buffer Destination
+   * @param[out] length Size of the stored object (required size on truncation), may be NULL
+   * @return same as getObject(const char *, void *, size_t *)
+   */
+  esp_err_t getObject(const char *key, std::span<uint8_t> buffer, size_t *length = NULL);
+
+  /**
+   * @brief Read a value of any supported type from NVS
+   *
+   * The NVS type and the nvs_get_* function are picked at compile time, see NvsTraits.
+   * Integers, bool, enums, float and double are stored natively, other trivially copyable
+   * types (structs) as a blob of sizeof(T) bytes.
+   *
+   * A string literal key (any const char array) is turned into an NvsKey and checked at compile time,
+   * other strings are checked at run time.
+   *
+   * @code
+   * uint16_t buffsize = config->get<uint16_t>("buffsize", 4096); // key checked at compile time
+   * Mode mode = config->get(name, Mode::Idle);                  // const char *name, checked at run time
+   * @endcode
+   *
+   * @param[in] key Key name, see NvsKey. Maximum length is (NVS_KEY_NAME_MAX_SIZE-1) characters. Shouldn't be empty.
+   * @param[in] default_value
+   * @return returns the read value, or default_value if the value could not be read.
+   */
+  template <typename T>
+  T get(const NvsKey &key, T default_value);
+
+  template <typename T, NvsRuntimeKey K>
+  T get(K &&key, T default_value) { return get(NvsKey::dynamic(key), default_value); }
+
+  /**
+   * @brief Read a value of any supported type from NVS, see get()
+   *
+   * @param[in] key Key name, see NvsKey. Maximum length is (NVS_KEY_NAME_MAX_SIZE-1) characters. Shouldn't be empty.
+   * @param[out] value Left untouched if the value could not be read
+   * @return
+   *             - ESP_OK if the value was read
+   *             - ESP_ERR_NVS_NOT_FOUND if the key doesn't exist or has another type
+   *             - ESP_ERR_NVS_INVALID_LENGTH if a blob doesn't have the size of T
+   *             - ESP_ERR_INVALID_ARG if the key is empty or too long
+   */
+  template <typename T>
+  esp_err_t read(const NvsKey &key, T *value);
+
+  template <typename T, NvsRuntimeKey K>
+  esp_err_t read(K &&key, T *value) { return read(NvsKey::dynamic(key), value); }
+
+  /**
+   * @brief Set a value of any supported type, see get()
+   *
+   * @param[in] key Key name, see NvsKey. Maximum length is (NVS_KEY_NAME_MAX_SIZE-1) characters. Shouldn't be empty.
+   * @param[in] value The value to set.
+   * @return same as the typed setters
+   */
+  template <typename T>
+  esp_err_t set(const NvsKey &key, const T &value);
+
+  template <typename T, NvsRuntimeKey K>
+  esp_err_t set(K &&key, const T &value) { return set(NvsKey::dynamic(key), value); }
+
+  /**
+   * @brief Set an integer, boolean or floating point value and get the result from a callback
+   *
+   * In async mode the call only queues the value and done runs on the persistence worker once the
+   * value is committed (or failed), with the instance locked: it should be short, as readers wait for
+   * it, and must not call flush(). Otherwise the value is written at once and done runs before the
+   * call returns.
+   *
+   * @param[in] key Key name, see NvsKey
+   * @param[in] value The value to set
+   * @param[in] done Result callback, can be NULL
+   * @param[in] arg Passed to done
+   * @return
+   *             - ESP_OK if the value was queued (async mode)
+   *             - ESP_ERR_NO_MEM if the queue is full (async mode)
+   *             - same as the typed setters otherwise
+   */
+  template <typename T>
+  esp_err_t set(const NvsKey &key, const T &value, NvsWriteCallback done, void *arg = NULL);
+
+  template <typename T, NvsRuntimeKey K>
+  esp_err_t set(K &&key, const T &value, NvsWriteCallback done, void *arg = NULL)
+  {
+    return set(NvsKey::dynamic(key), value, done, arg);
+  }
+
+  /**
+   * @brief Set string value for given key, same as setCharArray()
+   */
+  esp_err_t set(const char *key, const char *value) { return setCharArray(key, value); }
+
+  /**
+   * @brief Fill a struct described by a schema in one pass over the namespace
+   *
+   * Every member is first set to its default, then the entries of the namespace are walked once
+   * with nvs_entry_find / nvs_entry_next and each entry that matches a field by key and type is read
+   * into its member. Scalar values also warm up the cache when it is enabled. Values waiting in the
+   * write-back cache are flushed first.
+   *
+   * @code
+   * Config config;
+   * nvs->load(config_schema, &config);
+   * @endcode
+   *
+   * @param[in] schema Fields of the struct, see NvsField
+   * @param[out] object The struct
+   * @return ESP_OK, missing keys and entries of another type are not an error; the error of flush()
+   */
+  esp_err_t load(std::span<const NvsField> schema, void *object);
+
+  /**
+   * @brief Write a struct described by a schema with a single commit
+   *
+   * @param[in] schema Fields of the struct, see NvsField
+   * @param[in] object The struct
+   * @param[in] previous The struct as it was loaded; only members that differ from it are written.
+   *                     NULL writes every member.
+   * @return
+   *             - ESP_OK if all fields were written
+   *             - ESP_ERR_INVALID_SIZE if a char array member isn't zero terminated
+   *             - the first error of the setters or of commit()
+   */
+  esp_err_t store(std::span<const NvsField> schema, const void *object, const void *previous = NULL);
+
   /**
    * @brief Check if key exists in NVS
    *
@@ -427,6 +732,123 @@ public:
    */
   bool exists(const char *key);
 
+  /**
+   * @brief Entries of the namespace, see NvsEntries
+   *
+   * @param[in] type Only entries of this type, NVS_TYPE_ANY for all
+   */
+  NvsEntries entries(nvs_type_t type = NVS_TYPE_ANY);
+
+  /**
+   * @brief Entries of every namespace of the partition (or backend), see NvsEntries
+   *
+   * @param[in] type Only entries of this type, NVS_TYPE_ANY for all
+   */
+  NvsEntries partitionEntries(nvs_type_t type = NVS_TYPE_ANY);
+
+  /**
+   * @brief Stream every entry of the namespace into a snapshot image, see NvsSnapshot.h for the format
+   *
+   * Records are staged in buffer and handed to write whenever it is full. A string or blob value is read
+   * into the buffer as a whole, so the buffer has to hold the largest one.
+   *
+   * @param[in] write Receives consecutive pieces of the image
+   * @param[in] arg Passed to write
+   * @param[in] buffer Staging buffer, at least NVS_SNAPSHOT_MIN_BUFFER bytes
+   * @return
+   *             - ESP_OK if the whole image was written
+   *             - ESP_ERR_INVALID_ARG if buffer is too small
+   *             - ESP_ERR_NVS_INVALID_LENGTH if a string / blob doesn't fit in buffer
+   *             - errors of write and of the NVS reads
+   */
+  esp_err_t exportSnapshot(NvsSnapshotWrite write, void *arg, std::span<uint8_t> buffer);
+
+  /**
+   * @brief exportSnapshot() to a file descriptor
+   */
+  esp_err_t exportSnapshot(int fd, std::span<uint8_t> buffer);
+
+  /**
+   * @brief Write every record of a snapshot image into the namespace, with a single commit
+   *
+   * Records equal to the stored entry are skipped like in sync(); entries that are not in the image
+   * are left alone. The image is read through buffer, which has to hold the largest string / blob
+   * value of the image; nothing else is allocated. The source is read twice: the whole image is
+   * checked first, so a damaged image changes nothing, then rewound and applied. A second pass that
+   * doesn't match the first one (the source changed in between) or a failed setter leaves the records
+   * already written uncommitted.
+   *
+   * @param[in] read Provides consecutive pieces of the image
+   * @param[in] rewind Goes back to the start of the image, NULL if the source can't
+   * @param[in] arg Passed to read and rewind
+   * @param[in] buffer Read buffer, at least NVS_SNAPSHOT_MIN_BUFFER bytes
+   * @param[out] summary Number of records written / unchanged, can be NULL
+   * @return
+   *             - ESP_OK if the whole image was applied and committed
+   *             - ESP_ERR_INVALID_ARG if buffer is too small or the data is not a snapshot image
+   *             - ESP_ERR_NOT_SUPPORTED if rewind is NULL
+   *             - ESP_ERR_INVALID_VERSION if the image has an unknown version
+   *             - ESP_ERR_INVALID_SIZE if the image is truncated or a record is malformed
+   *             - ESP_ERR_INVALID_CRC if the image is corrupted or changed between the two passes
+   *             - ESP_ERR_NVS_INVALID_LENGTH if a string / blob doesn't fit in buffer
+   *             - errors of read, rewind and of the setters
+   */
+  esp_err_t importSnapshot(NvsSnapshotRead read, NvsSnapshotRewind rewind, void *arg, std::span<uint8_t> buffer,
+                           NvsSyncResult *summary = NULL);
+
+  /**
+   * @brief importSnapshot() from a file descriptor, read from its current offset
+   *
+   * @return ESP_ERR_NOT_SUPPORTED for a pipe or a socket, which can't be read twice
+   */
+  esp_err_t importSnapshot(int fd, std::span<uint8_t> buffer, NvsSyncResult *summary = NULL);
+
+  /**
+   * @brief Bring the namespace to a desired state, writing only what differs
+   *
+   * An integer value is compared with the cache or a single read; a string / blob is compared with the
+   * digest in the cache, else by length (from the entry index) and, up to NVS_ELIDE_COMPARE_SIZE bytes,
+   * on the stack; a longer one without a digest is written. An entry of another type is replaced.
+   * Everything is committed once.
+   *
+   * @code
+   * NvsSyncResult summary;
+   * config->sync(desired, true, &summary);
+   * @endcode
+   *
+   * @param[in] values Desired entries, see NvsValue
+   * @param[in] erase_missing Also erase the entries of the namespace that are not in values
+   * @param[out] summary Number of entries written / unchanged / erased, can be NULL
+   * @return
+   *             - ESP_OK if the namespace matches values
+   *             - ESP_ERR_INVALID_ARG if a key is invalid (nothing is written)
+   *             - the first error of the writes / erases, the others are still attempted
+   */
+  esp_err_t sync(std::span<const NvsValue> values, bool erase_missing = false, NvsSyncResult *summary = NULL);
+
+  /**
+   * @brief Erase an object written by NvsObjectWriter: its manifest and every chunk
+   *
+   * @param[in] key Key name. Maximum length is (NVS_KEY_NAME_MAX_SIZE-1) characters. Shouldn't be empty.
+   * @return
+   *             - ESP_OK if the object was erased
+   *             - ESP_ERR_NVS_NOT_FOUND if there is no object under the key
+   *             - ESP_ERR_NVS_TYPE_MISMATCH if the key holds something else, use erase()
+   */
+  esp_err_t eraseObject(const char *key);
+
+  /**
+   * @brief Copy of the operation counters and latency histograms
+   *
+   * Only collected when CONFIG_NVS_WRAPPER_STATS is enabled, all zero otherwise.
+   */
+  NvsStatsSnapshot stats();
+
+  /**
+   * @brief Reset the counters returned by stats()
+   */
+  void resetStats();
+
   /**
    * @brief Return last error. A way to find out if an initialization or mounting error occurred
    *
@@ -443,15 +865,279 @@ public:
    *               write operation has failed. The value was written however, and
    *               update will be finished after re-initialization of nvs, provided that
    *               flash operation doesn't fail again.
+   *
+   * In concurrent mode only the constructor sets it, use the value returned by each call instead.
    */
   esp_err_t last_error() { return _err; }
 
+  /**
+   * @brief Write any pending changes to flash
+   *
+   * Called by the setters and erasers themselves unless auto-commit is off or a batch is open.
+   *
+   * @return
+   *             - ESP_OK if the changes have been written successfully
+   *             - ESP_ERR_NVS_INVALID_HANDLE if handle has been closed or is NULL
+   *             - other error codes from the underlying storage driver
+   */
+  esp_err_t commit();
+
+  /**
+   * @brief Another namespace of the same partition, opened on first use and kept by this instance
+   *
+   * The first call opens a handle (the partition is already mounted), later calls are a lookup in a
+   * table of NVS_MAX_CHILDREN entries. The child starts with the auto-commit, concurrent, compression and
+   * allocator settings of this instance and lives until this instance is destroyed.
+   *
+   * @code
+   * Nvs *wifi = config->child("wifi");
+   * NvsBatch batch(*config); // one batch over config and its children
+   * wifi->setCharArray("ssid", ssid);
+   * config->setUInt8("mode", 2);
+   * batch.commit();
+   * @endcode
+   *
+   * @param[in] namespace_name Maximum length is (NVS_KEY_NAME_MAX_SIZE-1) characters. Shouldn't be empty.
+   * @return the child, this instance for its own namespace, NULL if the name is invalid, the table is full
+   *         or the namespace could not be opened (see last_error())
+   */
+  Nvs *child(const char *namespace_name);
+
+  /**
+   * @brief Start a batch. Until the matching commitBatch() the setters and erasers
+   * only stage their values, so a bulk update costs a single commit.
+   *
+   * Batches nest: only the outermost commitBatch() reaches flash. A batch also covers the
+   * namespaces opened by child(), they are committed together.
+   */
+  void beginBatch();
+
+  /**
+   * @brief Close the batch opened by beginBatch() and commit if it was the outermost one
+   *
+   * @return
+   *             - ESP_OK if the batch was closed (and committed, if anything was staged)
+   *             - ESP_ERR_INVALID_STATE if no batch is open
+   *             - error codes of commit()
+   */
+  esp_err_t commitBatch();
+
+  /**
+   * @brief Enable or disable the commit after every setter / eraser call (enabled by default).
+   * With auto-commit off the caller is responsible for calling commit(); pending changes
+   * are also committed by the destructor.
+   *
+   * @param[in] auto_commit
+   */
+  void setAutoCommit(bool auto_commit);
+
+  bool autoCommit() { return _auto_commit; }
+
+  /**
+   * @brief Enable or disable the in-RAM read cache of this namespace (disabled by default).
+   *
+   * Integer and boolean values are kept in a small table after the first read or write,
+   * so a repeated read is a single RAM probe instead of two lookups in NVS.
+   * The cache only sees changes made through this instance.
+   *
+   * @param[in] enabled
+   */
+  void setCache(bool enabled);
+
+  /**
+   * @brief Compress strings and blobs of at least min_length bytes written from now on (disabled by default).
+   *
+   * A value is compressed (LZF) by setCharArray() / setObject() and stored as a blob with a small header
+   * when that makes it smaller, otherwise it is written as before. The getters read both forms, whatever
+   * the setting. A compressed value is expanded in the caller's buffer, which needs NVS_CODEC_MARGIN()
+   * bytes past the value; a size query returns that room (the original length plus the margin), so the
+   * buffer of a query / allocate / read sequence is large enough. sync() and snapshots see the stored blob.
+   * The match table and NVS_CODEC_SCRATCH_SIZE bytes for the packed value are allocated here, once; a
+   * value that doesn't pack into them is written as it is.
+   *
+   * @param[in] min_length Smallest value to compress, 0 disables compression
+   */
+  void setCompression(size_t min_length);
+
+  size_t compression() { return _compress_min; }
+
+  /**
+   * @brief Enable or disable write-back of integer and boolean values (disabled by default).
+   *
+   * While enabled the integer/boolean setters only update the cache, repeated writes to the same key
+   * collapse into one, and the last value of every key is written to flash by flush(). flush() runs
+   * automatically on the first setter call after flush_interval_ms since the oldest unwritten change,
+   * once max_dirty keys are waiting, when write-back is disabled and from the destructor.
+   * Enabling write-back enables the cache.
+   *
+   * @param[in] enabled
+   * @param[in] flush_interval_ms Maximum age of an unwritten change
+   * @param[in] max_dirty Maximum number of unwritten keys
+   */
+  void setWriteBack(bool enabled, uint32_t flush_interval_ms = 1000, uint16_t max_dirty = 16);
+
+  /**
+   * @brief Write the values held back by write-back mode and commit, and wait for the writes
+   * queued in async mode
+   *
+   * @return
+   *             - ESP_OK if there was nothing to write or everything was written
+   *             - error codes of the setters and commit()
+   */
+  esp_err_t flush();
+
+  /**
+   * @brief Enable or disable concurrent mode (disabled by default), for an instance shared by several
+   * tasks / threads. Call it before the instance is shared.
+   *
+   * Readers then share a lock and don't block each other, writers take it alone. Readers that miss
+   * the cache fill it under a small mutex of their own, so a cold read doesn't wait for other readers.
+   * Every call reports its own result: last_error() is no longer updated, and the getters that
+   * return a default value can't tell why, use read() to get the error.
+   *
+   * @param[in] enabled
+   */
+  void setConcurrent(bool enabled);
+
+  bool concurrent() { return _concurrent; }
+
+  /**
+   * @brief Enable or disable async mode (disabled by default)
+   *
+   * While enabled the integer / boolean / floating point setters put the value in the cache and on a
+   * lock-free queue of NVS_ASYNC_QUEUE_SIZE writes, and return without waiting for flash. A worker thread
+   * writes the last value of every queued key and commits once per drained batch; the result of each
+   * write is only available through set(key, value, done, arg). flush() waits for everything queued so far.
+   * String / blob writes and erases wait for the queue first, so writes to a key stay in order.
+   *
+   * Enabling async mode enables the cache and concurrent mode and disables write-back; disabling it
+   * writes whatever is still queued, on the calling thread. It may be disabled while other threads
+   * call the setters, which then write synchronously; enable it before the instance is shared.
+   *
+   * @param[in] enabled
+   */
+  void setAsync(bool enabled);
+
+  bool async() { return _async_on; }
+
+  /**
+   * @brief Number of keys waiting to be written back
+   */
+  uint16_t dirtyCount();
+
+  /**
+   * @brief Number of reads answered from the cache
+   */
+  uint32_t cacheHits();
+
+  /**
+   * @brief Number of reads that went to NVS while the cache was enabled
+   */
+  uint32_t cacheMisses();
+
+  /**
+   * @brief Number of setter calls skipped because the value was already stored
+   *
+   * A setter compares the new value with the cache and skips the write and the commit when nothing
+   * changed; integers are only compared while the cache is enabled (setCache()), a key missing from it is
+   * read once. Strings / blobs are compared by length and CRC-32 once the cache holds their digest (after
+   * a write through this instance); without it only values up to NVS_ELIDE_COMPARE_SIZE bytes are
+   * compared, on the stack, longer ones are always written.
+   */
+  uint32_t elidedWrites() { return _elided.load(std::memory_order_relaxed); }
+
 private:
   esp_err_t _err = ESP_OK;
-  nvs_handle_t _nvs_handle;
+  nvs_handle_t _nvs_handle = 0;
+  nvs_open_mode_t _open_mode = NVS_READWRITE;
+  char _namespace[NVS_KEY_NAME_MAX_SIZE] = {};
   const esp_partition_t *_partition = NULL;
+  NvsFlashBackend _flash;
+  NvsBackend *_backend = &_flash; // every nvs_* call goes through it
+
+  bool _auto_commit = true;
+  bool _commit_pending = false;
+  uint16_t _batch_depth = 0;
+
+  NvsCache *_cache = NULL;
+
+  size_t _compress_min = 0;
+  uint8_t *_codec_buffer = NULL; // match table and packed value, while compression is on
+
+  Nvs *_children[NVS_MAX_CHILDREN] = {};
+  uint32_t _child_hashes[NVS_MAX_CHILDREN] = {};
+  uint8_t _child_count = 0;
+
+  NvsAllocator *_allocator = &NvsAllocator::heap();
+
+  bool _concurrent = false;
+  NvsLock _lock;
+  // the cache of a concurrent instance is also filled by readers holding _lock shared, see read()
+  std::mutex _cache_lock;
+
+  // created by the first setAsync(true) and kept until the destructor: threads in wait_async() may
+  // still use it after setAsync(false)
+  NvsAsync *_async = NULL;
+  std::atomic<bool> _async_on = false;
+
+  std::atomic<uint32_t> _elided = 0;
+
+#if CONFIG_NVS_WRAPPER_STATS
+  NvsStats _stats;
+#endif
+
+  bool _write_back = false;
+  uint16_t _write_back_max_dirty = 16;
+  std::chrono::steady_clock::duration _write_back_interval;
+  std::chrono::steady_clock::time_point _dirty_since;
+
+  esp_err_t result(esp_err_t err);
+  esp_err_t commit_if_needed();
+
+  std::unique_lock<std::mutex> cache_guard();
+  bool cache_find(const NvsKey &key, nvs_type_t type, uint64_t *value);
+  void cache_store(const NvsKey &key, nvs_type_t type, uint64_t value);
+  void cache_fill(const NvsKey &key, nvs_type_t type, uint64_t value);
+  void cache_remove(const NvsKey &key);
+
+  esp_err_t get_scalar(const char *key, nvs_type_t type, uint64_t *value);
+  esp_err_t get_scalar_value(const char *key, nvs_type_t type, uint64_t *value);
+  esp_err_t set_scalar(const char *key, nvs_type_t type, uint64_t value);
+  esp_err_t set_scalar_value(const char *key, nvs_type_t type, uint64_t value);
+  bool store_dirty(const NvsKey &key, nvs_type_t type, uint64_t value);
+  esp_err_t flush_if_due();
+
+  bool unchanged(const NvsKey &key, nvs_type_t type, uint64_t value);
+  bool unchanged_data(const NvsKey &key, nvs_type_t type, const void *data, size_t length);
+  esp_err_t get_data(const char *key, nvs_type_t type, void *buffer, size_t *length);
+  esp_err_t query_packed(const char *key, nvs_type_t type, size_t *length);
+  esp_err_t set_data(const char *key, nvs_type_t type, const void *data, size_t length);
+  void alloc_codec_buffer();
+  void *get_data_copy(const char *key, nvs_type_t type, NvsAllocator &allocator, size_t *size, size_t *length);
 
-  esp_err_t check_key_and_type(const char *key, nvs_type_t type);
+  friend class NvsAsync;
+  friend class NvsObjectWriter;
+  friend class NvsObjectReader;
+  esp_err_t submit(const NvsKey &key, nvs_type_t type, uint64_t value, NvsWriteCallback done, void *arg);
+  esp_err_t write_scalar(const NvsKey &key, nvs_type_t type, uint64_t value);
+  void write_batch(NvsWrite *writes, size_t count);
+  void wait_async();
+
+  template <typename T>
+  esp_err_t migrate_floating(const char *key);
+
+  bool same_value(const NvsValue &value);
+  esp_err_t sync_value(const NvsValue &value, NvsSyncResult *counts);
+  esp_err_t import_snapshot(NvsSnapshotRead read, void *arg, std::span<uint8_t> buffer, uint32_t crc,
+                            NvsSyncResult *summary);
+
+  esp_err_t load_data(const NvsField &field, nvs_type_t type, uint8_t *member);
+  void load_field(const NvsField &field, nvs_type_t entry_type, uint8_t *member);
+  esp_err_t store_field(const NvsField &field, const uint8_t *member);
+
+  Nvs(Nvs &parent, const char *namespace_name);
+  Nvs *find_child(const char *namespace_name, uint32_t hash);
+  void close_batch();
 
   esp_err_t init(const char *partition_label);
   esp_err_t deinit();
@@ -459,3 +1145,155 @@ private:
   esp_err_t open(const char *namespace_name, nvs_open_mode_t open_mode = NVS_READWRITE);
   void close();
 };
+
+template <typename T>
+T Nvs::get(const NvsKey &key, T default_value)
+{
+  T value;
+  if (read(key, &value) != ESP_OK)
+    return default_value;
+  return value;
+}
+
+template <typename T>
+esp_err_t Nvs::read(const NvsKey &key, T *value)
+{
+  using Traits = NvsTraits<T>;
+
+  if (!key.valid())
+    return result(ESP_ERR_INVALID_ARG);
+
+  esp_err_t err;
+  NvsGuard guard(_lock, _concurrent, NvsGuard::SHARED);
+
+  if constexpr (!Traits::scalar)
+  {
+    // written with compression on, the value is packed and expands with a margin past sizeof(T)
+    uint8_t buffer[sizeof(T) + NVS_CODEC_MARGIN(sizeof(T))];
+    size_t length = sizeof(buffer);
+    err = get_data(key.c_str(), NVS_TYPE_BLOB, buffer, &length);
+    if (err == ESP_OK && length != sizeof(T))
+      err = ESP_ERR_NVS_INVALID_LENGTH;
+    if (err == ESP_OK)
+      memcpy((void *)value, buffer, sizeof(T));
+    NVS_STAT(_stats.get(NVS_TYPE_BLOB, err));
+    return result(err);
+  }
+  else
+  {
+    typename Traits::storage_type stored;
+    uint64_t bits;
+    if (cache_find(key, Traits::type, &bits))
+    {
+      stored = (typename Traits::storage_type)bits;
+      NVS_STAT(_stats.get(Traits::type, ESP_OK); _stats.cacheHit());
+    }
+    else
+    {
+      NVS_STAT(NvsStats::clock::time_point start = NvsStats::clock::now());
+      err = _backend->getScalar(_nvs_handle, key.c_str(), nvs_entry_type(Traits::type), &bits);
+      stored = (typename Traits::storage_type)bits;
+      NVS_STAT(_stats.getLatency(start); _stats.get(Traits::type, err));
+      if constexpr (std::is_floating_point_v<typename Traits::value_type>)
+      {
+        // written as a blob by older versions, see migrateFloat() / migrateDouble()
+        if (err == ESP_ERR_NVS_NOT_FOUND)
+        {
+          size_t length = sizeof(T);
+          err = _backend->getBlob(_nvs_handle, key.c_str(), value, &length);
+          if (err == ESP_OK && length != sizeof(T))
+            err = ESP_ERR_NVS_INVALID_LENGTH;
+          return result(err);
+        }
+      }
+      if (err != ESP_OK)
+        return result(err);
+      // other readers hold the lock too: keep whatever got cached in the meantime
+      cache_fill(key, Traits::type, (uint64_t)stored);
+    }
+
+    *value = Traits::decode(stored);
+    return result(ESP_OK);
+  }
+}
+
+template <typename T>
+esp_err_t Nvs::set(const NvsKey &key, const T &value)
+{
+  using Traits = NvsTraits<T>;
+
+  if (!key.valid())
+    return ESP_ERR_INVALID_ARG;
+
+  if constexpr (!Traits::scalar)
+    return setObject(key.c_str(), &value, sizeof(T));
+  else
+  {
+    typename Traits::storage_type stored = Traits::encode(value);
+    if (_async_on.load(std::memory_order_relaxed))
+      return submit(key, Traits::type, (uint64_t)stored, NULL, NULL);
+
+    NvsGuard guard(_lock, _concurrent, NvsGuard::EXCLUSIVE);
+
+    if (_write_back && store_dirty(key, Traits::type, (uint64_t)stored))
+      return result(flush_if_due());
+
+    if (unchanged(key, Traits::type, (uint64_t)stored))
+      return result(ESP_OK);
+
+    esp_err_t err = _backend->setScalar(_nvs_handle, key.c_str(), nvs_entry_type(Traits::type), (uint64_t)stored);
+    NVS_STAT(_stats.set(Traits::type, sizeof(stored), err));
+    if (err != ESP_OK)
+      return result(err);
+    cache_store(key, Traits::type, (uint64_t)stored);
+    return commit_if_needed();
+  }
+}
+
+template <typename T>
+esp_err_t Nvs::set(const NvsKey &key, const T &value, NvsWriteCallback done, void *arg)
+{
+  using Traits = NvsTraits<T>;
+  static_assert(Traits::scalar, "only integer, boolean and floating point values have a result callback");
+
+  if (!key.valid())
+    return ESP_ERR_INVALID_ARG;
+
+  if (_async_on.load(std::memory_order_relaxed))
+    return submit(key, Traits::type, (uint64_t)Traits::encode(value), done, arg);
+
+  esp_err_t err = set(key, value);
+  if (done != NULL)
+    done(key.c_str(), err, arg);
+  return err;
+}
+
+/**
+ * @brief Scope guard for Nvs::beginBatch() / Nvs::commitBatch()
+ *
+ * @code
+ * {
+ *   NvsBatch batch(*config);
+ *   config->setUInt16("buffsize", 4096);
+ *   config->setCharArray("name", "device");
+ * } // one commit here
+ * @endcode
+ */
+class NvsBatch
+{
+public:
+  explicit NvsBatch(Nvs &nvs);
+  ~NvsBatch();
+
+  NvsBatch(const NvsBatch &) = delete;
+  NvsBatch &operator=(const NvsBatch &) = delete;
+
+  /**
+   * @brief Close the batch before the end of the scope and return the commit result
+   */
+  esp_err_t commit();
+
+private:
+  Nvs &_nvs;
+  bool _done = false;
+};
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <memory>
+#include <memory_resource>
+#include <span>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief Memory for the strings and blobs returned by Nvs::getString() / Nvs::getBlob()
+ */
+class NvsAllocator
+{
+public:
+  virtual ~NvsAllocator() = default;
+
+  /**
+   * @return size bytes aligned for any type, NULL if there is no room
+   */
+  virtual void *allocate(size_t size) = 0;
+
+  virtual void deallocate(void *data, size_t size) = 0;
+
+  /**
+   * @brief malloc() / free(), the default
+   */
+  static NvsAllocator &heap();
+};
+
+/**
+ * @brief Bump allocator over a caller supplied buffer, everything is released at once by reset()
+ *
+ * @code
+ * static uint8_t memory[2048];
+ * NvsArena arena(memory);
+ * NvsString name = config->getString("name", "device", &arena);
+ * NvsString url = config->getString("url", NULL, &arena);
+ * ...
+ * arena.reset(); // once every NvsString / NvsBlob taken from it is gone
+ * @endcode
+ */
+class NvsArena : public NvsAllocator
+{
+public:
+  NvsArena(std::span<uint8_t> buffer) : _buffer(buffer) {}
+
+  void *allocate(size_t size) override;
+  void deallocate(void *data, size_t size) override {}
+
+  void reset() { _used = 0; }
+  size_t used() const { return _used; }
+
+private:
+  std::span<uint8_t> _buffer;
+  size_t _used = 0;
+};
+
+/**
+ * @brief Adapter for a std::pmr::memory_resource (pool, monotonic buffer, ...)
+ *
+ * A memory_resource reports exhaustion by throwing std::bad_alloc, which aborts when exceptions are disabled.
+ */
+class NvsResourceAllocator : public NvsAllocator
+{
+public:
+  NvsResourceAllocator(std::pmr::memory_resource &resource) : _resource(resource) {}
+
+  void *allocate(size_t size) override;
+  void deallocate(void *data, size_t size) override;
+
+private:
+  std::pmr::memory_resource &_resource;
+};
+
+/**
+ * @brief Gives the memory back to the allocator it came from
+ */
+struct NvsDeleter
+{
+  NvsAllocator *allocator;
+  size_t size;
+
+  void operator()(void *data) const
+  {
+    if (data != NULL)
+      allocator->deallocate(data, size);
+  }
+};
+
+typedef std::unique_ptr<char[], NvsDeleter> NvsString;
+typedef std::unique_ptr<uint8_t[], NvsDeleter> NvsBlob;
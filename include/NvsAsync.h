@@ -0,0 +1,190 @@
+#pragma once
+
+#include "nvs.h"
+#include "NvsKey.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <stddef.h>
+#include <stdint.h>
+#include <thread>
+
+#ifndef NVS_ASYNC_QUEUE_SIZE
+#define NVS_ASYNC_QUEUE_SIZE 32
+#endif
+
+static_assert((NVS_ASYNC_QUEUE_SIZE & (NVS_ASYNC_QUEUE_SIZE - 1)) == 0, "NVS_ASYNC_QUEUE_SIZE must be a power of two");
+
+/**
+ * @brief Called from the persistence worker once a queued write is in flash (or failed)
+ */
+typedef void (*NvsWriteCallback)(const char *key, esp_err_t err, void *arg);
+
+/**
+ * @brief Bounded lock-free multi-producer / single-consumer ring (D. Vyukov's bounded queue)
+ *
+ * Every cell carries a sequence number that tells producers and the consumer whose turn it is,
+ * so push() is a single CAS on the tail and pop() touches no shared counter at all.
+ */
+template <typename T, size_t N>
+class NvsQueue
+{
+public:
+  NvsQueue()
+  {
+    for (size_t i = 0; i < N; i++)
+      _cells[i].sequence.store(i, std::memory_order_relaxed);
+  }
+
+  /**
+   * @return false if the queue is full
+   */
+  bool push(const T &value)
+  {
+    size_t position = _tail.load(std::memory_order_relaxed);
+    Cell *cell;
+    while (true)
+    {
+      cell = &_cells[position & (N - 1)];
+      intptr_t diff = (intptr_t)cell->sequence.load(std::memory_order_acquire) - (intptr_t)position;
+      if (diff == 0)
+      {
+        if (_tail.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+          break;
+      }
+      else if (diff < 0)
+        return false;
+      else
+        position = _tail.load(std::memory_order_relaxed);
+    }
+    cell->value = value;
+    cell->sequence.store(position + 1, std::memory_order_release);
+    return true;
+  }
+
+  /**
+   * @brief Consumer only: one thread at a time, the consumers take turns under a lock of their own
+   *
+   * @return false if the queue is empty
+   */
+  bool pop(T *value)
+  {
+    size_t head = _head.load(std::memory_order_relaxed);
+    Cell *cell = &_cells[head & (N - 1)];
+    if (cell->sequence.load(std::memory_order_acquire) != head + 1)
+      return false;
+    *value = cell->value;
+    cell->sequence.store(head + N, std::memory_order_release);
+    _head.store(head + 1, std::memory_order_relaxed);
+    return true;
+  }
+
+  /**
+   * @brief Number of pushes started so far, including ones still in progress
+   */
+  size_t pushed() const { return _tail.load(std::memory_order_acquire); }
+
+  /**
+   * @brief Whether there is nothing to pop; with another consumer running, only a hint
+   */
+  bool empty() const
+  {
+    size_t head = _head.load(std::memory_order_relaxed);
+    return _cells[head & (N - 1)].sequence.load(std::memory_order_acquire) != head + 1;
+  }
+
+private:
+  struct Cell
+  {
+    std::atomic<size_t> sequence;
+    T value;
+  };
+
+  Cell _cells[N];
+  std::atomic<size_t> _tail = 0;
+  // atomic only because empty() may read it while another consumer pops
+  std::atomic<size_t> _head = 0;
+};
+
+/**
+ * @brief One integer / boolean / floating point write waiting for the persistence worker
+ */
+struct NvsWrite
+{
+  char key[NVS_KEY_NAME_MAX_SIZE];
+  uint32_t hash;
+  nvs_type_t type;
+  uint64_t value; // as stored
+  NvsWriteCallback done;
+  void *arg;
+};
+
+class Nvs;
+
+/**
+ * @brief Persistence worker of Nvs::setAsync()
+ *
+ * Setters push their value with submit() and return. A single thread drains the queue, writes the
+ * last value of every key found in the drained batch and commits once per batch (Nvs::write_batch()).
+ * The thread only sleeps on the mutex while the queue is empty, producers take it just to wake it up.
+ * A batch is popped and written while the lock of the Nvs is held exclusively, so a thread holding
+ * that lock can drain() the queue itself.
+ */
+class NvsAsync
+{
+public:
+  explicit NvsAsync(Nvs &nvs);
+
+  // writes whatever is still queued before the worker stops
+  ~NvsAsync();
+
+  NvsAsync(const NvsAsync &) = delete;
+  NvsAsync &operator=(const NvsAsync &) = delete;
+
+  /**
+   * @return false if the queue is full
+   */
+  bool submit(const NvsKey &key, nvs_type_t type, uint64_t value, NvsWriteCallback done, void *arg);
+
+  /**
+   * @brief Wait until every write submitted before the call has been written and committed
+   */
+  void flush();
+
+  /**
+   * @brief Write everything queued on the calling thread, which holds the lock of the Nvs exclusively
+   */
+  void drain();
+
+  /**
+   * @brief Start the worker thread, once the one stopped by stop() has ended
+   *
+   * Must not be called with the lock of the Nvs held: the previous worker may still wait for it.
+   */
+  void start();
+
+  /**
+   * @brief Let the worker end once the queue is empty, without waiting for it
+   */
+  void stop();
+
+private:
+  Nvs &_nvs;
+  NvsQueue<NvsWrite, NVS_ASYNC_QUEUE_SIZE> _queue;
+  NvsWrite _batch[NVS_ASYNC_QUEUE_SIZE];
+
+  size_t _completed = 0;
+  std::atomic<bool> _sleeping = false;
+  bool _stop = false;
+
+  std::mutex _mutex;
+  std::condition_variable _wake;
+  std::condition_variable _done;
+
+  std::thread _thread;
+
+  void run();
+  void wake();
+  size_t write_queued();
+};
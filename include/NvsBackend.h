@@ -0,0 +1,86 @@
+#pragma once
+
+#include "nvs.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief Storage engine under Nvs, the operations of the nvs_* API on an opened namespace handle
+ *
+ * Return codes, lengths and the behaviour for a missing key / wrong type follow nvs_flash, so the wrapper
+ * doesn't have to know which engine it runs on. An engine may be shared by several Nvs instances and tasks.
+ */
+class NvsBackend
+{
+public:
+  virtual ~NvsBackend() = default;
+
+  virtual esp_err_t open(const char *namespace_name, nvs_open_mode_t open_mode, nvs_handle_t *handle) = 0;
+  virtual void close(nvs_handle_t handle) = 0;
+
+  /**
+   * @brief Integer entry of type NVS_TYPE_I8 .. NVS_TYPE_U64, signed values are sign-extended
+   */
+  virtual esp_err_t getScalar(nvs_handle_t handle, const char *key, nvs_type_t type, uint64_t *value) = 0;
+  virtual esp_err_t setScalar(nvs_handle_t handle, const char *key, nvs_type_t type, uint64_t value) = 0;
+
+  /**
+   * @brief Same contract as nvs_get_str / nvs_get_blob: a NULL buffer queries the length
+   */
+  virtual esp_err_t getStr(nvs_handle_t handle, const char *key, char *value, size_t *length) = 0;
+  virtual esp_err_t getBlob(nvs_handle_t handle, const char *key, void *value, size_t *length) = 0;
+  virtual esp_err_t setStr(nvs_handle_t handle, const char *key, const char *value) = 0;
+  virtual esp_err_t setBlob(nvs_handle_t handle, const char *key, const void *value, size_t length) = 0;
+
+  virtual esp_err_t findKey(nvs_handle_t handle, const char *key, nvs_type_t *type) = 0;
+  virtual esp_err_t eraseKey(nvs_handle_t handle, const char *key) = 0;
+  virtual esp_err_t eraseAll(nvs_handle_t handle) = 0;
+  virtual esp_err_t commit(nvs_handle_t handle) = 0;
+
+  /**
+   * @brief Start a scan of a namespace (NULL: every namespace), NULL if nothing matches
+   */
+  virtual void *entryFind(const char *namespace_name, nvs_type_t type) = 0;
+
+  /**
+   * @brief Next entry of the scan; after the last one the scan is released and NULL returned
+   */
+  virtual void *entryNext(void *it) = 0;
+  virtual void entryInfo(void *it, nvs_entry_info_t *info) = 0;
+  virtual void entryRelease(void *it) = 0;
+};
+
+/**
+ * @brief The nvs_flash engine on one partition, the default of every Nvs opened by partition label
+ *
+ * Mounting the partition stays with Nvs, this only forwards the calls.
+ */
+class NvsFlashBackend : public NvsBackend
+{
+public:
+  NvsFlashBackend(const char *partition_label = NULL) : _partition_label(partition_label) {}
+
+  esp_err_t open(const char *namespace_name, nvs_open_mode_t open_mode, nvs_handle_t *handle) override;
+  void close(nvs_handle_t handle) override;
+
+  esp_err_t getScalar(nvs_handle_t handle, const char *key, nvs_type_t type, uint64_t *value) override;
+  esp_err_t setScalar(nvs_handle_t handle, const char *key, nvs_type_t type, uint64_t value) override;
+  esp_err_t getStr(nvs_handle_t handle, const char *key, char *value, size_t *length) override;
+  esp_err_t getBlob(nvs_handle_t handle, const char *key, void *value, size_t *length) override;
+  esp_err_t setStr(nvs_handle_t handle, const char *key, const char *value) override;
+  esp_err_t setBlob(nvs_handle_t handle, const char *key, const void *value, size_t length) override;
+
+  esp_err_t findKey(nvs_handle_t handle, const char *key, nvs_type_t *type) override;
+  esp_err_t eraseKey(nvs_handle_t handle, const char *key) override;
+  esp_err_t eraseAll(nvs_handle_t handle) override;
+  esp_err_t commit(nvs_handle_t handle) override;
+
+  void *entryFind(const char *namespace_name, nvs_type_t type) override;
+  void *entryNext(void *it) override;
+  void entryInfo(void *it, nvs_entry_info_t *info) override;
+  void entryRelease(void *it) override;
+
+private:
+  const char *_partition_label;
+};
@@ -0,0 +1,135 @@
+#pragma once
+
+#include "nvs.h"
+#include "NvsCrc.h"
+#include "NvsKey.h"
+
+#include <atomic>
+
+#ifndef NVS_CACHE_SIZE
+#define NVS_CACHE_SIZE 32
+#endif
+
+static_assert((NVS_CACHE_SIZE & (NVS_CACHE_SIZE - 1)) == 0, "NVS_CACHE_SIZE must be a power of two");
+
+/**
+ * @brief Open-addressing (linear probing) table of scalar values keyed by key name.
+ *
+ * Slots are picked by the hash precomputed in NvsKey, so a probe does no string hashing.
+ *
+ * Values are kept as the raw bits of the stored integer together with its nvs_type_t; strings and
+ * blobs (NVS_TYPE_STR / NVS_TYPE_BLOB) as their digest(), which is enough to tell a rewrite of the
+ * same value.
+ * The table never grows: once it is 3/4 full a new key evicts the entry in its home slot.
+ * Dirty entries (written back later by Nvs::flush()) are never evicted.
+ */
+class NvsCache
+{
+public:
+  NvsCache();
+
+  /**
+   * @brief Length and CRC-32 of a string / blob in one value
+   */
+  static uint64_t digest(const void *data, size_t length)
+  {
+    return ((uint64_t)length << 32) | nvs_crc32(0, data, length);
+  }
+
+  /**
+   * @brief Look the key up
+   *
+   * @param[in] key Key name
+   * @param[in] type Expected type, an entry of another type is a miss
+   * @param[out] value Raw value bits
+   * @return true on hit
+   */
+  bool find(const NvsKey &key, nvs_type_t type, uint64_t *value);
+
+  /**
+   * @brief find() without counting a hit or a miss
+   */
+  bool peek(const NvsKey &key, nvs_type_t type, uint64_t *value);
+
+  bool contains(const NvsKey &key) { return lookup(key) != NULL; }
+
+  /**
+   * @brief Insert or update the key
+   *
+   * @param[in] dirty Mark the value as not yet written to NVS
+   * @return false if the table has no room for the key
+   */
+  bool store(const NvsKey &key, nvs_type_t type, uint64_t value, bool dirty = false);
+
+  /**
+   * @brief store() a value read from NVS, unless the key is already cached
+   *
+   * An entry stored meanwhile by a writer is at least as recent as the value read.
+   */
+  void fill(const NvsKey &key, nvs_type_t type, uint64_t value)
+  {
+    if (!contains(key))
+      store(key, type, value);
+  }
+
+  /**
+   * @brief Drop the key
+   *
+   * @return true if the dropped value was dirty
+   */
+  bool remove(const NvsKey &key);
+  void clear();
+
+  /**
+   * @brief Call write(key, type, value) for every dirty entry, the entry becomes clean
+   * when write returns ESP_OK
+   *
+   * @return the first error returned by write, ESP_OK otherwise
+   */
+  template <typename F>
+  esp_err_t writeDirty(F write)
+  {
+    esp_err_t result = ESP_OK;
+    for (Entry &entry : _entries)
+    {
+      if (!entry.used || !entry.dirty)
+        continue;
+      esp_err_t err = write(entry.key, entry.type, entry.value);
+      if (err != ESP_OK)
+      {
+        if (result == ESP_OK)
+          result = err;
+        continue;
+      }
+      entry.dirty = false;
+      _dirty--;
+    }
+    return result;
+  }
+
+  uint16_t dirtyCount() const { return _dirty; }
+
+  uint32_t hits() const { return _hits.load(std::memory_order_relaxed); }
+  uint32_t misses() const { return _misses.load(std::memory_order_relaxed); }
+
+private:
+  struct Entry
+  {
+    uint32_t hash;
+    nvs_type_t type;
+    uint64_t value;
+    char key[NVS_KEY_NAME_MAX_SIZE];
+    bool used;
+    bool dirty;
+  };
+
+  Entry _entries[NVS_CACHE_SIZE];
+  uint16_t _count = 0;
+  uint16_t _dirty = 0;
+  // atomic: find() runs under the shared lock of a concurrent Nvs
+  std::atomic<uint32_t> _hits = 0;
+  std::atomic<uint32_t> _misses = 0;
+
+  Entry *lookup(const NvsKey &key);
+  void erase(Entry *entry);
+};
@@ -0,0 +1,52 @@
+#pragma once
+
+#include "nvs.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Compressed string / blob values are stored as a blob:
+//   "\xffNZ"  magic
+//   u8        type of the original value, NVS_TYPE_STR or NVS_TYPE_BLOB
+//   u32       length of the original value, little endian
+//   ...       LZF stream (control byte < 32: 1..32 literals follow, otherwise a back reference)
+// A value is only stored compressed when that makes it smaller, so a plain value can be told apart
+// by the header and stays readable.
+#define NVS_CODEC_HEADER_SIZE 8
+
+#define NVS_CODEC_HASH_BITS 10
+
+// scratch space nvs_pack() needs to find matches
+#define NVS_CODEC_TABLE_SIZE (sizeof(uint32_t) << NVS_CODEC_HASH_BITS)
+
+// room past the original length that nvs_unpack() needs to expand a value in place
+#define NVS_CODEC_MARGIN(length) ((length) / 32 + 16)
+
+/**
+ * @brief Compress a value behind the header
+ *
+ * @param[in] table NVS_CODEC_TABLE_SIZE bytes of scratch space
+ * @return length of the packed value, 0 if it doesn't fit in room
+ */
+size_t nvs_pack(nvs_type_t type, const void *data, size_t length, void *output, size_t room, uint32_t *table);
+
+/**
+ * @brief Check if a stored blob is a packed value of type
+ *
+ * @param[out] length Length of the original value
+ */
+bool nvs_packed(nvs_type_t type, const void *data, size_t stored, size_t *length);
+
+/**
+ * @brief Expand a packed value in place
+ *
+ * @param[inout] buffer Holds the packed value (see nvs_packed()) at its start, the original one on return
+ * @param[in] stored Length of the packed value
+ * @param[in] room Size of buffer
+ * @param[out] length Length of the original value, or the room it needs when room is too small
+ * @return
+ *             - ESP_OK if the value was expanded
+ *             - ESP_ERR_NVS_INVALID_LENGTH if room is smaller than the original length + NVS_CODEC_MARGIN()
+ *             - ESP_ERR_INVALID_SIZE if the stream is corrupted
+ */
+esp_err_t nvs_unpack(void *buffer, size_t stored, size_t room, size_t *length);
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief CRC-32 (IEEE, reflected) with the same convention as esp_rom_crc32_le(): the running value
+ * is inverted on the way in and out, so calls can be chained and the NVS page format is
+ * nvs_crc32(0xffffffff, ...).
+ *
+ * Nibble table: 64 bytes of table for a fraction of the bit-by-bit cost.
+ */
+inline uint32_t nvs_crc32(uint32_t crc, const void *data, size_t length)
+{
+  static constexpr uint32_t table[16] = {
+      0x00000000, 0x1db71064, 0x3b6e20c8, 0x26d930ac, 0x76dc4190, 0x6b6b51f4, 0x4db26158, 0x5005713c,
+      0xedb88320, 0xf00f9344, 0xd6d6a3e8, 0xcb61b38c, 0x9b64c2b0, 0x86d3d2d4, 0xa00ae278, 0xbdbdf21c,
+  };
+
+  const uint8_t *bytes = (const uint8_t *)data;
+  crc = ~crc;
+  while (length--)
+  {
+    crc ^= *bytes++;
+    crc = (crc >> 4) ^ table[crc & 0x0f];
+    crc = (crc >> 4) ^ table[crc & 0x0f];
+  }
+  return ~crc;
+}
@@ -0,0 +1,100 @@
+#pragma once
+
+#include "NvsBackend.h"
+
+#include <stddef.h>
+#include <iterator>
+
+/**
+ * @brief One stored entry: key, namespace and type. The value itself is not read.
+ */
+class NvsEntry
+{
+public:
+  const char *key() const { return _info.key; }
+  const char *namespaceName() const { return _info.namespace_name; }
+
+  /**
+   * @brief NVS type of the entry. Floats and doubles show up as NVS_TYPE_U32 / NVS_TYPE_U64.
+   */
+  nvs_type_t type() const { return _info.type; }
+
+  /**
+   * @brief Size of the value in bytes (strings include the zero terminator)
+   *
+   * Free for integer entries. For strings and blobs of the namespace the range was created for
+   * this asks NVS for the length without reading the value; for other namespaces it returns 0.
+   */
+  size_t size() const;
+
+private:
+  friend class NvsEntryIterator;
+
+  nvs_entry_info_t _info;
+  NvsBackend *_backend = NULL;
+  nvs_handle_t _handle = 0;
+  const char *_handle_namespace = NULL;
+};
+
+/**
+ * @brief Input iterator over NvsBackend::entryFind / entryNext, see NvsEntries
+ *
+ * Move only: it owns the scan of the backend. Advancing doesn't allocate.
+ */
+class NvsEntryIterator
+{
+public:
+  using iterator_category = std::input_iterator_tag;
+  using value_type = NvsEntry;
+  using difference_type = ptrdiff_t;
+  using pointer = const NvsEntry *;
+  using reference = const NvsEntry &;
+
+  NvsEntryIterator() = default;
+  NvsEntryIterator(NvsBackend *backend, void *it, nvs_handle_t handle, const char *handle_namespace);
+  NvsEntryIterator(NvsEntryIterator &&other);
+  NvsEntryIterator &operator=(NvsEntryIterator &&other);
+  ~NvsEntryIterator();
+
+  NvsEntryIterator(const NvsEntryIterator &) = delete;
+  NvsEntryIterator &operator=(const NvsEntryIterator &) = delete;
+
+  reference operator*() const { return _entry; }
+  pointer operator->() const { return &_entry; }
+
+  NvsEntryIterator &operator++();
+
+  // only meaningful against the end iterator
+  bool operator==(const NvsEntryIterator &other) const { return _it == other._it; }
+
+private:
+  void *_it = NULL;
+  NvsEntry _entry;
+};
+
+/**
+ * @brief Range over the entries of a namespace, or of a whole partition
+ *
+ * @code
+ * for (const NvsEntry &entry : config->entries())
+ *   printf("%s type %02x size %u\n", entry.key(), entry.type(), entry.size());
+ * @endcode
+ *
+ * Every begin() starts a new scan.
+ */
+class NvsEntries
+{
+public:
+  NvsEntries(NvsBackend *backend, const char *namespace_name, nvs_type_t type,
+             nvs_handle_t handle, const char *handle_namespace);
+
+  NvsEntryIterator begin() const;
+  NvsEntryIterator end() const { return NvsEntryIterator(); }
+
+private:
+  NvsBackend *_backend;
+  const char *_namespace;
+  nvs_type_t _type;
+  nvs_handle_t _handle;
+  const char *_handle_namespace;
+};
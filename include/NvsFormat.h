@@ -0,0 +1,109 @@
+#pragma once
+
+#include "NvsCrc.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Layout nvs_flash writes to a partition (page format version 2), little endian:
+//   page     header (32 bytes), entry state bitmap (32 bytes), 126 entries of 32 bytes
+//   bitmap   2 bits per entry, entry i in bits (i % 4) * 2 of byte i / 4
+//   entry    namespace index, type, span (entries used), chunk index, CRC-32, key, 8 bytes of data;
+//            strings and blob chunks continue in the span - 1 entries that follow
+// Namespaces are U8 entries of namespace 0: key = name, value = index.
+#define NVS_PAGE_SIZE 4096
+#define NVS_PAGE_HEADER_SIZE 32
+#define NVS_PAGE_BITMAP_SIZE 32
+#define NVS_PAGE_ENTRIES 126
+#define NVS_ENTRY_SIZE 32
+#define NVS_PAGE_FIRST_ENTRY (NVS_PAGE_HEADER_SIZE + NVS_PAGE_BITMAP_SIZE)
+
+#define NVS_PAGE_VERSION 0xfe
+
+#define NVS_PAGE_STATE_EMPTY 0xffffffff
+#define NVS_PAGE_STATE_ACTIVE 0xfffffffe
+#define NVS_PAGE_STATE_FULL 0xfffffffc
+#define NVS_PAGE_STATE_FREEING 0xfffffff8
+#define NVS_PAGE_STATE_CORRUPT 0xfffffff0
+
+#define NVS_ENTRY_STATE_EMPTY 0x3
+#define NVS_ENTRY_STATE_WRITTEN 0x2
+#define NVS_ENTRY_STATE_ERASED 0x0
+
+// item types, the same values as nvs_type_t for integers; a blob is an index entry plus data chunks
+#define NVS_ITEM_STR 0x21
+#define NVS_ITEM_BLOB_V1 0x41
+#define NVS_ITEM_BLOB_DATA 0x42
+#define NVS_ITEM_BLOB_INDEX 0x48
+
+#define NVS_CHUNK_ANY 0xff
+#define NVS_NAMESPACE_INDEX 0
+#define NVS_NAMESPACE_MAX 254
+
+// largest chunk of a blob / string: every entry of a page but the first
+#define NVS_ITEM_MAX_DATA ((NVS_PAGE_ENTRIES - 1) * NVS_ENTRY_SIZE)
+
+struct NvsPageHeader
+{
+  uint32_t state;
+  uint32_t sequence;
+  uint8_t version;
+  uint8_t reserved[19]; // 0xff
+  uint32_t crc;         // of sequence .. reserved
+};
+
+struct NvsItem
+{
+  uint8_t space;
+  uint8_t type;
+  uint8_t span;
+  uint8_t chunk; // NVS_CHUNK_ANY except for blob chunks
+  uint32_t crc;  // of every other byte of the entry
+  char key[16];
+  union
+  {
+    uint8_t data[8];
+    struct
+    {
+      uint16_t size;
+      uint16_t reserved; // 0xffff
+      uint32_t crc;      // of the data in the following entries
+    } var;
+    struct
+    {
+      uint32_t size;
+      uint8_t chunks;
+      uint8_t start; // 0 or 128, alternates on every write of the blob
+      uint16_t reserved;
+    } blob;
+  };
+};
+
+static_assert(sizeof(NvsPageHeader) == NVS_PAGE_HEADER_SIZE, "NVS page header layout");
+static_assert(sizeof(NvsItem) == NVS_ENTRY_SIZE, "NVS entry layout");
+
+inline uint32_t nvs_page_crc(const NvsPageHeader *header)
+{
+  return nvs_crc32(0xffffffff, &header->sequence, offsetof(NvsPageHeader, crc) - offsetof(NvsPageHeader, sequence));
+}
+
+inline uint32_t nvs_item_crc(const NvsItem *item)
+{
+  uint32_t crc = nvs_crc32(0xffffffff, item, offsetof(NvsItem, crc));
+  return nvs_crc32(crc, item->key, sizeof(NvsItem) - offsetof(NvsItem, key));
+}
+
+inline uint32_t nvs_data_crc(const void *data, size_t length)
+{
+  return nvs_crc32(0xffffffff, data, length);
+}
+
+inline uint8_t nvs_entry_state(const uint8_t *page, size_t index)
+{
+  return (page[NVS_PAGE_HEADER_SIZE + index / 4] >> (index % 4 * 2)) & 0x3;
+}
+
+inline bool nvs_item_variable(uint8_t type)
+{
+  return type == NVS_ITEM_STR || type == NVS_ITEM_BLOB_V1 || type == NVS_ITEM_BLOB_DATA;
+}
@@ -0,0 +1,142 @@
+#pragma once
+
+#include "NvsBackend.h"
+#include "NvsFormat.h"
+
+#ifdef ESP_PLATFORM
+#include "esp_partition.h"
+#include "sdkconfig.h"
+#endif
+
+#include <span>
+#include <string_view>
+#include <vector>
+
+/**
+ * @brief Read-only view of an NVS partition through a memory mapping, without nvs_flash
+ *
+ * For data written once and read often (factory calibration, certificates): the pages are parsed once
+ * into a sorted index of entry offsets, 4 bytes of RAM per entry, and strings / blobs stored in one chunk
+ * are returned as views into the mapping, without copy or allocation:
+ *
+ * @code
+ * NvsImage factory("factory");
+ * std::span<const uint8_t> certificate;
+ * if (factory.getBlobView("tls", "cert", &certificate) == ESP_OK)
+ *   tls_set_certificate(certificate.data(), certificate.size());
+ *
+ * Nvs calibration(factory, "calib", NVS_READONLY); // everything else of Nvs, read only
+ * @endcode
+ *
+ * The index is a snapshot: the partition must not be written by nvs_flash while it is mapped. Pages of
+ * an encrypted NVS partition fail their CRC and are skipped.
+ */
+class NvsImage : public NvsBackend
+{
+public:
+#ifdef ESP_PLATFORM
+  /**
+   * @brief Map an NVS partition with esp_partition_mmap
+   */
+  NvsImage(const char *partition_label);
+#endif
+
+  /**
+   * @brief Index an image already in memory, it must outlive this object
+   */
+  NvsImage(std::span<const uint8_t> image);
+
+#if defined(CONFIG_IDF_TARGET_LINUX) || !defined(ESP_PLATFORM)
+  /**
+   * @brief Map a partition image file (e.g. read back with esptool), fd can be closed afterwards
+   */
+  NvsImage(int fd);
+#endif
+
+  ~NvsImage();
+
+  NvsImage(const NvsImage &) = delete;
+  NvsImage &operator=(const NvsImage &) = delete;
+
+  /**
+   * @brief String without copy, valid as long as this object; data() is terminated like a C string
+   *
+   * @return
+   *             - ESP_OK if the string was found
+   *             - ESP_ERR_NVS_NOT_FOUND if the namespace or key doesn't exist
+   */
+  esp_err_t getStringView(const char *namespace_name, const char *key, std::string_view *value);
+
+  /**
+   * @brief Blob without copy, valid as long as this object
+   *
+   * @return
+   *             - ESP_OK if the blob was found
+   *             - ESP_ERR_NVS_NOT_FOUND if the namespace or key doesn't exist
+   *             - ESP_ERR_NOT_SUPPORTED if the blob spans several pages (read it through Nvs::getObject)
+   */
+  esp_err_t getBlobView(const char *namespace_name, const char *key, std::span<const uint8_t> *value);
+
+  /**
+   * @brief Number of indexed entries, namespaces and blob chunks included
+   */
+  size_t size() { return _index.size(); }
+
+  /**
+   * @brief Pages and entries skipped because of a bad CRC or an inconsistent span / length
+   */
+  size_t damaged() { return _damaged; }
+
+  /**
+   * @brief Result of mapping and indexing
+   *
+   * @return
+   *             - ESP_OK if the image was indexed (damaged entries are skipped)
+   *             - ESP_ERR_NVS_PART_NOT_FOUND if there is no NVS partition with this label
+   *             - ESP_ERR_INVALID_SIZE if the image is not made of whole pages
+   *             - an esp_partition_mmap / mmap error
+   */
+  esp_err_t last_error() { return _err; }
+
+  esp_err_t open(const char *namespace_name, nvs_open_mode_t open_mode, nvs_handle_t *handle) override;
+  void close(nvs_handle_t handle) override;
+
+  esp_err_t getScalar(nvs_handle_t handle, const char *key, nvs_type_t type, uint64_t *value) override;
+  esp_err_t setScalar(nvs_handle_t handle, const char *key, nvs_type_t type, uint64_t value) override;
+  esp_err_t getStr(nvs_handle_t handle, const char *key, char *value, size_t *length) override;
+  esp_err_t getBlob(nvs_handle_t handle, const char *key, void *value, size_t *length) override;
+  esp_err_t setStr(nvs_handle_t handle, const char *key, const char *value) override;
+  esp_err_t setBlob(nvs_handle_t handle, const char *key, const void *value, size_t length) override;
+
+  esp_err_t findKey(nvs_handle_t handle, const char *key, nvs_type_t *type) override;
+  esp_err_t eraseKey(nvs_handle_t handle, const char *key) override;
+  esp_err_t eraseAll(nvs_handle_t handle) override;
+  esp_err_t commit(nvs_handle_t handle) override;
+
+  void *entryFind(const char *namespace_name, nvs_type_t type) override;
+  void *entryNext(void *it) override;
+  void entryInfo(void *it, nvs_entry_info_t *info) override;
+  void entryRelease(void *it) override;
+
+private:
+  const uint8_t *_image = NULL;
+  size_t _size = 0;
+#ifdef ESP_PLATFORM
+  esp_partition_mmap_handle_t _mmap_handle = 0;
+  bool _partition_mapped = false;
+#endif
+  bool _file_mapped = false;
+  size_t _damaged = 0;
+  esp_err_t _err = ESP_OK;
+
+  // offsets of the valid entries, sorted by namespace, key, type, chunk
+  std::vector<uint32_t> _index;
+
+  const NvsItem *item(uint32_t offset) { return (const NvsItem *)(_image + offset); }
+  esp_err_t build();
+  const NvsItem *find(uint8_t space, const char *key, uint8_t type, uint8_t chunk);
+  uint8_t namespace_index(const char *namespace_name);
+  esp_err_t string_item(uint8_t space, const char *key, const NvsItem **found);
+  esp_err_t blob_index(uint8_t space, const char *key, const NvsItem **found);
+  bool namespace_name(uint8_t space, char *name);
+};
@@ -0,0 +1,87 @@
+#pragma once
+
+#include "NvsFormat.h"
+#include "NvsValue.h"
+
+#include <span>
+#include <string>
+#include <vector>
+
+/**
+ * @brief Writes an NVS partition image in one pass, for provisioning (see tools/nvs_image)
+ *
+ * @code
+ * std::vector<uint8_t> image(0x6000);
+ * NvsImageBuilder builder(image);
+ * builder.setNamespace("factory");
+ * builder.add(NvsValue::of("serial", (uint32_t)1234));
+ * builder.add(NvsValue::of("gain", 1.5f));          // same encoding as Nvs::setFloat
+ * builder.add(NvsValue::blob("cert", der, der_length));
+ * if (builder.finish() == ESP_OK)
+ *   fwrite(image.data(), 1, image.size(), file);   // flash at the partition offset
+ * @endcode
+ *
+ * Entries are laid out the way nvs_flash writes them (page format version 2, blobs in chunks of up to a
+ * page), pages are filled in order and the last page of the image stays empty for nvs_flash to use.
+ * Keys are not checked for duplicates.
+ */
+class NvsImageBuilder
+{
+public:
+  /**
+   * @param[in] image The partition, a multiple of NVS_PAGE_SIZE and at least 2 pages. Erased by the builder.
+   */
+  NvsImageBuilder(std::span<uint8_t> image);
+
+  /**
+   * @brief Namespace of the following values, created on first use
+   *
+   * @return
+   *             - ESP_OK if the namespace was selected
+   *             - ESP_ERR_NVS_INVALID_NAME / ESP_ERR_NVS_KEY_TOO_LONG if the name is empty / too long
+   *             - ESP_ERR_NVS_NOT_ENOUGH_SPACE if the image or the 254 namespaces are full
+   */
+  esp_err_t setNamespace(const char *namespace_name);
+
+  /**
+   * @brief Append a value to the current namespace
+   *
+   * @return
+   *             - ESP_OK if the value was written
+   *             - ESP_ERR_INVALID_STATE if no namespace is selected, finish() was called or an earlier
+   *               call ran out of space
+   *             - ESP_ERR_NVS_INVALID_NAME / ESP_ERR_NVS_KEY_TOO_LONG if the key is empty / too long
+   *             - ESP_ERR_NVS_VALUE_TOO_LONG if a string is above 4000 bytes or a blob needs more than 127 chunks
+   *             - ESP_ERR_NVS_NOT_ENOUGH_SPACE if the image is full, the image is then unusable
+   */
+  esp_err_t add(const NvsValue &value);
+
+  /**
+   * @brief Close the last page, the image is complete
+   *
+   * @return ESP_OK, or the error that made the image unusable
+   */
+  esp_err_t finish();
+
+  /**
+   * @brief Pages holding entries
+   */
+  size_t pagesUsed() { return _page + (_entry > 0 ? 1 : 0); }
+
+private:
+  std::span<uint8_t> _image;
+  size_t _pages = 0;
+  size_t _page = 0;  // being filled
+  size_t _entry = 0; // next free entry of the page
+  uint8_t _space = NVS_NAMESPACE_INDEX;
+  std::vector<std::string> _namespaces; // index - 1
+  bool _finished = false;
+  esp_err_t _err = ESP_OK;
+
+  NvsItem *reserve(size_t span);
+  void close_page(uint32_t state);
+  esp_err_t write_scalar(uint8_t space, uint8_t type, const char *key, uint64_t bits);
+  esp_err_t write_data(uint8_t type, const char *key, uint8_t chunk, const void *data, size_t length);
+  esp_err_t write_blob(const char *key, const void *data, size_t length);
+  size_t blob_chunks(size_t length);
+};
@@ -0,0 +1,76 @@
+#pragma once
+
+#include "nvs.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <type_traits>
+
+/**
+ * @brief Key name with its length and hash computed once
+ *
+ * Keys built from a string literal are validated at compile time, an empty key or a key longer than
+ * (NVS_KEY_NAME_MAX_SIZE-1) characters doesn't compile:
+ *
+ * @code
+ * constexpr NvsKey buffsize_key("buffsize");
+ * uint16_t buffsize = config->get(buffsize_key, (uint16_t)4096);
+ * @endcode
+ *
+ * Keys only known at run time go through NvsKey::dynamic(), which scans the string once.
+ */
+class NvsKey
+{
+public:
+  template <size_t N>
+  consteval NvsKey(const char (&name)[N]) : _name(name), _length(N - 1), _hash(hash(name))
+  {
+    if (N < 2 || N > NVS_KEY_NAME_MAX_SIZE)
+      invalid_key_length();
+  }
+
+  static NvsKey dynamic(const char *name)
+  {
+    return NvsKey(name, strlen(name), hash(name));
+  }
+
+  constexpr const char *c_str() const { return _name; }
+  constexpr size_t length() const { return _length; }
+  constexpr uint32_t hash() const { return _hash; }
+
+  constexpr bool valid() const { return _length > 0 && _length <= NVS_KEY_NAME_MAX_SIZE - 1; }
+
+  static constexpr uint32_t hash(const char *name)
+  {
+    // FNV-1a
+    uint32_t hash = 2166136261u;
+    while (*name)
+    {
+      hash ^= (uint8_t)*name++;
+      hash *= 16777619u;
+    }
+    return hash;
+  }
+
+private:
+  const char *_name;
+  size_t _length;
+  uint32_t _hash;
+
+  constexpr NvsKey(const char *name, size_t length, uint32_t hash) : _name(name), _length(length), _hash(hash) {}
+
+  // not constexpr on purpose: reaching it in a consteval constructor is a compile error
+  static void invalid_key_length() {}
+};
+
+/**
+ * @brief Key types the templated getters / setters of Nvs take as a plain string, through NvsKey::dynamic()
+ *
+ * Const char arrays are left out: a string literal goes to the NvsKey overload and is validated at
+ * compile time. K is deduced from a forwarding reference, so a char buffer is still a run-time key.
+ */
+template <typename K>
+concept NvsRuntimeKey = std::is_convertible_v<K, const char *> &&
+                        !(std::is_array_v<std::remove_reference_t<K>> &&
+                          std::is_const_v<std::remove_extent_t<std::remove_reference_t<K>>>);
@@ -0,0 +1,120 @@
+#pragma once
+
+#include <atomic>
+#include <shared_mutex>
+#include <stdint.h>
+#include <thread>
+
+/**
+ * @brief Reader / writer lock of an Nvs in concurrent mode
+ *
+ * Readers share the lock, writers hold it alone. The thread holding it exclusively may take it
+ * again, shared or exclusive, so locked methods can call each other.
+ */
+class NvsLock
+{
+public:
+  void lock()
+  {
+    if (owned())
+    {
+      _depth++;
+      return;
+    }
+    _mutex.lock();
+    _owner.store(std::this_thread::get_id(), std::memory_order_relaxed);
+    _depth = 1;
+  }
+
+  void unlock()
+  {
+    if (--_depth > 0)
+      return;
+    _owner.store(std::thread::id(), std::memory_order_relaxed);
+    _mutex.unlock();
+  }
+
+  /**
+   * @return false if the calling thread already holds the lock exclusively (nothing was locked)
+   */
+  bool lockShared()
+  {
+    if (owned())
+      return false;
+    _mutex.lock_shared();
+    return true;
+  }
+
+  void unlockShared() { _mutex.unlock_shared(); }
+
+  /**
+   * @brief Whether the calling thread holds the lock exclusively
+   */
+  bool owned() const { return _owner.load(std::memory_order_relaxed) == std::this_thread::get_id(); }
+
+private:
+  std::shared_mutex _mutex;
+  // only ever set to the id of the thread that holds _mutex, so a relaxed load is enough to tell
+  // whether the calling thread is the owner
+  std::atomic<std::thread::id> _owner;
+  uint16_t _depth = 0;
+};
+
+/**
+ * @brief Scope guard of NvsLock, does nothing when concurrent mode is off
+ */
+class NvsGuard
+{
+public:
+  enum Mode
+  {
+    SHARED,
+    EXCLUSIVE,
+  };
+
+  NvsGuard(NvsLock &lock, bool enabled, Mode mode) : _lock(lock)
+  {
+    if (!enabled)
+      return;
+    if (mode == EXCLUSIVE)
+      _lock.lock();
+    else if (!_lock.lockShared())
+      return;
+    _held = true;
+    _mode = mode;
+  }
+
+  ~NvsGuard()
+  {
+    if (!_held)
+      return;
+    if (_mode == EXCLUSIVE)
+      _lock.unlock();
+    else
+      _lock.unlockShared();
+  }
+
+  NvsGuard(const NvsGuard &) = delete;
+  NvsGuard &operator=(const NvsGuard &) = delete;
+
+  /**
+   * @brief Trade a shared hold for an exclusive one. Other writers may run in between, so whatever
+   * was read under the shared hold has to be checked again.
+   *
+   * @return true if the lock was released in between
+   */
+  bool upgrade()
+  {
+    if (!_held || _mode != SHARED)
+      return false;
+    _lock.unlockShared();
+    _lock.lock();
+    _mode = EXCLUSIVE;
+    return true;
+  }
+
+private:
+  NvsLock &_lock;
+  bool _held = false;
+  Mode _mode = SHARED;
+};
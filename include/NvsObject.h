@@ -0,0 +1,151 @@
+#pragma once
+
+#include "nvs.h"
+
+#include <span>
+#include <stddef.h>
+#include <stdint.h>
+
+// Chunked objects: the data is split in blobs of chunk_size bytes under derived keys
+// "~<hash of key>.<generation><index>" (e.g. "~1a2b3c4d.a00f"), the key itself holds an NvsObjectManifest.
+// A rewrite goes to the other generation and only replaces the manifest once every chunk is written,
+// so the previous object stays readable until then.
+#define NVS_OBJECT_MAGIC 0x4f53564e // "NVSO"
+#define NVS_OBJECT_MAX_CHUNKS 0x1000
+
+struct NvsObjectManifest
+{
+  uint32_t magic;
+  uint32_t size;
+  uint16_t chunk_size;
+  uint8_t generation; // 0 / 1
+  uint8_t reserved;
+};
+
+class Nvs;
+
+/**
+ * @brief Write a large object chunk by chunk
+ *
+ * @code
+ * static uint8_t chunk[1024];
+ * NvsObjectWriter writer(*config, "certs", chunk);
+ * while (size_t n = next_piece(piece, sizeof(piece)))
+ *   writer.write(piece, n);
+ * esp_err_t err = writer.finish();
+ * @endcode
+ *
+ * The buffer sets the chunk size (at most 65535 bytes, NVS_OBJECT_MAX_CHUNKS chunks) and is the only
+ * RAM used. An object that is never finished is discarded by the destructor.
+ */
+class NvsObjectWriter
+{
+public:
+  NvsObjectWriter(Nvs &nvs, const char *key, std::span<uint8_t> chunk_buffer);
+  ~NvsObjectWriter();
+
+  NvsObjectWriter(const NvsObjectWriter &) = delete;
+  NvsObjectWriter &operator=(const NvsObjectWriter &) = delete;
+
+  /**
+   * @brief Append data, a chunk goes to NVS each time the buffer is full
+   *
+   * @return
+   *             - ESP_OK if the data was taken
+   *             - ESP_ERR_INVALID_STATE if finish() was called or an earlier call failed
+   *             - ESP_ERR_INVALID_SIZE if the object outgrows NVS_OBJECT_MAX_CHUNKS chunks
+   *             - errors of nvs_set_blob
+   */
+  esp_err_t write(const void *data, size_t length);
+
+  /**
+   * @brief Write the last chunk and the manifest, then drop the chunks of the previous object
+   *
+   * @return ESP_OK if the new object replaced the previous one, the previous one is kept otherwise
+   */
+  esp_err_t finish();
+
+  size_t size() const { return _size; }
+
+  /**
+   * @brief Result of the constructor or of the last failed call
+   */
+  esp_err_t last_error() const { return _err; }
+
+private:
+  Nvs &_nvs;
+  char _key[NVS_KEY_NAME_MAX_SIZE];
+  uint32_t _hash;
+  std::span<uint8_t> _buffer;
+  size_t _used = 0;
+  size_t _size = 0;
+  uint16_t _chunks = 0;
+  NvsObjectManifest _previous = {};
+  uint8_t _generation = 0;
+  bool _done = false;
+  esp_err_t _err = ESP_OK;
+
+  esp_err_t write_chunk();
+};
+
+/**
+ * @brief Read a chunked object through a buffer of one chunk, sequentially or at any offset
+ *
+ * @code
+ * static uint8_t chunk[1024];
+ * NvsObjectReader reader(*config, "certs", chunk);
+ * uint8_t piece[256];
+ * size_t n = sizeof(piece);
+ * while (reader.read(piece, &n) == ESP_OK && n > 0)
+ * {
+ *   consume(piece, n);
+ *   n = sizeof(piece);
+ * }
+ * @endcode
+ */
+class NvsObjectReader
+{
+public:
+  /**
+   * @param[in] chunk_buffer At least the chunk size the object was written with
+   */
+  NvsObjectReader(Nvs &nvs, const char *key, std::span<uint8_t> chunk_buffer);
+
+  size_t size() const { return _manifest.size; }
+
+  /**
+   * @brief Read the next bytes
+   *
+   * @param[out] data
+   * @param[inout] length Room in data on entry, bytes read on return, 0 at the end of the object
+   */
+  esp_err_t read(void *data, size_t *length);
+
+  /**
+   * @brief Read length bytes at offset, the position of read() doesn't move
+   *
+   * @return ESP_ERR_INVALID_SIZE if the range goes past the end of the object
+   */
+  esp_err_t readAt(size_t offset, void *data, size_t length);
+
+  /**
+   * @brief Result of the constructor or of the last failed call
+   *
+   * @return
+   *             - ESP_ERR_NVS_NOT_FOUND if there is no object under the key
+   *             - ESP_ERR_NVS_TYPE_MISMATCH if the key holds something else
+   *             - ESP_ERR_INVALID_SIZE if chunk_buffer is smaller than a chunk
+   */
+  esp_err_t last_error() const { return _err; }
+
+private:
+  Nvs &_nvs;
+  uint32_t _hash;
+  std::span<uint8_t> _buffer;
+  NvsObjectManifest _manifest = {};
+  int32_t _loaded = -1; // chunk held by _buffer
+  size_t _position = 0;
+  esp_err_t _err = ESP_OK;
+
+  esp_err_t load(uint16_t chunk);
+};
@@ -0,0 +1,143 @@
+#pragma once
+
+#include "NvsBackend.h"
+#include "sdkconfig.h"
+
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * @brief In-memory engine: one hash map for every namespace, nothing survives the object
+ *
+ * For tests and simulations on the host (or a target without flash to spare):
+ *
+ * @code
+ * NvsRamBackend ram;
+ * Nvs config(ram, "config");
+ * @endcode
+ *
+ * Mirrors nvs_flash where the wrapper depends on it (missing keys, type mismatches, read-only handles,
+ * the 4000 byte string limit, length queries). An entry of another type under a key is replaced
+ * instead of being kept next to the new one.
+ */
+class NvsRamBackend : public NvsBackend
+{
+public:
+  esp_err_t open(const char *namespace_name, nvs_open_mode_t open_mode, nvs_handle_t *handle) override;
+  void close(nvs_handle_t handle) override;
+
+  esp_err_t getScalar(nvs_handle_t handle, const char *key, nvs_type_t type, uint64_t *value) override;
+  esp_err_t setScalar(nvs_handle_t handle, const char *key, nvs_type_t type, uint64_t value) override;
+  esp_err_t getStr(nvs_handle_t handle, const char *key, char *value, size_t *length) override;
+  esp_err_t getBlob(nvs_handle_t handle, const char *key, void *value, size_t *length) override;
+  esp_err_t setStr(nvs_handle_t handle, const char *key, const char *value) override;
+  esp_err_t setBlob(nvs_handle_t handle, const char *key, const void *value, size_t length) override;
+
+  esp_err_t findKey(nvs_handle_t handle, const char *key, nvs_type_t *type) override;
+  esp_err_t eraseKey(nvs_handle_t handle, const char *key) override;
+  esp_err_t eraseAll(nvs_handle_t handle) override;
+  esp_err_t commit(nvs_handle_t handle) override;
+
+  void *entryFind(const char *namespace_name, nvs_type_t type) override;
+  void *entryNext(void *it) override;
+  void entryInfo(void *it, nvs_entry_info_t *info) override;
+  void entryRelease(void *it) override;
+
+  /**
+   * @brief Number of entries in every namespace
+   */
+  size_t size();
+
+protected:
+  struct Name
+  {
+    uint16_t space; // index in _namespaces
+    char key[NVS_KEY_NAME_MAX_SIZE];
+
+    bool operator==(const Name &other) const;
+  };
+
+  struct NameHash
+  {
+    size_t operator()(const Name &name) const;
+  };
+
+  struct Value
+  {
+    nvs_type_t type;
+    uint64_t bits;             // integers
+    std::vector<uint8_t> data; // strings (with the terminator) and blobs
+  };
+
+  struct Handle
+  {
+    uint16_t space;
+    bool writable;
+    bool open;
+  };
+
+  std::mutex _mutex;
+  std::vector<std::string> _namespaces;
+  std::vector<Handle> _handles; // handle - 1
+  std::unordered_map<Name, Value, NameHash> _values;
+  uint32_t _changes = 0; // bumped by every write / erase
+
+  uint16_t namespace_index(const char *namespace_name, bool create);
+
+private:
+  esp_err_t handle_space(nvs_handle_t handle, bool write, uint16_t *space);
+  esp_err_t lookup(nvs_handle_t handle, const char *key, bool write, Name *name);
+  esp_err_t get_data(nvs_handle_t handle, const char *key, nvs_type_t type, void *value, size_t *length);
+  esp_err_t set_value(nvs_handle_t handle, const char *key, Value &&value);
+};
+
+#if defined(CONFIG_IDF_TARGET_LINUX) || !defined(ESP_PLATFORM)
+
+/**
+ * @brief NvsRamBackend persisted to a memory mapped file, for host tools
+ *
+ * The file is read once by the constructor; commit() writes every namespace to "<path>.tmp" when
+ * something changed since the last one, syncs it and renames it over the file, so a crash during a
+ * commit leaves the previous image in place. Layout, little endian:
+ *   "NVSF", u16 version, u16 flags
+ *   per entry: u8 namespace length, namespace, u8 type, u8 key length, key,
+ *              value (integer: its size, string / blob: u32 length + bytes)
+ *   u8 0, u32 CRC-32 of everything before
+ */
+class NvsFileBackend : public NvsRamBackend
+{
+public:
+  NvsFileBackend(const char *path);
+  ~NvsFileBackend();
+
+  esp_err_t commit(nvs_handle_t handle) override;
+
+  /**
+   * @brief Result of loading the file
+   *
+   * @return
+   *             - ESP_OK if the file was loaded or is new (empty)
+   *             - ESP_ERR_INVALID_ARG if it is not a file of this engine
+   *             - ESP_ERR_INVALID_VERSION if it has an unknown version
+   *             - ESP_ERR_INVALID_CRC / ESP_ERR_INVALID_SIZE if it is damaged
+   *             - ESP_FAIL if it could not be opened or mapped
+   *
+   * commit() fails with the same error, so a file that could not be loaded is never overwritten.
+   */
+  esp_err_t last_error() { return _err; }
+
+private:
+  std::string _path;
+  int _fd = -1;
+  uint8_t *_map = NULL;
+  size_t _mapped = 0;
+  uint32_t _saved_changes = 0;
+  esp_err_t _err = ESP_OK;
+
+  esp_err_t load();
+  esp_err_t map(size_t size);
+};
+
+#endif
@@ -0,0 +1,165 @@
+#pragma once
+
+#include "esp_partition.h"
+
+#include <mutex>
+#include <stddef.h>
+#include <stdint.h>
+
+// largest record of an NvsRingLog, a slot is built on the stack
+#ifndef NVS_RING_MAX_RECORD
+#define NVS_RING_MAX_RECORD 120
+#endif
+
+// Slot of a record, slots never straddle a sector:
+//   u32 sequence, 1 for the first record, 0xffffffff: slot never written
+//   u32 nvs_crc32(0, ...) of the sequence and the record
+//   record, padded with 0xff to a multiple of 4
+struct NvsRingHeader
+{
+  uint32_t sequence;
+  uint32_t crc;
+};
+
+/**
+ * @brief Append-only log of fixed size records in a raw data partition (not an NVS one)
+ *
+ * @code
+ * struct Sample { uint32_t time; int16_t temperature; };
+ * NvsRingLog log("log", sizeof(Sample));
+ * log.append(&sample);           // one flash write
+ * log.read(0, &last);            // the latest record, 1 the one before...
+ * @endcode
+ *
+ * Records are written one after the other through every sector of the partition and the oldest sector
+ * is erased when the log wraps, so each write costs one flash write of one slot, each sector is erased
+ * once per pass and there is no garbage collection. The constructor finds the latest record with one
+ * read per sector and a binary search in the newest one. A record torn by a reset fails its CRC and is
+ * skipped, the previous one stays the latest.
+ *
+ * Needs a partition of at least 2 sectors, one instance per partition.
+ */
+class NvsRingLog
+{
+public:
+  NvsRingLog(const char *partition_label, size_t record_size);
+
+  NvsRingLog(const NvsRingLog &) = delete;
+  NvsRingLog &operator=(const NvsRingLog &) = delete;
+
+  /**
+   * @brief Append a record
+   *
+   * A failed write is skipped by the next append, except at the start of a sector: that one erases
+   * the sector again and retries the slot.
+   *
+   * @param[in] record record_size bytes
+   * @return
+   *             - ESP_OK if the record was written
+   *             - ESP_ERR_INVALID_STATE if the log could not be opened, see last_error()
+   *             - an esp_partition error if the flash write / erase failed
+   */
+  esp_err_t append(const void *record);
+
+  /**
+   * @brief Read a record
+   *
+   * @param[in] back 0 for the latest record, 1 for the one before...
+   * @param[out] record record_size bytes
+   * @return
+   *             - ESP_OK if the record was read
+   *             - ESP_ERR_NVS_NOT_FOUND if the log holds fewer records
+   *             - ESP_ERR_INVALID_STATE if the log could not be opened, see last_error()
+   */
+  esp_err_t read(uint32_t back, void *record);
+
+  /**
+   * @brief Erase every record
+   */
+  esp_err_t clear();
+
+  /**
+   * @brief Sequence number of the latest record, 0 if the log is empty
+   */
+  uint32_t sequence() { return _sequence; }
+
+  /**
+   * @brief Number of records the log keeps at least, older ones are dropped a sector at a time
+   */
+  size_t capacity() { return _sectors < 2 ? 0 : _slots_per_sector * (_sectors - 1); }
+
+  /**
+   * @brief Result of opening the log
+   *
+   * @return
+   *             - ESP_OK if the partition was found and scanned
+   *             - ESP_ERR_NOT_FOUND if there is no data partition with this label
+   *             - ESP_ERR_INVALID_SIZE if record_size is 0 or above NVS_RING_MAX_RECORD, or the partition
+   *               has fewer than 2 sectors
+   */
+  esp_err_t last_error() { return _err; }
+
+private:
+  const esp_partition_t *_partition = NULL;
+  size_t _record_size;
+  size_t _slot_size = 0;
+  size_t _sectors = 0;
+  size_t _slots_per_sector = 0;
+  esp_err_t _err = ESP_OK;
+  std::mutex _mutex;
+
+  uint32_t _sequence = 0; // of the latest record
+  size_t _latest = 0;     // slot of the latest record
+  size_t _next = 0;       // slot the next record goes to
+
+  esp_err_t scan();
+  esp_err_t read_slot(size_t slot, NvsRingHeader *header, void *record);
+  size_t slot_offset(size_t slot);
+};
+
+/**
+ * @brief Counter (boot count, runtime, energy...) kept in an NvsRingLog
+ *
+ * An increment writes 16 bytes instead of rewriting an NVS entry and committing, and a 4 KB sector
+ * is erased every 256 increments, spread over the partition.
+ *
+ * @code
+ * NvsCounter boots("counters");
+ * boots.add(1);
+ * printf("boot %llu\n", boots.value());
+ * @endcode
+ */
+class NvsCounter
+{
+public:
+  NvsCounter(const char *partition_label);
+
+  /**
+   * @brief The latest value, 0 for a new partition
+   */
+  uint64_t value();
+
+  /**
+   * @brief Add to the value and store it
+   *
+   * @return see NvsRingLog::append
+   */
+  esp_err_t add(uint64_t delta = 1);
+
+  /**
+   * @brief Store a value
+   *
+   * @return see NvsRingLog::append
+   */
+  esp_err_t set(uint64_t value);
+
+  /**
+   * @brief see NvsRingLog::last_error
+   */
+  esp_err_t last_error() { return _log.last_error(); }
+
+private:
+  NvsRingLog _log;
+  uint64_t _value = 0;
+  std::mutex _mutex;
+};
@@ -0,0 +1,70 @@
+#pragma once
+
+#include "NvsKey.h"
+#include "NvsTraits.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <type_traits>
+
+/**
+ * @brief One member of a struct loaded / stored by Nvs::load() and Nvs::store()
+ *
+ * Build the table with NVS_FIELD, it can be constexpr:
+ *
+ * @code
+ * struct Config
+ * {
+ *   uint16_t buffsize;
+ *   float gain;
+ *   char name[32];
+ *   Calibration calibration;
+ * };
+ *
+ * static constexpr Calibration default_calibration = {...};
+ *
+ * static constexpr NvsField config_schema[] = {
+ *     NVS_FIELD(Config, buffsize, "buffsize", 4096),
+ *     NVS_FIELD(Config, gain, "gain", 1.0f),
+ *     NVS_FIELD(Config, name, "name", "device"),
+ *     NVS_FIELD(Config, calibration, "calib", &default_calibration),
+ * };
+ * @endcode
+ *
+ * The default of a scalar member is its value, of a char array member a string, and of any
+ * other member a pointer to a default object (NULL leaves the member untouched).
+ */
+struct NvsField
+{
+  NvsKey key;
+  nvs_type_t type;          // NvsTraits type, NVS_TYPE_STR for char arrays
+  uint16_t offset;          // offsetof the member
+  uint16_t size;            // sizeof the member
+  uint64_t default_bits;    // default of scalar members, as stored
+  const void *default_data; // default of string / blob members
+
+  template <typename M>
+  using default_t = std::conditional_t<std::is_array_v<M>, const char *,
+                    std::conditional_t<std::is_integral_v<M> || std::is_enum_v<M> || std::is_floating_point_v<M>, M,
+                    const M *>>;
+
+  template <typename M>
+  static constexpr NvsField of(NvsKey key, size_t offset, default_t<M> default_value)
+  {
+    if constexpr (std::is_array_v<M>)
+    {
+      static_assert(std::is_same_v<std::remove_extent_t<M>, char>, "only char arrays are supported");
+      return NvsField{key, NVS_TYPE_STR, (uint16_t)offset, (uint16_t)sizeof(M), 0, default_value};
+    }
+    else if constexpr (NvsTraits<M>::scalar)
+    {
+      return NvsField{key, NvsTraits<M>::type, (uint16_t)offset, (uint16_t)sizeof(M),
+                      (uint64_t)NvsTraits<M>::encode(default_value), NULL};
+    }
+    else
+      return NvsField{key, NVS_TYPE_BLOB, (uint16_t)offset, (uint16_t)sizeof(M), 0, default_value};
+  }
+};
+
+#define NVS_FIELD(Struct, member, key, default_value) \
+  NvsField::of<decltype(Struct::member)>(NvsKey(key), offsetof(Struct, member), default_value)
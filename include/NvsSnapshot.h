@@ -0,0 +1,43 @@
+#pragma once
+
+#include "nvs.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Snapshot image of a namespace, see Nvs::exportSnapshot(). All integers are little endian.
+//
+//   header   "NVSS", u16 version, u16 flags (0)
+//   record   u8 type (nvs_type_t of the entry), u8 key length, key without terminator,
+//            u32 value length (NVS_TYPE_STR / NVS_TYPE_BLOB only, a string includes its terminator),
+//            value (integers take the size given by their type)
+//   end      u8 NVS_TYPE_ANY, u32 nvs_crc32(0, ...) of every byte before the CRC
+#define NVS_SNAPSHOT_MAGIC "NVSS"
+#define NVS_SNAPSHOT_VERSION 1
+#define NVS_SNAPSHOT_HEADER_SIZE 8
+
+// smallest staging buffer: holds the header and any record without a string / blob value
+#define NVS_SNAPSHOT_MIN_BUFFER 32
+
+/**
+ * @brief Receives the next length bytes of an image
+ *
+ * @return ESP_OK, any other value aborts the export and is returned by it
+ */
+typedef esp_err_t (*NvsSnapshotWrite)(const void *data, size_t length, void *arg);
+
+/**
+ * @brief Provides the next bytes of an image
+ *
+ * @param[out] data Where to put them
+ * @param[inout] length Room in data on entry, number of bytes provided on return, 0 at the end of the image
+ * @return ESP_OK, any other value aborts the import and is returned by it
+ */
+typedef esp_err_t (*NvsSnapshotRead)(void *data, size_t *length, void *arg);
+
+/**
+ * @brief Goes back to the first byte of an image, for the second pass of an import
+ *
+ * @return ESP_OK, any other value aborts the import and is returned by it
+ */
+typedef esp_err_t (*NvsSnapshotRewind)(void *arg);
@@ -0,0 +1,139 @@
+#pragma once
+
+#include "nvs.h"
+#include "sdkconfig.h"
+#include "NvsTraits.h"
+
+#include <atomic>
+#include <chrono>
+#include <stdint.h>
+
+#if CONFIG_NVS_WRAPPER_STATS
+#define NVS_STAT(statement) statement
+#else
+#define NVS_STAT(statement)
+#endif
+
+// U8, I8, U16, I16, U32, I32, U64, I64, STR, BLOB, FLOAT, DOUBLE
+#define NVS_STATS_TYPES 12
+
+// bucket i counts latencies below 2^i microseconds, the last one everything slower
+#define NVS_STATS_BUCKETS 16
+
+/**
+ * @brief Plain copy of the counters, see Nvs::stats()
+ */
+struct NvsStatsSnapshot
+{
+  uint32_t sets[NVS_STATS_TYPES];
+  uint32_t gets[NVS_STATS_TYPES];
+  uint32_t failures[NVS_STATS_TYPES];
+  uint32_t cache_hits;
+  uint32_t commits;
+  uint32_t erases;
+  uint64_t bytes_written;
+  uint32_t commit_latency[NVS_STATS_BUCKETS];
+  uint32_t get_latency[NVS_STATS_BUCKETS];
+
+  /**
+   * @brief Index of a type in sets / gets / failures
+   */
+  static constexpr int typeIndex(nvs_type_t type)
+  {
+    switch ((int)type)
+    {
+    case NVS_TYPE_U8:
+      return 0;
+    case NVS_TYPE_I8:
+      return 1;
+    case NVS_TYPE_U16:
+      return 2;
+    case NVS_TYPE_I16:
+      return 3;
+    case NVS_TYPE_U32:
+      return 4;
+    case NVS_TYPE_I32:
+      return 5;
+    case NVS_TYPE_U64:
+      return 6;
+    case NVS_TYPE_I64:
+      return 7;
+    case NVS_TYPE_STR:
+      return 8;
+    case NVS_TYPE_FLOAT:
+      return 10;
+    case NVS_TYPE_DOUBLE:
+      return 11;
+    default:
+      return 9;
+    }
+  }
+
+  /**
+   * @brief Upper bound in microseconds of a histogram bucket
+   */
+  static constexpr uint32_t bucketLimit(int bucket) { return 1u << bucket; }
+};
+
+/**
+ * @brief Lock-free operation counters of one Nvs instance
+ *
+ * All updates are relaxed atomic increments, so tasks updating them don't serialize.
+ */
+class NvsStats
+{
+public:
+  using clock = std::chrono::steady_clock;
+
+  void set(nvs_type_t type, size_t bytes, esp_err_t err)
+  {
+    int index = NvsStatsSnapshot::typeIndex(type);
+    _sets[index].fetch_add(1, std::memory_order_relaxed);
+    if (err == ESP_OK)
+      _bytes_written.fetch_add(bytes, std::memory_order_relaxed);
+    else
+      _failures[index].fetch_add(1, std::memory_order_relaxed);
+  }
+
+  void get(nvs_type_t type, esp_err_t err)
+  {
+    int index = NvsStatsSnapshot::typeIndex(type);
+    _gets[index].fetch_add(1, std::memory_order_relaxed);
+    if (err != ESP_OK && err != ESP_ERR_NVS_NOT_FOUND)
+      _failures[index].fetch_add(1, std::memory_order_relaxed);
+  }
+
+  void cacheHit() { _cache_hits.fetch_add(1, std::memory_order_relaxed); }
+  void erase() { _erases.fetch_add(1, std::memory_order_relaxed); }
+
+  void commit(clock::time_point start)
+  {
+    _commits.fetch_add(1, std::memory_order_relaxed);
+    record(_commit_latency, start);
+  }
+
+  void getLatency(clock::time_point start) { record(_get_latency, start); }
+
+  NvsStatsSnapshot snapshot() const;
+  void reset();
+
+private:
+  std::atomic<uint32_t> _sets[NVS_STATS_TYPES] = {};
+  std::atomic<uint32_t> _gets[NVS_STATS_TYPES] = {};
+  std::atomic<uint32_t> _failures[NVS_STATS_TYPES] = {};
+  std::atomic<uint32_t> _cache_hits = 0;
+  std::atomic<uint32_t> _commits = 0;
+  std::atomic<uint32_t> _erases = 0;
+  std::atomic<uint64_t> _bytes_written = 0;
+  std::atomic<uint32_t> _commit_latency[NVS_STATS_BUCKETS] = {};
+  std::atomic<uint32_t> _get_latency[NVS_STATS_BUCKETS] = {};
+
+  static void record(std::atomic<uint32_t> *histogram, clock::time_point start)
+  {
+    uint64_t us = std::chrono::duration_cast<std::chrono::microseconds>(clock::now() - start).count();
+    int bucket = 0;
+    while (bucket < NVS_STATS_BUCKETS - 1 && us >= NvsStatsSnapshot::bucketLimit(bucket))
+      bucket++;
+    histogram[bucket].fetch_add(1, std::memory_order_relaxed);
+  }
+};
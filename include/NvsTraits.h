@@ -0,0 +1,166 @@
+#pragma once
+
+#include "nvs.h"
+
+#include <bit>
+#include <stddef.h>
+#include <stdint.h>
+#include <type_traits>
+
+// Wrapper level type tags of floating point values. They are stored bit-cast in a single
+// NVS_TYPE_U32 (float) or NVS_TYPE_U64 (double) entry; the tags keep the cache and the
+// setters from mixing them up with integers of the same width. They never reach flash: a float
+// entry is indistinguishable from a uint32_t one (a double from a uint64_t one), and reading it
+// with the other type reinterprets its bits.
+#define NVS_TYPE_FLOAT ((nvs_type_t)0x34)
+#define NVS_TYPE_DOUBLE ((nvs_type_t)0x38)
+
+/**
+ * @brief Type of the NVS entry that holds a value of the given (wrapper level) type
+ */
+constexpr nvs_type_t nvs_entry_type(nvs_type_t type)
+{
+  if (type == NVS_TYPE_FLOAT)
+    return NVS_TYPE_U32;
+  if (type == NVS_TYPE_DOUBLE)
+    return NVS_TYPE_U64;
+  return type;
+}
+
+/**
+ * @brief Size in bytes of an integer / float / double value; the low nibble of the type holds it
+ */
+constexpr size_t nvs_scalar_size(nvs_type_t type)
+{
+  return type & 0x0f;
+}
+
+/**
+ * @brief Compile-time mapping of a C++ type to the way Nvs stores it
+ *
+ * - bool is stored as NVS_TYPE_I8 (0 / 1)
+ * - integers and enums as the NVS integer type of the same width and signedness
+ * - float / double bit-cast into NVS_TYPE_U32 / NVS_TYPE_U64
+ * - any other trivially copyable type as a blob of sizeof(T) bytes
+ */
+template <typename T>
+struct NvsTraits
+{
+  static_assert(!std::is_pointer_v<T>, "pointers can't be stored, use setCharArray / setObject");
+  static_assert(std::is_trivially_copyable_v<T>, "only trivially copyable types can be stored");
+
+  using value_type = typename std::conditional_t<std::is_enum_v<T>, std::underlying_type<T>, std::type_identity<T>>::type;
+
+  static constexpr bool scalar = std::is_integral_v<value_type> ||
+                                 std::is_same_v<value_type, float> ||
+                                 std::is_same_v<value_type, double>;
+
+  static constexpr nvs_type_t type_of()
+  {
+    if constexpr (std::is_same_v<value_type, bool>)
+      return NVS_TYPE_I8;
+    else if constexpr (std::is_same_v<value_type, float>)
+      return NVS_TYPE_FLOAT;
+    else if constexpr (std::is_same_v<value_type, double>)
+      return NVS_TYPE_DOUBLE;
+    else if constexpr (std::is_integral_v<value_type>)
+    {
+      constexpr bool is_signed = std::is_signed_v<value_type>;
+      if constexpr (sizeof(value_type) == 1)
+        return is_signed ? NVS_TYPE_I8 : NVS_TYPE_U8;
+      else if constexpr (sizeof(value_type) == 2)
+        return is_signed ? NVS_TYPE_I16 : NVS_TYPE_U16;
+      else if constexpr (sizeof(value_type) == 4)
+        return is_signed ? NVS_TYPE_I32 : NVS_TYPE_U32;
+      else
+      {
+        static_assert(sizeof(value_type) == 8, "unsupported integer width");
+        return is_signed ? NVS_TYPE_I64 : NVS_TYPE_U64;
+      }
+    }
+    else
+      return NVS_TYPE_BLOB;
+  }
+
+  static constexpr nvs_type_t type = type_of();
+
+  // integer type of the NVS entry, T itself for blobs
+  using storage_type =
+      std::conditional_t<type == NVS_TYPE_I8, int8_t,
+      std::conditional_t<type == NVS_TYPE_U8, uint8_t,
+      std::conditional_t<type == NVS_TYPE_I16, int16_t,
+      std::conditional_t<type == NVS_TYPE_U16, uint16_t,
+      std::conditional_t<type == NVS_TYPE_I32, int32_t,
+      std::conditional_t<type == NVS_TYPE_U32 || type == NVS_TYPE_FLOAT, uint32_t,
+      std::conditional_t<type == NVS_TYPE_I64, int64_t,
+      std::conditional_t<type == NVS_TYPE_U64 || type == NVS_TYPE_DOUBLE, uint64_t,
+      T>>>>>>>>;
+
+  static constexpr storage_type encode(const T &value)
+  {
+    if constexpr (std::is_same_v<value_type, bool>)
+      return value ? 1 : 0;
+    else if constexpr (std::is_floating_point_v<value_type>)
+      return std::bit_cast<storage_type>(value);
+    else
+      return (storage_type)value;
+  }
+
+  static constexpr T decode(storage_type stored)
+  {
+    if constexpr (std::is_same_v<value_type, bool>)
+      return stored == 1;
+    else if constexpr (std::is_floating_point_v<value_type>)
+      return std::bit_cast<T>(stored);
+    else
+      return (T)stored;
+  }
+};
+
+template <typename S>
+inline esp_err_t nvs_get_value(nvs_handle_t handle, const char *key, S *value)
+{
+  if constexpr (std::is_same_v<S, int8_t>)
+    return nvs_get_i8(handle, key, value);
+  else if constexpr (std::is_same_v<S, uint8_t>)
+    return nvs_get_u8(handle, key, value);
+  else if constexpr (std::is_same_v<S, int16_t>)
+    return nvs_get_i16(handle, key, value);
+  else if constexpr (std::is_same_v<S, uint16_t>)
+    return nvs_get_u16(handle, key, value);
+  else if constexpr (std::is_same_v<S, int32_t>)
+    return nvs_get_i32(handle, key, value);
+  else if constexpr (std::is_same_v<S, uint32_t>)
+    return nvs_get_u32(handle, key, value);
+  else if constexpr (std::is_same_v<S, int64_t>)
+    return nvs_get_i64(handle, key, value);
+  else
+  {
+    static_assert(std::is_same_v<S, uint64_t>, "not an NVS integer type");
+    return nvs_get_u64(handle, key, value);
+  }
+}
+
+template <typename S>
+inline esp_err_t nvs_set_value(nvs_handle_t handle, const char *key, S value)
+{
+  if constexpr (std::is_same_v<S, int8_t>)
+    return nvs_set_i8(handle, key, value);
+  else if constexpr (std::is_same_v<S, uint8_t>)
+    return nvs_set_u8(handle, key, value);
+  else if constexpr (std::is_same_v<S, int16_t>)
+    return nvs_set_i16(handle, key, value);
+  else if constexpr (std::is_same_v<S, uint16_t>)
+    return nvs_set_u16(handle, key, value);
+  else if constexpr (std::is_same_v<S, int32_t>)
+    return nvs_set_i32(handle, key, value);
+  else if constexpr (std::is_same_v<S, uint32_t>)
+    return nvs_set_u32(handle, key, value);
+  else if constexpr (std::is_same_v<S, int64_t>)
+    return nvs_set_i64(handle, key, value);
+  else
+  {
+    static_assert(std::is_same_v<S, uint64_t>, "not an NVS integer type");
+    return nvs_set_u64(handle, key, value);
+  }
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include "NvsKey.h"
+#include "NvsTraits.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+/**
+ * @brief One entry of a desired state, see Nvs::sync()
+ *
+ * @code
+ * const NvsValue desired[] = {
+ *     NvsValue::of("buffsize", (uint16_t)4096),
+ *     NvsValue::of("gain", 1.0f),
+ *     NvsValue::of("name", "device"),
+ *     NvsValue::blob("calib", &calibration, sizeof(calibration)),
+ * };
+ * @endcode
+ */
+struct NvsValue
+{
+  NvsKey key;
+  nvs_type_t type;  // NvsTraits type, NVS_TYPE_STR or NVS_TYPE_BLOB
+  uint64_t bits;    // integer / boolean / floating point value, as stored
+  const void *data; // string / blob
+  size_t length;    // bytes of data, a string includes its terminator
+
+  template <typename T>
+  static constexpr NvsValue of(NvsKey key, const T &value)
+  {
+    static_assert(NvsTraits<T>::scalar, "use NvsValue::blob for other types");
+    return NvsValue{key, NvsTraits<T>::type, (uint64_t)NvsTraits<T>::encode(value), NULL, 0};
+  }
+
+  static NvsValue of(NvsKey key, const char *value)
+  {
+    return NvsValue{key, NVS_TYPE_STR, 0, value, strlen(value) + 1};
+  }
+
+  static constexpr NvsValue blob(NvsKey key, const void *data, size_t length)
+  {
+    return NvsValue{key, NVS_TYPE_BLOB, 0, data, length};
+  }
+};
+
+/**
+ * @brief What Nvs::sync() / Nvs::importSnapshot() did
+ */
+struct NvsSyncResult
+{
+  uint16_t written;
+  uint16_t unchanged;
+  uint16_t erased;
+};
@@ -0,0 +1,44 @@
+#include "bench.h"
+
+#include <algorithm>
+#include <stdio.h>
+
+Bench::Bench(const char *name, size_t bytes) : _name(name), _bytes(bytes)
+{
+}
+
+void Bench::field(const char *name, double value)
+{
+  _fields.push_back({name, value});
+}
+
+static double to_us(Bench::clock::duration duration)
+{
+  return std::chrono::duration<double, std::micro>(duration).count();
+}
+
+void Bench::report()
+{
+  if (_samples.empty())
+    return;
+
+  clock::duration total = clock::duration::zero();
+  for (clock::duration sample : _samples)
+    total += sample;
+  std::sort(_samples.begin(), _samples.end());
+  size_t n = _samples.size();
+  double seconds = to_us(total) / 1e6;
+
+  printf("{\"bench\":\"%s\",\"n\":%zu,\"ops_per_s\":%.1f,\"p50_us\":%.2f,\"p90_us\":%.2f,\"p99_us\":%.2f,\"max_us\":%.2f",
+         _name, n, seconds > 0 ? n / seconds : 0.0, to_us(_samples[n / 2]), to_us(_samples[n * 9 / 10]),
+         to_us(_samples[n * 99 / 100]), to_us(_samples[n - 1]));
+  if (_bytes != 0)
+    printf(",\"bytes\":%zu,\"mb_per_s\":%.2f", _bytes, seconds > 0 ? _bytes * n / seconds / 1e6 : 0.0);
+  for (const Field &field : _fields)
+    printf(",\"%s\":%g", field.name, field.value);
+  printf("}\n");
+  fflush(stdout);
+
+  _samples.clear();
+  _fields.clear();
+}
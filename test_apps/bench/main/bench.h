@@ -0,0 +1,85 @@
+#pragma once
+
+#include <chrono>
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+// partition every benchmark runs on, erased before the first one
+#define BENCH_PARTITION "nvs"
+
+// raw data partition of the NvsCounter benchmark, erased before the first one
+#define BENCH_COUNTER_PARTITION "counters"
+
+/**
+ * @brief Latency of one operation over many calls, reported as one JSON line on stdout
+ *
+ * @code
+ * Bench bench("set_u32");
+ * bench.run(1000, [&](size_t i) { nvs.setUInt32("key", i); });
+ * bench.field("commits", commits);
+ * bench.report();
+ * @endcode
+ *
+ * The line holds the number of calls, ops/s over the summed latency, the p50 / p90 / p99 / max
+ * latency in microseconds, MB/s when the operation moves bytes and any extra field:
+ *   {"bench":"set_u32","n":1000,"ops_per_s":81234.5,"p50_us":11.2,...,"commits":1000}
+ */
+class Bench
+{
+public:
+  using clock = std::chrono::steady_clock;
+
+  /**
+   * @param[in] name Name of the line, a literal
+   * @param[in] bytes Bytes moved by one call, 0 for none
+   */
+  explicit Bench(const char *name, size_t bytes = 0);
+
+  /**
+   * @brief Time op(i) for i in [0, iterations)
+   */
+  template <typename F>
+  void run(size_t iterations, F op)
+  {
+    _samples.reserve(_samples.size() + iterations);
+    for (size_t i = 0; i < iterations; i++)
+    {
+      clock::time_point start = clock::now();
+      op(i);
+      add(clock::now() - start);
+    }
+  }
+
+  /**
+   * @brief Add one sample timed by the caller, for operations that need untimed preparation
+   */
+  void add(clock::duration latency) { _samples.push_back(latency); }
+
+  /**
+   * @brief Extra number printed with the line; name has to be a literal
+   */
+  void field(const char *name, double value);
+
+  void report();
+
+private:
+  struct Field
+  {
+    const char *name;
+    double value;
+  };
+
+  const char *_name;
+  size_t _bytes;
+  std::vector<clock::duration> _samples;
+  std::vector<Field> _fields;
+};
+
+// one function per group of benchmarks, run in this order by app_main
+void bench_mount();
+void bench_core();
+void bench_batch();
+void bench_object();
+void bench_codec();
+void bench_counter();
@@ -0,0 +1,64 @@
+#include "bench.h"
+#include "counting_backend.h"
+
+#include <stdio.h>
+
+#define BATCH_ROUNDS 50
+
+struct BatchCase
+{
+  size_t keys;
+  const char *each_name;
+  const char *batch_name;
+};
+
+static const BatchCase cases[] = {
+    {10, "save_10_commit_each", "save_10_batch"},
+    {40, "save_40_commit_each", "save_40_batch"},
+    {200, "save_200_commit_each", "save_200_batch"},
+};
+
+// one save of count keys, every value changed so that no write is skipped
+static void save(Nvs &nvs, size_t count, uint32_t round)
+{
+  char key[NVS_KEY_NAME_MAX_SIZE];
+  for (size_t k = 0; k < count; k++)
+  {
+    snprintf(key, sizeof(key), "key%u", (unsigned)k);
+    nvs.setUInt32(key, round * count + k);
+  }
+}
+
+void bench_batch()
+{
+  // mounts the partition for the backend
+  Nvs mount(BENCH_PARTITION);
+
+  for (const BatchCase &c : cases)
+  {
+    size_t count = c.keys;
+    CountingBackend backend(BENCH_PARTITION);
+    Nvs nvs(backend, "batch");
+
+    // a commit per set, as with auto-commit
+    Bench each(c.each_name);
+    each.run(BATCH_ROUNDS, [&](size_t round)
+             { save(nvs, count, round); });
+    each.field("keys", count);
+    each.field("commits_per_save", (double)backend.commits / BATCH_ROUNDS);
+    each.report();
+
+    // one commit per save
+    backend.commits = 0;
+    Bench batched(c.batch_name);
+    batched.run(BATCH_ROUNDS, [&](size_t round)
+                {
+      NvsBatch batch(nvs);
+      save(nvs, count, BATCH_ROUNDS + round); });
+    batched.field("keys", count);
+    batched.field("commits_per_save", (double)backend.commits / BATCH_ROUNDS);
+    batched.report();
+
+    nvs.eraseAll();
+  }
+}
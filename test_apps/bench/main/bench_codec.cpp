@@ -0,0 +1,131 @@
+#include "bench.h"
+#include "NVS.h"
+#include "NvsCodec.h"
+
+#include <stdio.h>
+#include <vector>
+
+#define CODEC_ROUNDS 100
+
+// JSON text, length - 1 characters and the terminator
+static std::vector<uint8_t> json(size_t length)
+{
+  std::vector<uint8_t> text;
+  char record[96];
+  for (int i = 0; text.size() < length; i++)
+  {
+    int n = snprintf(record, sizeof(record), "{\"id\":%d,\"name\":\"sensor%d\",\"gain\":1.%03d,\"offset\":%d},",
+                     i, i % 16, (i * 37) % 1000, i % 7 - 3);
+    text.insert(text.end(), record, record + n);
+  }
+  text.resize(length);
+  text.back() = '\0';
+  return text;
+}
+
+// calibration table: a slowly changing curve of 16 bit samples
+static std::vector<uint8_t> table(size_t length)
+{
+  std::vector<uint8_t> data(length);
+  for (size_t i = 0; i + 1 < length; i += 2)
+  {
+    uint16_t sample = 1000 + (uint16_t)(i / 64);
+    data[i] = sample & 0xff;
+    data[i + 1] = sample >> 8;
+  }
+  return data;
+}
+
+struct CodecCase
+{
+  nvs_type_t type;
+  size_t length;
+  const char *name; // prefix of the line names
+};
+
+static const CodecCase cases[] = {
+    {NVS_TYPE_STR, 1024, "json_1k"},
+    {NVS_TYPE_STR, 3000, "json_3k"},
+    {NVS_TYPE_BLOB, 4096, "table_4k"},
+    {NVS_TYPE_BLOB, 16384, "table_16k"},
+};
+
+static esp_err_t store(Nvs &nvs, const CodecCase &c, const std::vector<uint8_t> &value)
+{
+  return c.type == NVS_TYPE_STR ? nvs.setCharArray("value", (const char *)value.data())
+                                : nvs.setObject("value", value.data(), value.size());
+}
+
+static esp_err_t load(Nvs &nvs, const CodecCase &c, std::vector<uint8_t> &buffer)
+{
+  size_t length = buffer.size();
+  return c.type == NVS_TYPE_STR ? nvs.getCharArray("value", (char *)buffer.data(), &length)
+                                : nvs.getObject("value", buffer.data(), &length);
+}
+
+static void bench_value(const CodecCase &c)
+{
+  char name[48];
+  std::vector<uint8_t> value = c.type == NVS_TYPE_STR ? json(c.length) : table(c.length);
+  std::vector<uint8_t> packed(c.length + NVS_CODEC_MARGIN(c.length));
+  static uint32_t hash_table[NVS_CODEC_TABLE_SIZE / sizeof(uint32_t)];
+
+  size_t stored = 0;
+  snprintf(name, sizeof(name), "%s_pack", c.name);
+  Bench pack(name, c.length);
+  pack.run(CODEC_ROUNDS, [&](size_t)
+           { stored = nvs_pack(c.type, value.data(), value.size(), packed.data(), packed.size(), hash_table); });
+  pack.field("ratio", stored > 0 ? (double)c.length / stored : 1);
+  pack.report();
+
+  // nvs_unpack() expands in place, every round starts from a copy of the packed value
+  std::vector<uint8_t> buffer(packed.size());
+  snprintf(name, sizeof(name), "%s_unpack", c.name);
+  Bench unpack(name, c.length);
+  for (int i = 0; i < CODEC_ROUNDS && stored > 0; i++)
+  {
+    memcpy(buffer.data(), packed.data(), stored);
+    size_t length;
+    Bench::clock::time_point start = Bench::clock::now();
+    nvs_unpack(buffer.data(), stored, buffer.size(), &length);
+    unpack.add(Bench::clock::now() - start);
+  }
+  unpack.report();
+
+  // the same value through the setters, stored as it is and compressed
+  for (size_t min_length : {(size_t)0, (size_t)64})
+  {
+    Nvs nvs(BENCH_PARTITION, "codec");
+    nvs.setCompression(min_length);
+    int errors = 0;
+
+    snprintf(name, sizeof(name), min_length == 0 ? "%s_set_plain" : "%s_set_packed", c.name);
+    Bench set(name, c.length);
+    set.run(CODEC_ROUNDS, [&](size_t i)
+            {
+      value[i % (value.size() - 1)] ^= 1; // a changed value is written every time
+      if (store(nvs, c, value) != ESP_OK)
+        errors++; });
+    set.field("stored", min_length == 0 || stored == 0 ? c.length : stored);
+    set.field("errors", errors);
+    set.report();
+
+    errors = 0;
+    snprintf(name, sizeof(name), min_length == 0 ? "%s_get_plain" : "%s_get_packed", c.name);
+    Bench get(name, c.length);
+    get.run(CODEC_ROUNDS, [&](size_t)
+            {
+      if (load(nvs, c, buffer) != ESP_OK)
+        errors++; });
+    get.field("errors", errors);
+    get.report();
+
+    nvs.eraseAll();
+  }
+}
+
+void bench_codec()
+{
+  for (const CodecCase &c : cases)
+    bench_value(c);
+}
@@ -0,0 +1,127 @@
+#include "bench.h"
+#include "NVS.h"
+
+#include <string.h>
+#include <vector>
+
+#define CORE_ITERATIONS 1000
+
+// a handful of keys written in turn, so the namespace doesn't grow with the iterations
+static const char *const keys[] = {"k0", "k1", "k2", "k3", "k4", "k5", "k6", "k7"};
+#define KEY(i) keys[(i) % (sizeof(keys) / sizeof(keys[0]))]
+
+template <typename T>
+static void bench_scalar(Nvs &nvs, const char *set_name, const char *get_name)
+{
+  Bench set(set_name);
+  set.run(CORE_ITERATIONS, [&](size_t i)
+          { nvs.set(KEY(i), (T)(i + 1)); });
+  set.report();
+
+  Bench get(get_name);
+  get.run(CORE_ITERATIONS, [&](size_t i)
+          { nvs.get(KEY(i), (T)0); });
+  get.report();
+}
+
+static void bench_scalars(Nvs &nvs)
+{
+  // one commit per set
+  bench_scalar<uint8_t>(nvs, "set_u8", "get_u8");
+  bench_scalar<int32_t>(nvs, "set_i32", "get_i32");
+  bench_scalar<uint64_t>(nvs, "set_u64", "get_u64");
+  bench_scalar<float>(nvs, "set_float", "get_float");
+
+  nvs.setAutoCommit(false);
+  Bench set("set_u32_no_commit");
+  set.run(CORE_ITERATIONS, [&](size_t i)
+          { nvs.setUInt32(KEY(i), i + 1); });
+  set.report();
+
+  // one changed key per commit
+  Bench commit("commit");
+  for (uint32_t i = 0; i < CORE_ITERATIONS; i++)
+  {
+    nvs.setUInt32(KEY(i), i + 7);
+    Bench::clock::time_point start = Bench::clock::now();
+    nvs.commit();
+    commit.add(Bench::clock::now() - start);
+  }
+  commit.report();
+  nvs.setAutoCommit(true);
+
+  nvs.setCache(true);
+  Bench cached("get_u32_cached");
+  cached.run(CORE_ITERATIONS, [&](size_t i)
+             { nvs.getUInt32(KEY(i), 0); });
+  cached.field("hit_rate", (double)nvs.cacheHits() / (nvs.cacheHits() + nvs.cacheMisses()));
+  cached.report();
+  nvs.setCache(false);
+}
+
+static void bench_data(Nvs &nvs)
+{
+  static const char *const str_names[] = {"set_str_32", "set_str_256", "set_str_1k", "set_str_4k"};
+  static const char *const get_str_names[] = {"get_str_32", "get_str_256", "get_str_1k", "get_str_4k"};
+  static const size_t str_sizes[] = {32, 256, 1024, 4000};
+  for (size_t s = 0; s < 4; s++)
+  {
+    std::vector<char> text(str_sizes[s], 'a');
+    text.back() = '\0';
+    Bench set(str_names[s], str_sizes[s]);
+    set.run(CORE_ITERATIONS / 4, [&](size_t i)
+            {
+      text[i % (text.size() - 1)]++;
+      nvs.setCharArray(KEY(i), text.data()); });
+    set.report();
+
+    Bench get(get_str_names[s], str_sizes[s]);
+    get.run(CORE_ITERATIONS / 4, [&](size_t i)
+            { nvs.getString(KEY(i)); });
+    get.report();
+  }
+
+  static const char *const blob_names[] = {"set_blob_32", "set_blob_512", "set_blob_4k", "set_blob_16k"};
+  static const char *const get_blob_names[] = {"get_blob_32", "get_blob_512", "get_blob_4k", "get_blob_16k"};
+  static const size_t blob_sizes[] = {32, 512, 4096, 16384};
+  for (size_t s = 0; s < 4; s++)
+  {
+    std::vector<uint8_t> blob(blob_sizes[s], 0x5a);
+    std::vector<uint8_t> buffer(blob_sizes[s]);
+    Bench set(blob_names[s], blob_sizes[s]);
+    set.run(CORE_ITERATIONS / 4, [&](size_t i)
+            {
+      blob[i % blob.size()]++;
+      nvs.setObject(KEY(i), blob.data(), blob.size()); });
+    set.report();
+
+    Bench get(get_blob_names[s], blob_sizes[s]);
+    get.run(CORE_ITERATIONS / 4, [&](size_t i)
+            { nvs.getObject(KEY(i), buffer); });
+    get.report();
+  }
+}
+
+static void bench_erase(Nvs &nvs)
+{
+  Bench erase("erase");
+  for (uint32_t i = 0; i < CORE_ITERATIONS; i++)
+  {
+    nvs.setUInt32(KEY(i), i);
+    Bench::clock::time_point start = Bench::clock::now();
+    nvs.erase(KEY(i));
+    erase.add(Bench::clock::now() - start);
+  }
+  erase.report();
+}
+
+void bench_core()
+{
+  Nvs nvs(BENCH_PARTITION, "core");
+  bench_scalars(nvs);
+  nvs.eraseAll();
+  bench_data(nvs);
+  nvs.eraseAll();
+  bench_erase(nvs);
+  nvs.eraseAll();
+}
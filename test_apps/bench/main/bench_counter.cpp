@@ -0,0 +1,54 @@
+#include "bench.h"
+#include "NVS.h"
+#include "NvsRingLog.h"
+#include "sdkconfig.h"
+
+#if CONFIG_ESP_PARTITION_ENABLE_STATS
+#include "esp_private/partition_linux.h"
+#endif
+
+#define COUNTER_INCREMENTS 10000
+
+// flash writes and sector erases of the emulated partitions per increment, the wear of each path
+static void wear_fields(Bench &bench)
+{
+#if CONFIG_ESP_PARTITION_ENABLE_STATS
+  bench.field("writes_per_op", (double)esp_partition_get_write_ops() / COUNTER_INCREMENTS);
+  bench.field("bytes_per_op", (double)esp_partition_get_write_bytes() / COUNTER_INCREMENTS);
+  bench.field("erases_per_1k_ops", (double)esp_partition_get_erase_ops() * 1000 / COUNTER_INCREMENTS);
+  esp_partition_clear_stats();
+#endif
+}
+
+void bench_counter()
+{
+  Nvs nvs(BENCH_PARTITION, "counter");
+#if CONFIG_ESP_PARTITION_ENABLE_STATS
+  esp_partition_clear_stats();
+#endif
+
+  // read, add and store with a commit, as a counter kept in NVS
+  Bench entry("counter_set_u32");
+  entry.run(COUNTER_INCREMENTS, [&](size_t)
+            { nvs.setUInt32("boots", nvs.getUInt32("boots", 0) + 1); });
+  wear_fields(entry);
+  entry.report();
+  nvs.eraseAll();
+#if CONFIG_ESP_PARTITION_ENABLE_STATS
+  esp_partition_clear_stats();
+#endif
+
+  NvsCounter counter(BENCH_COUNTER_PARTITION);
+  Bench ring("counter_add");
+  ring.run(COUNTER_INCREMENTS, [&](size_t)
+           { counter.add(1); });
+  wear_fields(ring);
+  ring.field("value", counter.value());
+  ring.report();
+
+  // the scan of the constructor, over a log that wrapped
+  Bench open("counter_open");
+  open.run(100, [](size_t)
+           { NvsCounter reopened(BENCH_COUNTER_PARTITION); });
+  open.report();
+}
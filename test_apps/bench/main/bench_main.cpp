@@ -0,0 +1,23 @@
+#include "bench.h"
+#include "esp_partition.h"
+#include "nvs_flash.h"
+
+#include <stdlib.h>
+
+extern "C" void app_main(void)
+{
+  // every run starts from empty partitions
+  nvs_flash_erase_partition(BENCH_PARTITION);
+  const esp_partition_t *counters = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY,
+                                                             BENCH_COUNTER_PARTITION);
+  if (counters != NULL)
+    esp_partition_erase_range(counters, 0, counters->size);
+
+  bench_mount();
+  bench_core();
+  bench_batch();
+  bench_object();
+  bench_codec();
+  bench_counter();
+  exit(0);
+}
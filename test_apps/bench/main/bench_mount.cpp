@@ -0,0 +1,39 @@
+#include "bench.h"
+#include "NVS.h"
+
+#include <stdio.h>
+
+#define MOUNT_ITERATIONS 200
+#define MOUNT_KEYS 200
+
+void bench_mount()
+{
+  // entries for the mount to scan
+  {
+    Nvs nvs(BENCH_PARTITION, "mount");
+    NvsBatch batch(nvs);
+    char key[NVS_KEY_NAME_MAX_SIZE];
+    for (uint32_t k = 0; k < MOUNT_KEYS; k++)
+    {
+      snprintf(key, sizeof(key), "key%u", (unsigned)k);
+      nvs.setUInt32(key, k);
+    }
+  }
+
+  // nothing else has the partition mounted: every instance mounts and unmounts it
+  Bench cold("open_cold");
+  cold.run(MOUNT_ITERATIONS, [](size_t)
+           { Nvs nvs(BENCH_PARTITION, "mount"); });
+  cold.field("entries", MOUNT_KEYS);
+  cold.report();
+
+  // a long-lived instance keeps it mounted, the others only open a namespace
+  Nvs keeper(BENCH_PARTITION);
+  Bench shared("open_shared");
+  shared.run(MOUNT_ITERATIONS, [](size_t)
+             { Nvs nvs(BENCH_PARTITION, "mount"); });
+  shared.field("entries", MOUNT_KEYS);
+  shared.report();
+
+  Nvs(BENCH_PARTITION, "mount").eraseAll();
+}
@@ -0,0 +1,68 @@
+#include "bench.h"
+#include "NVS.h"
+#include "NvsObject.h"
+
+#include <algorithm>
+#include <string.h>
+
+#define OBJECT_CHUNK 4096
+#define OBJECT_PIECE 1024
+
+struct ObjectCase
+{
+  size_t size;
+  int rounds;
+  const char *write_name;
+  const char *read_name;
+};
+
+static const ObjectCase cases[] = {
+    {1024, 50, "object_write_1k", "object_read_1k"},
+    {16 * 1024, 20, "object_write_16k", "object_read_16k"},
+    {64 * 1024, 10, "object_write_64k", "object_read_64k"},
+    {256 * 1024, 4, "object_write_256k", "object_read_256k"},
+};
+
+void bench_object()
+{
+  static uint8_t chunk[OBJECT_CHUNK];
+  uint8_t piece[OBJECT_PIECE];
+  Nvs nvs(BENCH_PARTITION, "object");
+
+  for (const ObjectCase &c : cases)
+  {
+    int errors = 0;
+
+    // every write goes to the other generation, the previous object is dropped by finish()
+    Bench write(c.write_name, c.size);
+    write.run(c.rounds, [&](size_t round)
+              {
+      NvsObjectWriter writer(nvs, "object", chunk);
+      for (size_t offset = 0; offset < c.size; offset += OBJECT_PIECE)
+      {
+        memset(piece, (int)(round + offset / OBJECT_PIECE), OBJECT_PIECE);
+        writer.write(piece, std::min((size_t)OBJECT_PIECE, c.size - offset));
+      }
+      if (writer.finish() != ESP_OK)
+        errors++; });
+    write.field("chunk", OBJECT_CHUNK);
+    write.field("errors", errors);
+    write.report();
+
+    errors = 0;
+    Bench read(c.read_name, c.size);
+    read.run(c.rounds, [&](size_t)
+             {
+      NvsObjectReader reader(nvs, "object", chunk);
+      size_t n = sizeof(piece);
+      while (reader.read(piece, &n) == ESP_OK && n > 0)
+        n = sizeof(piece);
+      if (reader.last_error() != ESP_OK)
+        errors++; });
+    read.field("chunk", OBJECT_CHUNK);
+    read.field("errors", errors);
+    read.report();
+
+    nvs.eraseAll();
+  }
+}
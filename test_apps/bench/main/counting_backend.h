@@ -0,0 +1,22 @@
+#pragma once
+
+#include "NVS.h"
+
+/**
+ * @brief NvsFlashBackend that counts the commits reaching nvs_flash
+ *
+ * The partition has to be mounted by an Nvs opened on it for as long as this is used.
+ */
+class CountingBackend : public NvsFlashBackend
+{
+public:
+  int commits = 0;
+
+  explicit CountingBackend(const char *partition_label) : NvsFlashBackend(partition_label) {}
+
+  esp_err_t commit(nvs_handle_t handle) override
+  {
+    commits++;
+    return NvsFlashBackend::commit(handle);
+  }
+};
@@ -0,0 +1,42 @@
+#pragma once
+
+#include "NVS.h"
+
+#include <vector>
+
+/**
+ * @brief NvsRamBackend that records the writes and commits reaching it, in order
+ */
+class CountingBackend : public NvsRamBackend
+{
+public:
+  struct Write
+  {
+    char key[NVS_KEY_NAME_MAX_SIZE];
+    uint64_t value;
+  };
+
+  std::vector<Write> writes;
+  int commits = 0;
+
+  esp_err_t setScalar(nvs_handle_t handle, const char *key, nvs_type_t type, uint64_t value) override
+  {
+    Write write = {};
+    strcpy(write.key, key);
+    write.value = value;
+    writes.push_back(write);
+    return NvsRamBackend::setScalar(handle, key, type, value);
+  }
+
+  esp_err_t commit(nvs_handle_t handle) override
+  {
+    commits++;
+    return NvsRamBackend::commit(handle);
+  }
+
+  void reset()
+  {
+    writes.clear();
+    commits = 0;
+  }
+};
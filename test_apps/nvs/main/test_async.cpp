@@ -0,0 +1,98 @@
+#include "counting_backend.h"
+#include "unity.h"
+
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+static std::atomic<int> completed;
+static std::atomic<int> failed;
+
+static void count_result(const char *key, esp_err_t err, void *arg)
+{
+  completed++;
+  if (err != ESP_OK)
+    failed++;
+}
+
+// retries while the queue is full
+static void set_queued(Nvs &nvs, const char *key, uint32_t value)
+{
+  esp_err_t err;
+  while ((err = nvs.set(key, value, count_result)) == ESP_ERR_NO_MEM)
+    std::this_thread::yield();
+  TEST_ASSERT_EQUAL(ESP_OK, err);
+}
+
+TEST_CASE("async writes follow auto-commit and batches", "[async]")
+{
+  CountingBackend backend;
+  Nvs nvs(backend, "async");
+  nvs.setAutoCommit(false);
+  nvs.setAsync(true);
+  completed = 0;
+
+  for (uint32_t i = 0; i < 100; i++)
+    set_queued(nvs, "count", i);
+  TEST_ASSERT_EQUAL(ESP_OK, nvs.flush());
+  TEST_ASSERT_EQUAL(100, completed.load());
+  TEST_ASSERT_EQUAL(0, backend.commits);
+  TEST_ASSERT_EQUAL(ESP_OK, nvs.commit());
+  TEST_ASSERT_EQUAL(1, backend.commits);
+
+  nvs.setAutoCommit(true);
+  {
+    NvsBatch batch(nvs);
+    set_queued(nvs, "a", 1);
+    set_queued(nvs, "b", 2);
+    nvs.flush();
+    TEST_ASSERT_EQUAL(1, backend.commits);
+  }
+  TEST_ASSERT_EQUAL(2, backend.commits);
+  nvs.setAsync(false);
+
+  Nvs reader(backend, "async");
+  TEST_ASSERT_EQUAL(99, reader.getUInt32("count", 0));
+  TEST_ASSERT_EQUAL(2, reader.getUInt32("b", 0));
+}
+
+TEST_CASE("async mode can be disabled while other threads write", "[async]")
+{
+  NvsRamBackend backend;
+  Nvs nvs(backend, "async");
+  nvs.setAsync(true);
+  completed = 0;
+  failed = 0;
+
+  const int writes = 2000;
+  std::vector<std::thread> writers;
+  for (int t = 0; t < 4; t++)
+  {
+    writers.emplace_back([&, t]
+                         {
+      std::string key = "w" + std::to_string(t);
+      for (uint32_t i = 1; i <= writes; i++)
+        set_queued(nvs, key.c_str(), i); });
+  }
+  while (completed < writes)
+    std::this_thread::yield();
+  nvs.setAsync(false);
+  TEST_ASSERT_FALSE(nvs.async());
+  for (std::thread &writer : writers)
+    writer.join();
+
+  // every write reported exactly once, the later ones synchronously
+  TEST_ASSERT_EQUAL(4 * writes, completed.load());
+  TEST_ASSERT_EQUAL(0, failed.load());
+  Nvs reader(backend, "async");
+  for (int t = 0; t < 4; t++)
+    TEST_ASSERT_EQUAL(writes, reader.getUInt32(("w" + std::to_string(t)).c_str(), 0));
+
+  // and enabled again
+  nvs.setAsync(true);
+  set_queued(nvs, "w0", 1);
+  TEST_ASSERT_EQUAL(1, nvs.getUInt32("w0", 0));
+  TEST_ASSERT_EQUAL(ESP_OK, nvs.flush());
+  TEST_ASSERT_EQUAL(1, reader.getUInt32("w0", 0));
+}
@@ -0,0 +1,153 @@
+#include "NVS.h"
+#include "unity.h"
+
+#include <stdio.h>
+#include <unistd.h>
+
+#define FILE_PATH "/tmp/nvs_test_backend.nvsf"
+
+struct Calibration
+{
+  int16_t offset;
+  float gain;
+};
+
+static void write_values(Nvs &nvs)
+{
+  TEST_ASSERT_EQUAL(ESP_OK, nvs.setBoolean("flag", true));
+  TEST_ASSERT_EQUAL(ESP_OK, nvs.setUInt8("u8", 200));
+  TEST_ASSERT_EQUAL(ESP_OK, nvs.setInt16("i16", -1234));
+  TEST_ASSERT_EQUAL(ESP_OK, nvs.setUInt32("u32", 4000000000u));
+  TEST_ASSERT_EQUAL(ESP_OK, nvs.setInt64("i64", -5000000000ll));
+  TEST_ASSERT_EQUAL(ESP_OK, nvs.setFloat("gain", 1.5f));
+  TEST_ASSERT_EQUAL(ESP_OK, nvs.setDouble("ratio", 0.125));
+  TEST_ASSERT_EQUAL(ESP_OK, nvs.setCharArray("name", "device"));
+  Calibration calibration = {-3, 0.5f};
+  TEST_ASSERT_EQUAL(ESP_OK, nvs.set("calib", calibration));
+}
+
+static void check_values(Nvs &nvs)
+{
+  TEST_ASSERT_TRUE(nvs.getBoolean("flag", false));
+  TEST_ASSERT_EQUAL(200, nvs.getUInt8("u8", 0));
+  TEST_ASSERT_EQUAL(-1234, nvs.getInt16("i16", 0));
+  TEST_ASSERT_EQUAL(4000000000u, nvs.getUInt32("u32", 0));
+  TEST_ASSERT_EQUAL(-5000000000ll, nvs.getInt64("i64", 0));
+  TEST_ASSERT_EQUAL_FLOAT(1.5f, nvs.getFloat("gain", 0));
+  TEST_ASSERT_EQUAL_DOUBLE(0.125, nvs.getDouble("ratio", 0));
+  char name[16];
+  TEST_ASSERT_EQUAL(ESP_OK, nvs.getCharArray("name", name));
+  TEST_ASSERT_EQUAL_STRING("device", name);
+  Calibration calibration = {};
+  TEST_ASSERT_EQUAL(ESP_OK, nvs.read("calib", &calibration));
+  TEST_ASSERT_EQUAL(-3, calibration.offset);
+  TEST_ASSERT_EQUAL_FLOAT(0.5f, calibration.gain);
+}
+
+TEST_CASE("RAM backend round-trips every value type", "[backend]")
+{
+  NvsRamBackend ram;
+  {
+    Nvs nvs(ram, "config");
+    TEST_ASSERT_EQUAL(ESP_OK, nvs.last_error());
+    write_values(nvs);
+  }
+  Nvs nvs(ram, "config");
+  check_values(nvs);
+  TEST_ASSERT_EQUAL(9, ram.size());
+
+  size_t count = 0;
+  for (const NvsEntry &entry : nvs.entries())
+  {
+    TEST_ASSERT_EQUAL_STRING("config", entry.namespaceName());
+    count++;
+  }
+  TEST_ASSERT_EQUAL(9, count);
+}
+
+TEST_CASE("RAM backend mirrors nvs_flash errors", "[backend]")
+{
+  NvsRamBackend ram;
+  Nvs nvs(ram, "config");
+  nvs.setUInt16("size", 4096);
+
+  uint32_t wrong_type;
+  TEST_ASSERT_EQUAL(ESP_ERR_NVS_NOT_FOUND, nvs.read("size", &wrong_type));
+  TEST_ASSERT_EQUAL(ESP_ERR_NVS_NOT_FOUND, nvs.read("missing", &wrong_type));
+
+  nvs.setCharArray("name", "device");
+  size_t length = 0;
+  TEST_ASSERT_EQUAL(ESP_OK, nvs.getCharArray("name", NULL, &length));
+  TEST_ASSERT_EQUAL(7, length);
+  char small[4];
+  length = sizeof(small);
+  TEST_ASSERT_EQUAL(ESP_ERR_NVS_INVALID_LENGTH, nvs.getCharArray("name", small, &length));
+
+  Nvs read_only(ram, "config", NVS_READONLY);
+  TEST_ASSERT_EQUAL(4096, read_only.getUInt16("size", 0));
+  TEST_ASSERT_EQUAL(ESP_ERR_NVS_READ_ONLY, read_only.setUInt16("size", 1));
+
+  // namespaces are separate
+  Nvs other(ram, "other");
+  TEST_ASSERT_FALSE(other.exists("size"));
+
+  TEST_ASSERT_EQUAL(ESP_OK, nvs.eraseAll());
+  TEST_ASSERT_FALSE(nvs.exists("size"));
+  TEST_ASSERT_EQUAL(0, ram.size());
+}
+
+TEST_CASE("file backend keeps committed values across reopening", "[backend]")
+{
+  unlink(FILE_PATH);
+  {
+    NvsFileBackend file(FILE_PATH);
+    TEST_ASSERT_EQUAL(ESP_OK, file.last_error());
+    Nvs nvs(file, "config");
+    write_values(nvs);
+  }
+
+  {
+    NvsFileBackend file(FILE_PATH);
+    TEST_ASSERT_EQUAL(ESP_OK, file.last_error());
+    Nvs nvs(file, "config");
+    check_values(nvs);
+
+    // a second commit replaces the file as a whole
+    TEST_ASSERT_EQUAL(ESP_OK, nvs.setUInt8("u8", 7));
+    TEST_ASSERT_EQUAL(ESP_OK, nvs.erase("name"));
+    TEST_ASSERT_EQUAL(-1, access(FILE_PATH ".tmp", F_OK));
+  }
+
+  NvsFileBackend file(FILE_PATH);
+  Nvs nvs(file, "config");
+  TEST_ASSERT_EQUAL(7, nvs.getUInt8("u8", 0));
+  TEST_ASSERT_FALSE(nvs.exists("name"));
+  TEST_ASSERT_EQUAL(8, file.size());
+  unlink(FILE_PATH);
+}
+
+TEST_CASE("file backend refuses to overwrite a damaged file", "[backend]")
+{
+  unlink(FILE_PATH);
+  {
+    NvsFileBackend file(FILE_PATH);
+    Nvs nvs(file, "config");
+    write_values(nvs);
+  }
+
+  // flip a byte in the middle of the image
+  FILE *stream = fopen(FILE_PATH, "r+b");
+  TEST_ASSERT_NOT_NULL(stream);
+  fseek(stream, 20, SEEK_SET);
+  int c = fgetc(stream);
+  fseek(stream, 20, SEEK_SET);
+  fputc(c ^ 0xff, stream);
+  fclose(stream);
+
+  NvsFileBackend file(FILE_PATH);
+  TEST_ASSERT_EQUAL(ESP_ERR_INVALID_CRC, file.last_error());
+  Nvs nvs(file, "config");
+  TEST_ASSERT_FALSE(nvs.exists("u8"));
+  TEST_ASSERT_EQUAL(ESP_ERR_INVALID_CRC, nvs.setUInt8("u8", 1));
+  unlink(FILE_PATH);
+}
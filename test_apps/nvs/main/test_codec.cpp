@@ -0,0 +1,113 @@
+#include "NVS.h"
+#include "unity.h"
+
+#include <string.h>
+
+struct Curve
+{
+  uint16_t points[256];
+};
+
+TEST_CASE("get() reads a struct that set() stored compressed", "[codec]")
+{
+  NvsRamBackend backend;
+  Nvs nvs(backend, "codec");
+  nvs.setCompression(16);
+
+  Curve curve;
+  for (size_t i = 0; i < 256; i++)
+    curve.points[i] = 1000 + i / 32;
+  TEST_ASSERT_EQUAL(ESP_OK, nvs.set("curve", curve));
+
+  // stored packed
+  nvs_handle_t handle;
+  TEST_ASSERT_EQUAL(ESP_OK, backend.open("codec", NVS_READONLY, &handle));
+  size_t stored = 0;
+  TEST_ASSERT_EQUAL(ESP_OK, backend.getBlob(handle, "curve", NULL, &stored));
+  backend.close(handle);
+  TEST_ASSERT_LESS_THAN(sizeof(Curve), stored);
+
+  Curve loaded = {};
+  TEST_ASSERT_EQUAL(ESP_OK, nvs.read("curve", &loaded));
+  TEST_ASSERT_EQUAL_MEMORY(&curve, &loaded, sizeof(Curve));
+
+  Nvs reader(backend, "codec");
+  Curve none = {};
+  Curve got = reader.get("curve", none);
+  TEST_ASSERT_EQUAL_MEMORY(&curve, &got, sizeof(Curve));
+}
+
+/**
+ * @brief NvsRamBackend whose blob writes fail on demand
+ */
+class FailingBlobBackend : public NvsRamBackend
+{
+public:
+  bool fail = false;
+
+  esp_err_t setBlob(nvs_handle_t handle, const char *key, const void *value, size_t length) override
+  {
+    if (fail)
+      return ESP_ERR_NVS_NOT_ENOUGH_SPACE;
+    return NvsRamBackend::setBlob(handle, key, value, length);
+  }
+};
+
+TEST_CASE("a failed compressed write keeps the previous string", "[codec]")
+{
+  FailingBlobBackend backend;
+  Nvs nvs(backend, "codec");
+  TEST_ASSERT_EQUAL(ESP_OK, nvs.setCharArray("layout", "previous"));
+
+  char json[512];
+  memset(json, 'x', sizeof(json) - 1);
+  json[sizeof(json) - 1] = '\0';
+  nvs.setCompression(16);
+  backend.fail = true;
+  TEST_ASSERT_NOT_EQUAL(ESP_OK, nvs.setCharArray("layout", json));
+
+  char buffer[64];
+  size_t length = sizeof(buffer);
+  TEST_ASSERT_EQUAL(ESP_OK, nvs.getCharArray("layout", buffer, &length));
+  TEST_ASSERT_EQUAL_STRING("previous", buffer);
+
+  backend.fail = false;
+  TEST_ASSERT_EQUAL(ESP_OK, nvs.setCharArray("layout", json));
+  TEST_ASSERT_EQUAL(1, backend.size());
+}
+
+TEST_CASE("a size query returns the room a compressed value expands into", "[codec]")
+{
+  NvsRamBackend backend;
+  Nvs nvs(backend, "codec");
+  nvs.setCompression(16);
+
+  char json[600];
+  memset(json, 'y', sizeof(json) - 1);
+  json[sizeof(json) - 1] = '\0';
+  TEST_ASSERT_EQUAL(ESP_OK, nvs.setCharArray("layout", json));
+  uint8_t blob[300];
+  memset(blob, 3, sizeof(blob));
+  TEST_ASSERT_EQUAL(ESP_OK, nvs.setObject("blob", blob, sizeof(blob)));
+
+  // query, allocate, read
+  size_t length = 0;
+  TEST_ASSERT_EQUAL(ESP_OK, nvs.getCharArray("layout", NULL, &length));
+  TEST_ASSERT_GREATER_OR_EQUAL(sizeof(json), length);
+  char *text = (char *)malloc(length);
+  TEST_ASSERT_EQUAL(ESP_OK, nvs.getCharArray("layout", text, &length));
+  TEST_ASSERT_EQUAL(sizeof(json), length);
+  TEST_ASSERT_EQUAL_STRING(json, text);
+  free(text);
+
+  length = 0;
+  TEST_ASSERT_EQUAL(ESP_OK, nvs.getObject("blob", NULL, &length));
+  uint8_t *data = (uint8_t *)malloc(length);
+  TEST_ASSERT_EQUAL(ESP_OK, nvs.getObject("blob", data, &length));
+  TEST_ASSERT_EQUAL(sizeof(blob), length);
+  TEST_ASSERT_EQUAL_MEMORY(blob, data, sizeof(blob));
+  free(data);
+
+  // a packed blob is no string
+  TEST_ASSERT_EQUAL(ESP_ERR_NVS_NOT_FOUND, nvs.getCharArray("blob", NULL, &length));
+}
@@ -0,0 +1,79 @@
+#include "NVS.h"
+#include "unity.h"
+
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+// more keys than the cache holds, so readers keep missing and filling it
+#define STRESS_KEYS 64
+#define STRESS_WRITES 5000
+
+static std::string stress_key(int i)
+{
+  return "k" + std::to_string(i);
+}
+
+TEST_CASE("concurrent readers and writers see consistent values", "[concurrency]")
+{
+  NvsRamBackend backend;
+  Nvs nvs(backend, "stress");
+  nvs.setCache(true);
+  nvs.setConcurrent(true);
+  for (int i = 0; i < STRESS_KEYS; i++)
+    TEST_ASSERT_EQUAL(ESP_OK, nvs.setUInt32(stress_key(i).c_str(), 0));
+
+  std::atomic<bool> stop = false;
+  std::atomic<int> failures = 0;
+  std::vector<std::thread> readers;
+  for (int t = 0; t < 4; t++)
+  {
+    readers.emplace_back([&, t]
+                         {
+      while (!stop)
+      {
+        for (int i = t; i < STRESS_KEYS; i += 3)
+        {
+          // writers only store even values
+          uint32_t value;
+          if (nvs.read(stress_key(i).c_str(), &value) != ESP_OK || value % 2 != 0)
+            failures++;
+        }
+      } });
+  }
+
+  // each writer owns half of the keys
+  std::vector<std::thread> writers;
+  for (int t = 0; t < 2; t++)
+  {
+    writers.emplace_back([&, t]
+                         {
+      for (uint32_t n = 1; n <= STRESS_WRITES; n++)
+      {
+        int i = t + 2 * (n % (STRESS_KEYS / 2));
+        if (nvs.setUInt32(stress_key(i).c_str(), 2 * n) != ESP_OK)
+          failures++;
+      } });
+  }
+  for (std::thread &writer : writers)
+    writer.join();
+  stop = true;
+  for (std::thread &reader : readers)
+    reader.join();
+  TEST_ASSERT_EQUAL(0, failures.load());
+
+  // the cache agrees with flash
+  Nvs uncached(backend, "stress");
+  for (int i = 0; i < STRESS_KEYS; i++)
+  {
+    uint32_t last = 0;
+    for (uint32_t n = 1; n <= STRESS_WRITES; n++)
+    {
+      if ((int)(i % 2 + 2 * (n % (STRESS_KEYS / 2))) == i)
+        last = 2 * n;
+    }
+    TEST_ASSERT_EQUAL(last, nvs.getUInt32(stress_key(i).c_str(), 1));
+    TEST_ASSERT_EQUAL(last, uncached.getUInt32(stress_key(i).c_str(), 1));
+  }
+}
@@ -0,0 +1,25 @@
+#include "counting_backend.h"
+#include "unity.h"
+
+TEST_CASE("an unchanged integer is only skipped against the cache", "[elide]")
+{
+  CountingBackend backend;
+  Nvs nvs(backend, "elide");
+
+  // without the cache every set is a write, nothing is read first
+  TEST_ASSERT_EQUAL(ESP_OK, nvs.setUInt32("brightness", 80));
+  TEST_ASSERT_EQUAL(ESP_OK, nvs.setUInt32("brightness", 80));
+  TEST_ASSERT_EQUAL(2, backend.writes.size());
+  TEST_ASSERT_EQUAL(0, nvs.elidedWrites());
+
+  nvs.setCache(true);
+  TEST_ASSERT_EQUAL(ESP_OK, nvs.setUInt32("brightness", 80));
+  TEST_ASSERT_EQUAL(ESP_OK, nvs.setUInt32("brightness", 80));
+  TEST_ASSERT_EQUAL(2, backend.writes.size());
+  TEST_ASSERT_EQUAL(2, nvs.elidedWrites());
+  TEST_ASSERT_EQUAL(2, backend.commits);
+
+  TEST_ASSERT_EQUAL(ESP_OK, nvs.setUInt32("brightness", 60));
+  TEST_ASSERT_EQUAL(3, backend.writes.size());
+  TEST_ASSERT_EQUAL(60, nvs.getUInt32("brightness", 0));
+}
@@ -0,0 +1,160 @@
+#include "NVS.h"
+#include "unity.h"
+
+#include <random>
+#include <string>
+#include <vector>
+
+#define IMAGE_PAGES 16
+
+struct Expected
+{
+  std::string space;
+  std::string key;
+  nvs_type_t type;
+  uint64_t bits;
+  std::string data;
+};
+
+TEST_CASE("images written by NvsImageBuilder are read back by NvsImage", "[image]")
+{
+  std::mt19937 random(1);
+  int checked = 0;
+
+  for (int round = 0; round < 100; round++)
+  {
+    std::vector<uint8_t> image(NVS_PAGE_SIZE * IMAGE_PAGES);
+    NvsImageBuilder builder(image);
+    std::vector<Expected> expected;
+    esp_err_t err = ESP_OK;
+
+    for (int n = 0; n < 3 && err == ESP_OK; n++)
+    {
+      std::string space = "ns" + std::to_string(n);
+      TEST_ASSERT_EQUAL(ESP_OK, builder.setNamespace(space.c_str()));
+      int count = random() % 20;
+      for (int i = 0; i < count && err == ESP_OK; i++)
+      {
+        Expected value = {space, "k" + std::to_string(i), NVS_TYPE_I32, 0, ""};
+        switch (random() % 4)
+        {
+        case 0:
+          value.bits = (uint64_t)(int64_t)(int32_t)random();
+          err = builder.add(NvsValue::of(NvsKey::dynamic(value.key.c_str()), (int32_t)value.bits));
+          break;
+        case 1:
+          value.type = NVS_TYPE_FLOAT;
+          value.bits = std::bit_cast<uint32_t>((float)random() / 7);
+          err = builder.add(NvsValue::of(NvsKey::dynamic(value.key.c_str()), std::bit_cast<float>((uint32_t)value.bits)));
+          break;
+        case 2:
+          value.type = NVS_TYPE_STR;
+          value.data.assign(random() % 4000, 'a' + random() % 26);
+          err = builder.add(NvsValue::of(NvsKey::dynamic(value.key.c_str()), value.data.c_str()));
+          break;
+        default:
+          // up to a few pages, split in chunks
+          value.type = NVS_TYPE_BLOB;
+          for (size_t j = random() % 9000; j > 0; j--)
+            value.data += (char)random();
+          err = builder.add(NvsValue::blob(NvsKey::dynamic(value.key.c_str()), value.data.data(), value.data.size()));
+          break;
+        }
+        if (err == ESP_OK)
+          expected.push_back(value);
+      }
+    }
+
+    if (err == ESP_ERR_NVS_NOT_ENOUGH_SPACE)
+    {
+      TEST_ASSERT_EQUAL(ESP_ERR_NVS_NOT_ENOUGH_SPACE, builder.finish());
+      continue;
+    }
+    TEST_ASSERT_EQUAL(ESP_OK, err);
+    TEST_ASSERT_EQUAL(ESP_OK, builder.finish());
+    TEST_ASSERT_LESS_THAN(IMAGE_PAGES, builder.pagesUsed());
+
+    // the last page is left to nvs_flash
+    for (size_t i = NVS_PAGE_SIZE * (IMAGE_PAGES - 1); i < image.size(); i++)
+      TEST_ASSERT_EQUAL(0xff, image[i]);
+
+    NvsImage parsed(std::span<const uint8_t>(image.data(), image.size()));
+    TEST_ASSERT_EQUAL(ESP_OK, parsed.last_error());
+    TEST_ASSERT_EQUAL(0, parsed.damaged());
+
+    for (const Expected &value : expected)
+    {
+      Nvs nvs(parsed, value.space.c_str(), NVS_READONLY);
+      TEST_ASSERT_EQUAL(ESP_OK, nvs.last_error());
+      const char *key = value.key.c_str();
+      if (value.type == NVS_TYPE_I32)
+        TEST_ASSERT_EQUAL((int32_t)value.bits, nvs.getInt32(key, 0));
+      else if (value.type == NVS_TYPE_FLOAT)
+        TEST_ASSERT_EQUAL(value.bits, std::bit_cast<uint32_t>(nvs.getFloat(key, 0)));
+      else if (value.type == NVS_TYPE_STR)
+      {
+        NvsString text = nvs.getString(key);
+        TEST_ASSERT_NOT_NULL(text.get());
+        TEST_ASSERT_EQUAL_STRING(value.data.c_str(), text.get());
+        std::string_view view;
+        TEST_ASSERT_EQUAL(ESP_OK, parsed.getStringView(value.space.c_str(), key, &view));
+        TEST_ASSERT_TRUE(view == value.data);
+      }
+      else
+      {
+        size_t length = 0;
+        NvsBlob blob = nvs.getBlob(key, &length);
+        TEST_ASSERT_EQUAL(value.data.size(), length);
+        if (length > 0)
+          TEST_ASSERT_EQUAL_MEMORY(value.data.data(), blob.get(), length);
+      }
+      checked++;
+    }
+  }
+  TEST_ASSERT_GREATER_THAN(500, checked);
+}
+
+TEST_CASE("NvsImage skips a damaged entry of a built image", "[image]")
+{
+  std::vector<uint8_t> image(NVS_PAGE_SIZE * 2);
+  NvsImageBuilder builder(image);
+  TEST_ASSERT_EQUAL(ESP_OK, builder.setNamespace("factory"));
+  TEST_ASSERT_EQUAL(ESP_OK, builder.add(NvsValue::of("serial", (uint32_t)1234)));
+  TEST_ASSERT_EQUAL(ESP_OK, builder.add(NvsValue::of("model", "sensor")));
+  TEST_ASSERT_EQUAL(ESP_OK, builder.finish());
+  TEST_ASSERT_EQUAL(1, builder.pagesUsed());
+
+  // entry 0 is the namespace, entry 1 the serial number: flip a bit of its value
+  image[NVS_PAGE_FIRST_ENTRY + NVS_ENTRY_SIZE + 24] ^= 1;
+
+  NvsImage parsed(std::span<const uint8_t>(image.data(), image.size()));
+  TEST_ASSERT_EQUAL(ESP_OK, parsed.last_error());
+  TEST_ASSERT_EQUAL(1, parsed.damaged());
+  Nvs nvs(parsed, "factory", NVS_READONLY);
+  TEST_ASSERT_FALSE(nvs.exists("serial"));
+  std::string_view model;
+  TEST_ASSERT_EQUAL(ESP_OK, parsed.getStringView("factory", "model", &model));
+  TEST_ASSERT_TRUE(model == "sensor");
+}
+
+TEST_CASE("NvsImageBuilder rejects invalid input", "[image]")
+{
+  std::vector<uint8_t> one_page(NVS_PAGE_SIZE);
+  NvsImageBuilder too_small(one_page);
+  TEST_ASSERT_EQUAL(ESP_ERR_INVALID_STATE, too_small.setNamespace("x"));
+
+  std::vector<uint8_t> image(NVS_PAGE_SIZE * 2);
+  NvsImageBuilder builder(image);
+  TEST_ASSERT_EQUAL(ESP_ERR_INVALID_STATE, builder.add(NvsValue::of("a", (uint8_t)1)));
+  TEST_ASSERT_EQUAL(ESP_ERR_NVS_INVALID_NAME, builder.setNamespace(""));
+  TEST_ASSERT_EQUAL(ESP_ERR_NVS_KEY_TOO_LONG, builder.setNamespace("0123456789abcdef"));
+  TEST_ASSERT_EQUAL(ESP_OK, builder.setNamespace("x"));
+  std::string text(4001, 'a');
+  TEST_ASSERT_EQUAL(ESP_ERR_NVS_VALUE_TOO_LONG, builder.add(NvsValue::of(NvsKey::dynamic("s"), text.c_str())));
+
+  // one usable page: a blob of two pages doesn't fit
+  std::vector<uint8_t> blob(NVS_PAGE_SIZE * 2);
+  TEST_ASSERT_EQUAL(ESP_ERR_NVS_NOT_ENOUGH_SPACE, builder.add(NvsValue::blob("b", blob.data(), blob.size())));
+  TEST_ASSERT_EQUAL(ESP_ERR_INVALID_STATE, builder.add(NvsValue::of("a", (uint8_t)1)));
+  TEST_ASSERT_EQUAL(ESP_ERR_NVS_NOT_ENOUGH_SPACE, builder.finish());
+}
@@ -0,0 +1,123 @@
+#include "NVS.h"
+#include "unity.h"
+
+#include <vector>
+
+static std::vector<uint8_t> pattern(size_t size)
+{
+  std::vector<uint8_t> data(size);
+  for (size_t i = 0; i < size; i++)
+    data[i] = (uint8_t)(i * 31 + i / 256);
+  return data;
+}
+
+static void check_object(Nvs &nvs, const char *key, const std::vector<uint8_t> &expected)
+{
+  uint8_t chunk[256];
+  const NvsObjectReader reader_view(nvs, key, chunk);
+  TEST_ASSERT_EQUAL(ESP_OK, reader_view.last_error());
+
+  NvsObjectReader reader(nvs, key, chunk);
+  TEST_ASSERT_EQUAL(expected.size(), reader.size());
+  std::vector<uint8_t> data(expected.size());
+  TEST_ASSERT_EQUAL(ESP_OK, reader.readAt(0, data.data(), data.size()));
+  TEST_ASSERT_EQUAL_MEMORY(expected.data(), data.data(), data.size());
+}
+
+TEST_CASE("an object written in chunks is read back", "[object]")
+{
+  NvsRamBackend backend;
+  Nvs nvs(backend, "object");
+  std::vector<uint8_t> data = pattern(3000);
+
+  uint8_t chunk[256];
+  NvsObjectWriter writer(nvs, "firmware", chunk);
+  TEST_ASSERT_EQUAL(ESP_OK, writer.last_error());
+  // odd pieces, across chunk boundaries
+  for (size_t offset = 0; offset < data.size(); offset += 97)
+    TEST_ASSERT_EQUAL(ESP_OK, writer.write(data.data() + offset, std::min((size_t)97, data.size() - offset)));
+  TEST_ASSERT_EQUAL(ESP_OK, writer.finish());
+
+  check_object(nvs, "firmware", data);
+}
+
+TEST_CASE("an object replaces a value queued for its key in async mode", "[object]")
+{
+  NvsRamBackend backend;
+  Nvs nvs(backend, "object");
+  nvs.setAsync(true);
+  std::vector<uint8_t> data = pattern(700);
+
+  for (uint32_t i = 0; i < NVS_ASYNC_QUEUE_SIZE / 2; i++)
+    TEST_ASSERT_EQUAL(ESP_OK, nvs.set("config", i, NULL));
+  uint8_t chunk[256];
+  NvsObjectWriter writer(nvs, "config", chunk);
+  TEST_ASSERT_EQUAL(ESP_OK, writer.write(data.data(), data.size()));
+  TEST_ASSERT_EQUAL(ESP_OK, nvs.set("config", (uint32_t)1, NULL));
+  TEST_ASSERT_EQUAL(ESP_OK, writer.finish());
+  nvs.setAsync(false);
+
+  check_object(nvs, "config", data);
+}
+
+TEST_CASE("a corrupted manifest is not an object", "[object]")
+{
+  NvsRamBackend backend;
+  Nvs nvs(backend, "object");
+  uint8_t chunk[256];
+  uint8_t data[16];
+
+  static const NvsObjectManifest corrupted[] = {
+      {NVS_OBJECT_MAGIC, 100, 0, 0, 0},                               // no chunk size
+      {NVS_OBJECT_MAGIC, 256 * NVS_OBJECT_MAX_CHUNKS + 1, 256, 0, 0}, // more chunks than allowed
+      {NVS_OBJECT_MAGIC, 100, 256, 2, 0},                             // no such generation
+  };
+  for (const NvsObjectManifest &manifest : corrupted)
+  {
+    TEST_ASSERT_EQUAL(ESP_OK, nvs.setObject("cert", &manifest, sizeof(manifest)));
+    NvsObjectReader reader(nvs, "cert", chunk);
+    TEST_ASSERT_EQUAL(ESP_ERR_NVS_TYPE_MISMATCH, reader.last_error());
+    TEST_ASSERT_EQUAL(0, reader.size());
+    TEST_ASSERT_NOT_EQUAL(ESP_OK, reader.readAt(0, data, sizeof(data)));
+  }
+}
+
+/**
+ * @brief NvsRamBackend whose commits fail on demand
+ */
+class FailingCommitBackend : public NvsRamBackend
+{
+public:
+  bool fail = false;
+
+  esp_err_t commit(nvs_handle_t handle) override
+  {
+    if (fail)
+      return ESP_FAIL;
+    return NvsRamBackend::commit(handle);
+  }
+};
+
+TEST_CASE("a failed commit after the manifest keeps the new object readable", "[object]")
+{
+  FailingCommitBackend backend;
+  Nvs nvs(backend, "object");
+  uint8_t chunk[256];
+  std::vector<uint8_t> first = pattern(600);
+  std::vector<uint8_t> second = pattern(900);
+  second[0] ^= 0xff;
+
+  {
+    NvsObjectWriter writer(nvs, "table", chunk);
+    TEST_ASSERT_EQUAL(ESP_OK, writer.write(first.data(), first.size()));
+    TEST_ASSERT_EQUAL(ESP_OK, writer.finish());
+  }
+  {
+    NvsObjectWriter writer(nvs, "table", chunk);
+    TEST_ASSERT_EQUAL(ESP_OK, writer.write(second.data(), second.size()));
+    backend.fail = true;
+    TEST_ASSERT_EQUAL(ESP_FAIL, writer.finish());
+  }
+  backend.fail = false;
+  check_object(nvs, "table", second);
+}
@@ -0,0 +1,34 @@
+#include "NVS.h"
+#include "esp_private/partition_linux.h"
+#include "unity.h"
+
+// raw partition of the test app
+#define RING_PARTITION "log"
+
+TEST_CASE("a failed write at the start of a sector loses no later record", "[ring]")
+{
+  {
+    NvsRingLog log(RING_PARTITION, sizeof(uint64_t));
+    TEST_ASSERT_EQUAL(ESP_OK, log.clear());
+  }
+
+  {
+    NvsCounter counter(RING_PARTITION);
+    // 16 byte slots: the first sector is full after 256 increments
+    for (int i = 0; i < 256; i++)
+      TEST_ASSERT_EQUAL(ESP_OK, counter.add(1));
+
+    // the first slot of the next sector fails
+    esp_partition_fail_after(0, ESP_PARTITION_FAIL_AFTER_MODE_WRITE);
+    TEST_ASSERT_NOT_EQUAL(ESP_OK, counter.add(1));
+    esp_partition_fail_after(SIZE_MAX, 0);
+
+    for (int i = 0; i < 3; i++)
+      TEST_ASSERT_EQUAL(ESP_OK, counter.add(1));
+    TEST_ASSERT_EQUAL(259, counter.value());
+  }
+
+  // the records after the failed one are found again
+  NvsCounter reopened(RING_PARTITION);
+  TEST_ASSERT_EQUAL(259, reopened.value());
+}
@@ -0,0 +1,65 @@
+#include "NVS.h"
+#include "unity.h"
+
+#include <string.h>
+
+struct Calibration
+{
+  uint8_t table[96];
+};
+
+struct Config
+{
+  uint16_t buffsize;
+  char name[64];
+  Calibration calibration;
+};
+
+static constexpr Config default_config = {};
+
+static constexpr NvsField config_schema[] = {
+    NVS_FIELD(Config, buffsize, "buffsize", 4096),
+    NVS_FIELD(Config, name, "name", "device"),
+    NVS_FIELD(Config, calibration, "calib", &default_config.calibration),
+};
+
+static void check_round_trip(size_t compression)
+{
+  NvsRamBackend backend;
+  Nvs nvs(backend, "schema");
+  nvs.setCompression(compression);
+
+  Config config = {};
+  config.buffsize = 512;
+  // long runs that compress well
+  memset(config.name, 'x', sizeof(config.name) - 1);
+  memset(config.calibration.table, 7, sizeof(config.calibration.table));
+  TEST_ASSERT_EQUAL(ESP_OK, nvs.store(config_schema, &config));
+
+  Nvs reader(backend, "schema");
+  Config loaded;
+  TEST_ASSERT_EQUAL(ESP_OK, reader.load(config_schema, &loaded));
+  TEST_ASSERT_EQUAL(512, loaded.buffsize);
+  TEST_ASSERT_EQUAL_STRING(config.name, loaded.name);
+  TEST_ASSERT_EQUAL_MEMORY(config.calibration.table, loaded.calibration.table, sizeof(loaded.calibration.table));
+}
+
+TEST_CASE("load() reads what store() wrote", "[schema]")
+{
+  check_round_trip(0);
+}
+
+TEST_CASE("load() expands compressed strings and blobs", "[schema]")
+{
+  check_round_trip(16);
+}
+
+TEST_CASE("load() keeps the default of a missing key", "[schema]")
+{
+  NvsRamBackend backend;
+  Nvs nvs(backend, "schema");
+  Config loaded;
+  TEST_ASSERT_EQUAL(ESP_OK, nvs.load(config_schema, &loaded));
+  TEST_ASSERT_EQUAL(4096, loaded.buffsize);
+  TEST_ASSERT_EQUAL_STRING("device", loaded.name);
+}
@@ -0,0 +1,181 @@
+#include "counting_backend.h"
+#include "unity.h"
+
+#include <algorithm>
+#include <fcntl.h>
+#include <string>
+#include <unistd.h>
+
+#define SNAPSHOT_PATH "/tmp/nvs_test_snapshot.nvss"
+
+struct Image
+{
+  std::vector<uint8_t> data;
+  size_t offset;
+};
+
+static esp_err_t write_image(const void *data, size_t length, void *arg)
+{
+  Image *image = (Image *)arg;
+  image->data.insert(image->data.end(), (const uint8_t *)data, (const uint8_t *)data + length);
+  return ESP_OK;
+}
+
+// hands the image over in small pieces, the way a socket would
+static esp_err_t read_image(void *data, size_t *length, void *arg)
+{
+  Image *image = (Image *)arg;
+  size_t left = image->data.size() - image->offset;
+  *length = std::min({*length, left, (size_t)7});
+  memcpy(data, image->data.data() + image->offset, *length);
+  image->offset += *length;
+  return ESP_OK;
+}
+
+static esp_err_t rewind_image(void *arg)
+{
+  ((Image *)arg)->offset = 0;
+  return ESP_OK;
+}
+
+static Image export_image()
+{
+  NvsRamBackend backend;
+  Nvs nvs(backend, "source");
+  for (uint32_t i = 0; i < 20; i++)
+    nvs.setUInt32(("k" + std::to_string(i)).c_str(), i * 1000);
+  nvs.setCharArray("name", "device");
+
+  Image image = {};
+  uint8_t buffer[64];
+  TEST_ASSERT_EQUAL(ESP_OK, nvs.exportSnapshot(write_image, &image, buffer));
+  return image;
+}
+
+static size_t name_offset(const Image &image)
+{
+  static const char value[] = "device";
+  auto found = std::search(image.data.begin(), image.data.end(), value, value + sizeof(value));
+  TEST_ASSERT_TRUE(found != image.data.end());
+  return found - image.data.begin();
+}
+
+TEST_CASE("a snapshot is imported with one commit", "[snapshot]")
+{
+  Image image = export_image();
+  CountingBackend backend;
+  Nvs nvs(backend, "target");
+  nvs.setUInt32("k3", 3000);
+  backend.reset();
+
+  uint8_t buffer[64];
+  NvsSyncResult summary;
+  TEST_ASSERT_EQUAL(ESP_OK, nvs.importSnapshot(read_image, rewind_image, &image, buffer, &summary));
+  TEST_ASSERT_EQUAL(20, summary.written);
+  TEST_ASSERT_EQUAL(1, summary.unchanged);
+  TEST_ASSERT_EQUAL(19, backend.writes.size());
+  TEST_ASSERT_EQUAL(1, backend.commits);
+  TEST_ASSERT_EQUAL(19000, nvs.getUInt32("k19", 0));
+  TEST_ASSERT_EQUAL_STRING("device", nvs.getString("name").get());
+}
+
+TEST_CASE("a damaged snapshot writes nothing", "[snapshot]")
+{
+  Image image = export_image();
+  uint8_t buffer[64];
+  CountingBackend backend;
+  Nvs nvs(backend, "target");
+
+  // a damaged string value: the records keep their structure, only the CRC tells
+  Image damaged = image;
+  damaged.data[name_offset(image)] ^= 0x10;
+  TEST_ASSERT_EQUAL(ESP_ERR_INVALID_CRC, nvs.importSnapshot(read_image, rewind_image, &damaged, buffer));
+
+  Image truncated = image;
+  truncated.data.resize(truncated.data.size() - 3);
+  TEST_ASSERT_EQUAL(ESP_ERR_INVALID_SIZE, nvs.importSnapshot(read_image, rewind_image, &truncated, buffer));
+
+  TEST_ASSERT_EQUAL(0, backend.writes.size());
+  TEST_ASSERT_EQUAL(0, backend.commits);
+  TEST_ASSERT_FALSE(nvs.exists("name"));
+}
+
+TEST_CASE("a snapshot is imported from a file, not from a pipe", "[snapshot]")
+{
+  Image image = export_image();
+  uint8_t buffer[64];
+
+  int fd = open(SNAPSHOT_PATH, O_RDWR | O_CREAT | O_TRUNC, 0644);
+  TEST_ASSERT_GREATER_OR_EQUAL(0, fd);
+  TEST_ASSERT_EQUAL(image.data.size(), write(fd, image.data.data(), image.data.size()));
+  lseek(fd, 0, SEEK_SET);
+  CountingBackend from_file;
+  Nvs file_nvs(from_file, "target");
+  TEST_ASSERT_EQUAL(ESP_OK, file_nvs.importSnapshot(fd, buffer));
+  TEST_ASSERT_EQUAL(20, from_file.writes.size());
+
+  // damaged file: checked in a first pass, nothing written
+  lseek(fd, name_offset(image), SEEK_SET);
+  uint8_t byte = image.data[name_offset(image)] ^ 0x10;
+  TEST_ASSERT_EQUAL(1, write(fd, &byte, 1));
+  lseek(fd, 0, SEEK_SET);
+  CountingBackend from_damaged;
+  Nvs damaged_nvs(from_damaged, "target");
+  TEST_ASSERT_EQUAL(ESP_ERR_INVALID_CRC, damaged_nvs.importSnapshot(fd, buffer));
+  TEST_ASSERT_EQUAL(0, from_damaged.writes.size());
+  close(fd);
+  unlink(SNAPSHOT_PATH);
+
+  // a pipe can't be read twice
+  int pipe_fds[2];
+  TEST_ASSERT_EQUAL(0, pipe(pipe_fds));
+  TEST_ASSERT_EQUAL(image.data.size(), write(pipe_fds[1], image.data.data(), image.data.size()));
+  close(pipe_fds[1]);
+  CountingBackend from_pipe;
+  Nvs pipe_nvs(from_pipe, "target");
+  TEST_ASSERT_EQUAL(ESP_ERR_NOT_SUPPORTED, pipe_nvs.importSnapshot(pipe_fds[0], buffer));
+  TEST_ASSERT_EQUAL(0, from_pipe.writes.size());
+  close(pipe_fds[0]);
+}
+
+// a source replaced by another valid image between the check and the second pass
+struct ChangingImage
+{
+  Image first;
+  Image second;
+  Image *current;
+};
+
+static esp_err_t read_changing(void *data, size_t *length, void *arg)
+{
+  return read_image(data, length, ((ChangingImage *)arg)->current);
+}
+
+static esp_err_t rewind_changing(void *arg)
+{
+  ChangingImage *changing = (ChangingImage *)arg;
+  changing->current = &changing->second;
+  return rewind_image(changing->current);
+}
+
+TEST_CASE("a snapshot that changes between the two passes is not committed", "[snapshot]")
+{
+  ChangingImage changing = {export_image(), {}, NULL};
+  changing.current = &changing.first;
+  {
+    NvsRamBackend backend;
+    Nvs other(backend, "source");
+    other.setUInt32("k0", 1);
+    uint8_t buffer[64];
+    TEST_ASSERT_EQUAL(ESP_OK, other.exportSnapshot(write_image, &changing.second, buffer));
+  }
+
+  uint8_t buffer[64];
+  CountingBackend backend;
+  Nvs nvs(backend, "target");
+  TEST_ASSERT_EQUAL(ESP_ERR_INVALID_CRC, nvs.importSnapshot(read_changing, rewind_changing, &changing, buffer));
+  TEST_ASSERT_EQUAL(0, backend.commits);
+
+  Image plain = export_image();
+  TEST_ASSERT_EQUAL(ESP_ERR_NOT_SUPPORTED, nvs.importSnapshot(read_image, NULL, &plain, buffer));
+}
@@ -0,0 +1,66 @@
+#include "counting_backend.h"
+#include "unity.h"
+
+#include <string>
+
+static const NvsValue desired[] = {
+    NvsValue::of("mode", (uint8_t)2),
+    NvsValue::of("name", "device"),
+};
+
+TEST_CASE("sync() erases every entry missing from values", "[sync]")
+{
+  NvsRamBackend backend;
+  Nvs nvs(backend, "sync");
+  // more than one walk's worth of keys
+  for (uint32_t i = 0; i < 50; i++)
+    nvs.setUInt32(("old" + std::to_string(i)).c_str(), i);
+  nvs.setUInt8("mode", 2);
+
+  NvsSyncResult summary;
+  TEST_ASSERT_EQUAL(ESP_OK, nvs.sync(desired, true, &summary));
+  TEST_ASSERT_EQUAL(1, summary.written);
+  TEST_ASSERT_EQUAL(1, summary.unchanged);
+  TEST_ASSERT_EQUAL(50, summary.erased);
+  TEST_ASSERT_EQUAL(2, backend.size());
+  TEST_ASSERT_FALSE(nvs.exists("old49"));
+}
+
+TEST_CASE("sync() erases values still waiting in the write-back cache", "[sync]")
+{
+  CountingBackend backend;
+  Nvs nvs(backend, "sync");
+  nvs.setWriteBack(true, 60000, 8);
+  nvs.setUInt32("old", 3);
+  nvs.flush();
+  // one key changed since the last flush, one only known to the cache
+  nvs.setUInt32("old", 4);
+  nvs.setUInt32("fresh", 1);
+
+  NvsSyncResult summary;
+  TEST_ASSERT_EQUAL(ESP_OK, nvs.sync(desired, true, &summary));
+  TEST_ASSERT_EQUAL(2, summary.erased);
+  TEST_ASSERT_EQUAL(ESP_OK, nvs.flush());
+  TEST_ASSERT_FALSE(nvs.exists("fresh"));
+  TEST_ASSERT_FALSE(nvs.exists("old"));
+  TEST_ASSERT_EQUAL(2, backend.size());
+}
+
+TEST_CASE("sync() compares short blobs and writes long ones", "[sync]")
+{
+  NvsRamBackend backend;
+  Nvs nvs(backend, "sync");
+  uint8_t small[NVS_ELIDE_COMPARE_SIZE] = {1, 2, 3};
+  uint8_t large[NVS_ELIDE_COMPARE_SIZE + 1] = {4, 5, 6};
+  nvs.setObject("small", small, sizeof(small));
+  nvs.setObject("large", large, sizeof(large));
+
+  const NvsValue values[] = {
+      NvsValue::blob("small", small, sizeof(small)),
+      NvsValue::blob("large", large, sizeof(large)),
+  };
+  NvsSyncResult summary;
+  TEST_ASSERT_EQUAL(ESP_OK, nvs.sync(values, false, &summary));
+  TEST_ASSERT_EQUAL(1, summary.unchanged);
+  TEST_ASSERT_EQUAL(1, summary.written);
+}
@@ -0,0 +1,149 @@
+#include "counting_backend.h"
+#include "unity.h"
+
+TEST_CASE("write-back coalesces repeated writes into one per key", "[write_back]")
+{
+  CountingBackend backend;
+  {
+    Nvs nvs(backend, "wb");
+    nvs.setWriteBack(true, 60000, 8);
+
+    for (uint32_t i = 0; i < 1000; i++)
+    {
+      TEST_ASSERT_EQUAL(ESP_OK, nvs.setUInt32("count", i));
+      TEST_ASSERT_EQUAL(ESP_OK, nvs.setInt64("position", -(int64_t)i));
+    }
+    TEST_ASSERT_EQUAL(0, backend.writes.size());
+    TEST_ASSERT_EQUAL(0, backend.commits);
+    TEST_ASSERT_EQUAL(2, nvs.dirtyCount());
+    TEST_ASSERT_EQUAL(999, nvs.getUInt32("count", 0));
+    TEST_ASSERT_TRUE(nvs.exists("position"));
+
+    TEST_ASSERT_EQUAL(ESP_OK, nvs.flush());
+    TEST_ASSERT_EQUAL(2, backend.writes.size());
+    TEST_ASSERT_EQUAL(1, backend.commits);
+    TEST_ASSERT_EQUAL(0, nvs.dirtyCount());
+
+    // nothing left to write
+    TEST_ASSERT_EQUAL(ESP_OK, nvs.flush());
+    TEST_ASSERT_EQUAL(2, backend.writes.size());
+  }
+
+  Nvs reopened(backend, "wb");
+  TEST_ASSERT_EQUAL(999, reopened.getUInt32("count", 0));
+  TEST_ASSERT_EQUAL(-999, reopened.getInt64("position", 0));
+}
+
+TEST_CASE("write-back keeps flash at the last flushed value until the next flush", "[write_back]")
+{
+  CountingBackend backend;
+  Nvs nvs(backend, "wb");
+  Nvs other(backend, "wb"); // sees the backend only
+  nvs.setWriteBack(true, 60000, 8);
+
+  nvs.setUInt8("mode", 1);
+  TEST_ASSERT_EQUAL(ESP_OK, nvs.flush());
+  nvs.setUInt8("mode", 2);
+  nvs.setUInt8("mode", 3);
+  TEST_ASSERT_EQUAL(1, other.getUInt8("mode", 0));
+  TEST_ASSERT_EQUAL(3, nvs.getUInt8("mode", 0));
+
+  TEST_ASSERT_EQUAL(ESP_OK, nvs.flush());
+  TEST_ASSERT_EQUAL(3, other.getUInt8("mode", 0));
+  TEST_ASSERT_EQUAL(2, backend.writes.size());
+  TEST_ASSERT_EQUAL(3, backend.writes[1].value);
+}
+
+TEST_CASE("write-back flushes once max_dirty keys are waiting", "[write_back]")
+{
+  CountingBackend backend;
+  Nvs nvs(backend, "wb");
+  nvs.setWriteBack(true, 60000, 4);
+
+  nvs.setUInt16("k0", 0);
+  nvs.setUInt16("k1", 1);
+  nvs.setUInt16("k2", 2);
+  TEST_ASSERT_EQUAL(0, backend.writes.size());
+  nvs.setUInt16("k3", 3);
+  TEST_ASSERT_EQUAL(4, backend.writes.size());
+  TEST_ASSERT_EQUAL(1, backend.commits);
+  TEST_ASSERT_EQUAL(0, nvs.dirtyCount());
+}
+
+TEST_CASE("write-back flushes when the oldest change is due", "[write_back]")
+{
+  CountingBackend backend;
+  Nvs nvs(backend, "wb");
+  nvs.setWriteBack(true, 0, 16);
+
+  nvs.setUInt16("a", 1);
+  nvs.setUInt16("a", 2);
+  TEST_ASSERT_EQUAL(2, backend.writes.size());
+  TEST_ASSERT_EQUAL(0, nvs.dirtyCount());
+}
+
+TEST_CASE("an erased dirty value is not written back", "[write_back]")
+{
+  CountingBackend backend;
+  Nvs nvs(backend, "wb");
+  nvs.setWriteBack(true, 60000, 8);
+
+  nvs.setUInt32("gone", 7);
+  nvs.setUInt32("kept", 8);
+  TEST_ASSERT_EQUAL(ESP_OK, nvs.erase("gone"));
+  TEST_ASSERT_FALSE(nvs.exists("gone"));
+  TEST_ASSERT_EQUAL(ESP_OK, nvs.flush());
+
+  TEST_ASSERT_EQUAL(1, backend.writes.size());
+  TEST_ASSERT_EQUAL_STRING("kept", backend.writes[0].key);
+  Nvs other(backend, "wb");
+  TEST_ASSERT_FALSE(other.exists("gone"));
+}
+
+TEST_CASE("disabling write-back and the destructor flush pending values", "[write_back]")
+{
+  CountingBackend backend;
+  {
+    Nvs nvs(backend, "wb");
+    nvs.setWriteBack(true, 60000, 8);
+    nvs.setUInt8("a", 1);
+    nvs.setWriteBack(false);
+    TEST_ASSERT_EQUAL(1, backend.writes.size());
+
+    nvs.setWriteBack(true, 60000, 8);
+    nvs.setUInt8("b", 2);
+    TEST_ASSERT_EQUAL(1, backend.writes.size());
+  }
+  TEST_ASSERT_EQUAL(2, backend.writes.size());
+
+  Nvs reopened(backend, "wb");
+  TEST_ASSERT_EQUAL(2, reopened.getUInt8("b", 0));
+}
+
+struct Counters
+{
+  uint32_t count;
+  uint32_t fresh;
+};
+
+static constexpr NvsField counters_schema[] = {
+    NVS_FIELD(Counters, count, "count", 0),
+    NVS_FIELD(Counters, fresh, "fresh", 0),
+};
+
+TEST_CASE("load() sees values still waiting in the write-back cache", "[write_back]")
+{
+  CountingBackend backend;
+  Nvs nvs(backend, "wb");
+  nvs.setUInt32("count", 1);
+  nvs.setWriteBack(true, 60000, 8);
+  nvs.setUInt32("count", 5);
+  nvs.setUInt32("fresh", 7);
+
+  Counters counters;
+  TEST_ASSERT_EQUAL(ESP_OK, nvs.load(counters_schema, &counters));
+  TEST_ASSERT_EQUAL(5, counters.count);
+  TEST_ASSERT_EQUAL(7, counters.fresh);
+  TEST_ASSERT_EQUAL(0, nvs.dirtyCount());
+  TEST_ASSERT_EQUAL(5, nvs.getUInt32("count", 0));
+}
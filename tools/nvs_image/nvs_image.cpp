@@ -0,0 +1,412 @@
+// Host tool: builds NVS partition images from CSV files and dumps / checks existing images.
+//
+//   nvs_image build <size> <input.csv> <output.bin> [<input.csv> <output.bin> ...]
+//   nvs_image dump <image.bin>
+//   nvs_image check <image.bin>
+//
+// The CSV format is the one of ESP-IDF's nvs_partition_gen.py:
+//   key,type,encoding,value
+//   factory,namespace,,
+//   serial,data,u32,1234
+//   name,data,string,"device, rev. 2"
+//   cert,file,binary,cert.der
+// encodings: u8 i8 u16 i16 u32 i32 u64 i64 string hex2bin base64 binary (file only), plus float / double
+// stored like Nvs::setFloat / setDouble. dump prints an image in the same format.
+
+#include "NvsImage.h"
+#include "NvsImageBuilder.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <string>
+#include <vector>
+
+static bool read_file(const char *path, std::string *content)
+{
+  FILE *file = fopen(path, "rb");
+  if (file == NULL)
+    return false;
+  char buffer[4096];
+  size_t length;
+  content->clear();
+  while ((length = fread(buffer, 1, sizeof(buffer), file)) > 0)
+    content->append(buffer, length);
+  bool ok = !ferror(file);
+  fclose(file);
+  return ok;
+}
+
+// one record, quotes as written by Python's csv module; false at the end of the input
+static bool read_record(FILE *file, std::vector<std::string> *fields)
+{
+  fields->assign(1, std::string());
+  bool quoted = false, any = false;
+  int c;
+  while ((c = fgetc(file)) != EOF)
+  {
+    any = true;
+    if (quoted)
+    {
+      if (c != '"')
+        fields->back() += (char)c;
+      else if ((c = fgetc(file)) == '"')
+        fields->back() += '"';
+      else
+      {
+        quoted = false;
+        if (c == EOF)
+          break;
+        ungetc(c, file);
+      }
+    }
+    else if (c == '"')
+      quoted = true;
+    else if (c == ',')
+      fields->emplace_back();
+    else if (c == '\n')
+      break;
+    else if (c != '\r')
+      fields->back() += (char)c;
+  }
+  return any;
+}
+
+static int hex_digit(char c)
+{
+  if (c >= '0' && c <= '9')
+    return c - '0';
+  if (c >= 'a' && c <= 'f')
+    return c - 'a' + 10;
+  if (c >= 'A' && c <= 'F')
+    return c - 'A' + 10;
+  return -1;
+}
+
+static bool decode_hex(const std::string &text, std::string *data)
+{
+  data->clear();
+  if (text.size() % 2 != 0)
+    return false;
+  for (size_t i = 0; i < text.size(); i += 2)
+  {
+    int high = hex_digit(text[i]), low = hex_digit(text[i + 1]);
+    if (high < 0 || low < 0)
+      return false;
+    *data += (char)(high << 4 | low);
+  }
+  return true;
+}
+
+static bool decode_base64(const std::string &text, std::string *data)
+{
+  static const char alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+  data->clear();
+  uint32_t bits = 0;
+  int count = 0;
+  for (char c : text)
+  {
+    if (c == '=' || c == '\n' || c == '\r')
+      continue;
+    const char *found = strchr(alphabet, c);
+    if (c == '\0' || found == NULL)
+      return false;
+    bits = bits << 6 | (uint32_t)(found - alphabet);
+    if ((count += 6) >= 8)
+    {
+      count -= 8;
+      *data += (char)(bits >> count);
+    }
+  }
+  return true;
+}
+
+static bool parse_integer(const std::string &text, bool is_signed, int64_t min, uint64_t max, uint64_t *value)
+{
+  char *end;
+  errno = 0;
+  if (is_signed)
+  {
+    long long parsed = strtoll(text.c_str(), &end, 0);
+    *value = (uint64_t)parsed;
+    return errno == 0 && end != text.c_str() && *end == '\0' && parsed >= min && parsed <= (int64_t)max;
+  }
+  if (text.find('-') != std::string::npos)
+    return false;
+  unsigned long long parsed = strtoull(text.c_str(), &end, 0);
+  *value = parsed;
+  return errno == 0 && end != text.c_str() && *end == '\0' && parsed <= max;
+}
+
+static const struct
+{
+  const char *name;
+  nvs_type_t type;
+  int64_t min;
+  uint64_t max;
+} integer_encodings[] = {
+    {"u8", NVS_TYPE_U8, 0, UINT8_MAX},
+    {"i8", NVS_TYPE_I8, INT8_MIN, INT8_MAX},
+    {"u16", NVS_TYPE_U16, 0, UINT16_MAX},
+    {"i16", NVS_TYPE_I16, INT16_MIN, INT16_MAX},
+    {"u32", NVS_TYPE_U32, 0, UINT32_MAX},
+    {"i32", NVS_TYPE_I32, INT32_MIN, INT32_MAX},
+    {"u64", NVS_TYPE_U64, 0, UINT64_MAX},
+    {"i64", NVS_TYPE_I64, INT64_MIN, INT64_MAX},
+};
+
+static const char *integer_encoding(nvs_type_t type)
+{
+  for (const auto &encoded : integer_encodings)
+  {
+    if (encoded.type == type)
+      return encoded.name;
+  }
+  return NULL;
+}
+
+static esp_err_t add_integer(NvsImageBuilder &builder, const char *key, const std::string &encoding, const std::string &text)
+{
+  for (const auto &encoded : integer_encodings)
+  {
+    if (encoding != encoded.name)
+      continue;
+    uint64_t bits;
+    if (!parse_integer(text, (encoded.type & 0xf0) == 0x10, encoded.min, encoded.max, &bits))
+      return ESP_ERR_INVALID_ARG;
+    return builder.add(NvsValue{NvsKey::dynamic(key), encoded.type, bits, NULL, 0});
+  }
+  return ESP_ERR_NOT_SUPPORTED;
+}
+
+static esp_err_t add_record(NvsImageBuilder &builder, const std::vector<std::string> &record)
+{
+  const std::string &type = record[1], &encoding = record[2];
+  std::string text = record[3];
+  const char *key = record[0].c_str();
+
+  if (type == "namespace")
+    return builder.setNamespace(key);
+  if (type == "file" && !read_file(text.c_str(), &text))
+    return ESP_ERR_NOT_FOUND;
+  if (type != "data" && type != "file")
+    return ESP_ERR_NOT_SUPPORTED;
+
+  std::string data;
+  if (encoding == "string")
+    return builder.add(NvsValue::of(NvsKey::dynamic(key), text.c_str()));
+  if (encoding == "hex2bin" || encoding == "base64" || (encoding == "binary" && type == "file"))
+  {
+    if (encoding == "binary")
+      data = text;
+    else if (!(encoding == "hex2bin" ? decode_hex(text, &data) : decode_base64(text, &data)))
+      return ESP_ERR_INVALID_ARG;
+    return builder.add(NvsValue::blob(NvsKey::dynamic(key), data.data(), data.size()));
+  }
+  if (encoding == "float" || encoding == "double")
+  {
+    char *end;
+    double value = strtod(text.c_str(), &end);
+    if (end == text.c_str() || *end != '\0')
+      return ESP_ERR_INVALID_ARG;
+    if (encoding == "float")
+      return builder.add(NvsValue::of(NvsKey::dynamic(key), (float)value));
+    return builder.add(NvsValue::of(NvsKey::dynamic(key), value));
+  }
+  return add_integer(builder, key, encoding, text);
+}
+
+static int build(size_t size, const char *input, const char *output)
+{
+  FILE *csv = fopen(input, "r");
+  if (csv == NULL)
+  {
+    fprintf(stderr, "%s: can't open\n", input);
+    return 1;
+  }
+
+  std::vector<uint8_t> image(size);
+  NvsImageBuilder builder(image);
+  std::vector<std::string> record;
+  esp_err_t err = ESP_OK;
+  for (size_t line = 1; err == ESP_OK && read_record(csv, &record); line++)
+  {
+    if (record[0].empty() || record[0][0] == '#' || (line == 1 && record[0] == "key"))
+      continue;
+    record.resize(4);
+    if ((err = add_record(builder, record)) != ESP_OK)
+      fprintf(stderr, "%s:%zu: %s: error 0x%x\n", input, line, record[0].c_str(), err);
+  }
+  fclose(csv);
+  if (err != ESP_OK)
+    return 1;
+  if ((err = builder.finish()) != ESP_OK)
+  {
+    fprintf(stderr, "%s: error 0x%x\n", input, err);
+    return 1;
+  }
+
+  FILE *bin = fopen(output, "wb");
+  bool written = bin != NULL && fwrite(image.data(), 1, image.size(), bin) == image.size();
+  if (bin != NULL && fclose(bin) != 0)
+    written = false;
+  if (!written)
+  {
+    fprintf(stderr, "%s: can't write\n", output);
+    return 1;
+  }
+  printf("%s: %zu of %zu pages\n", output, builder.pagesUsed(), size / NVS_PAGE_SIZE);
+  return 0;
+}
+
+static void print_field(const char *text)
+{
+  if (strpbrk(text, ",\"\n\r") == NULL)
+  {
+    fputs(text, stdout);
+    return;
+  }
+  putchar('"');
+  for (; *text != '\0'; text++)
+  {
+    if (*text == '"')
+      putchar('"');
+    putchar(*text);
+  }
+  putchar('"');
+}
+
+static void print_entry(NvsImage &image, nvs_handle_t handle, const nvs_entry_info_t &info)
+{
+  const char *encoding = integer_encoding(info.type);
+  if (encoding == NULL && info.type != NVS_TYPE_STR && info.type != NVS_TYPE_BLOB)
+    return;
+  print_field(info.key);
+  if (info.type == NVS_TYPE_STR || info.type == NVS_TYPE_BLOB)
+  {
+    size_t length = 0;
+    std::vector<char> data;
+    esp_err_t err = info.type == NVS_TYPE_STR ? image.getStr(handle, info.key, NULL, &length)
+                                              : image.getBlob(handle, info.key, NULL, &length);
+    data.resize(length + 1);
+    if (err == ESP_OK)
+      err = info.type == NVS_TYPE_STR ? image.getStr(handle, info.key, data.data(), &length)
+                                      : image.getBlob(handle, info.key, data.data(), &length);
+    if (err != ESP_OK)
+    {
+      printf(",data,,# error 0x%x\n", err);
+      return;
+    }
+    if (info.type == NVS_TYPE_STR)
+    {
+      fputs(",data,string,", stdout);
+      print_field(data.data());
+    }
+    else
+    {
+      fputs(",data,hex2bin,", stdout);
+      for (size_t i = 0; i < length; i++)
+        printf("%02x", (uint8_t)data[i]);
+    }
+    putchar('\n');
+    return;
+  }
+
+  uint64_t bits = 0;
+  image.getScalar(handle, info.key, info.type, &bits);
+  if ((info.type & 0xf0) == 0x10)
+    printf(",data,%s,%lld\n", encoding, (long long)bits);
+  else
+    printf(",data,%s,%llu\n", encoding, (unsigned long long)bits);
+}
+
+static int open_image(const char *path)
+{
+  int fd = open(path, O_RDONLY);
+  if (fd < 0)
+    fprintf(stderr, "%s: can't open\n", path);
+  return fd;
+}
+
+static int dump(const char *path)
+{
+  int fd = open_image(path);
+  if (fd < 0)
+    return 1;
+  NvsImage image(fd);
+  close(fd);
+  if (image.last_error() != ESP_OK)
+  {
+    fprintf(stderr, "%s: error 0x%x\n", path, image.last_error());
+    return 1;
+  }
+
+  printf("key,type,encoding,value\n");
+  char current[NVS_KEY_NAME_MAX_SIZE] = {};
+  nvs_handle_t handle = 0;
+  for (void *it = image.entryFind(NULL, NVS_TYPE_ANY); it != NULL; it = image.entryNext(it))
+  {
+    nvs_entry_info_t info;
+    image.entryInfo(it, &info);
+    if (handle == 0 || strcmp(current, info.namespace_name) != 0)
+    {
+      strcpy(current, info.namespace_name);
+      image.open(current, NVS_READONLY, &handle);
+      print_field(current);
+      printf(",namespace,,\n");
+    }
+    print_entry(image, handle, info);
+  }
+  return 0;
+}
+
+static int check(const char *path)
+{
+  int fd = open_image(path);
+  if (fd < 0)
+    return 1;
+  NvsImage image(fd);
+  close(fd);
+  if (image.last_error() != ESP_OK)
+  {
+    fprintf(stderr, "%s: error 0x%x\n", path, image.last_error());
+    return 1;
+  }
+  printf("%s: %zu entries, %zu damaged\n", path, image.size(), image.damaged());
+  return image.damaged() == 0 ? 0 : 2;
+}
+
+static int usage()
+{
+  fprintf(stderr, "usage: nvs_image build <size> <input.csv> <output.bin> [<input.csv> <output.bin> ...]\n"
+                  "       nvs_image dump <image.bin>\n"
+                  "       nvs_image check <image.bin>\n");
+  return 1;
+}
+
+int main(int argc, char **argv)
+{
+  if (argc == 3 && strcmp(argv[1], "dump") == 0)
+    return dump(argv[2]);
+  if (argc == 3 && strcmp(argv[1], "check") == 0)
+    return check(argv[2]);
+  if (argc < 5 || argc % 2 != 1 || strcmp(argv[1], "build") != 0)
+    return usage();
+
+  char *end;
+  size_t size = strtoul(argv[2], &end, 0);
+  if (*end != '\0' || size % NVS_PAGE_SIZE != 0 || size < 2 * NVS_PAGE_SIZE)
+  {
+    fprintf(stderr, "size must be a multiple of %d, at least 2 pages\n", NVS_PAGE_SIZE);
+    return 1;
+  }
+  // one image per pair, in one process: batches of thousands of units
+  int failed = 0;
+  for (int i = 3; i < argc; i += 2)
+    failed += build(size, argv[i], argv[i + 1]);
+  return failed == 0 ? 0 : 1;
+}